@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <access_log.h>
+#include <common.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+  // records of the ring of each thread, a power of two
+  RingRecords = 4096,
+  // milliseconds the writer sleeps between batches, unless a ring fills up by half earlier
+  WriterInterval = 1000,
+};
+
+// records of a thread, which is a single-producer single-consumer queue
+//  head is only advanced by the thread owning the ring, and tail by the writer
+struct ring {
+  struct access_log_record records[RingRecords];
+  size_t head;
+  size_t tail;
+  size_t dropped;  // records dropped as the ring is full, counted by the owner
+  size_t reported; // records dropped which are already logged
+  struct ring *next;
+};
+struct access_log {
+  int file_descriptor;
+  uint64_t clock_offset;
+  pthread_mutex_t lock; // guards the list of rings and the writer
+  pthread_cond_t wake;
+  struct ring *rings;
+  pthread_t writer;
+  bool stopping;
+};
+
+static struct access_log *get_access_log(void) {
+  static struct access_log access_log = {.file_descriptor = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+  return &access_log;
+}
+
+// write blocks as a whole, retrying on short writes, return false if the file cannot be written
+static bool write_vector(int file_descriptor, struct iovec *vector, int count) {
+  while (count > 0) {
+    ssize_t written = writev(file_descriptor, vector, count);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    for (; count > 0 && (size_t)written >= vector->iov_len; vector++, count--) {
+      written -= vector->iov_len;
+    }
+    if (count > 0) {
+      vector->iov_base = (char *)vector->iov_base + written;
+      vector->iov_len -= written;
+    }
+  }
+  return true;
+}
+// append what every ring holds to the file, which shall be called with the lock held
+static void drain(struct access_log *access_log) {
+  for (struct ring *ring = access_log->rings; ring != NULL; ring = ring->next) {
+    size_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->reported) {
+      logging_warning(
+          "%zu access log records dropped as the writer fell behind\n", dropped - ring->reported
+      );
+      ring->reported = dropped;
+    }
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == ring->tail) {
+      continue;
+    }
+    size_t start = ring->tail & (RingRecords - 1);
+    size_t count = head - ring->tail;
+    size_t first = count < RingRecords - start ? count : RingRecords - start;
+    struct iovec vector[2] = {
+        {&ring->records[start], sizeof(struct access_log_record) * first},
+        {ring->records, sizeof(struct access_log_record) * (count - first)},
+    };
+    if (!write_vector(access_log->file_descriptor, vector, first < count ? 2 : 1)) {
+      logging_error("cannot write the access log: %s\n", strerror(errno));
+    }
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+  }
+}
+static void *run_writer(void *context) {
+  struct access_log *access_log = context;
+  pthread_mutex_lock(&access_log->lock);
+  while (!access_log->stopping) {
+    drain(access_log);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += WriterInterval / 1000;
+    deadline.tv_nsec += WriterInterval % 1000 * 1000000l;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000l;
+    deadline.tv_nsec %= 1000000000l;
+    pthread_cond_timedwait(&access_log->wake, &access_log->lock, &deadline);
+  }
+  drain(access_log);
+  pthread_mutex_unlock(&access_log->lock);
+  return NULL;
+}
+// stop the writer once every record is written, which is registered with atexit(3)
+static void stop_writer(void) {
+  struct access_log *access_log = get_access_log();
+  pthread_mutex_lock(&access_log->lock);
+  access_log->stopping = true;
+  pthread_cond_signal(&access_log->wake);
+  pthread_mutex_unlock(&access_log->lock);
+  pthread_join(access_log->writer, NULL);
+}
+
+bool access_log_open(const char *path) {
+  struct access_log *access_log = get_access_log();
+  int file_descriptor = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+  if (file_descriptor == -1) {
+    logging_error("cannot open access log %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  // a new log starts with the header, while an existing one shall come from a host of the same byte order
+  struct access_log_header header = {.record_size = sizeof(struct access_log_record)};
+  memcpy(header.magic, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_LENGTH);
+  struct stat status;
+  fstat(file_descriptor, &status);
+  if (status.st_size == 0) {
+    if (write(file_descriptor, &header, sizeof(header)) != sizeof(header)) {
+      logging_error("cannot write access log %s: %s\n", path, strerror(errno));
+      close(file_descriptor);
+      return false;
+    }
+  } else {
+    struct access_log_header existing;
+    if (pread(file_descriptor, &existing, sizeof(existing), 0) != sizeof(existing) ||
+        memcmp(&existing, &header, sizeof(header)) != 0 ||
+        (status.st_size - sizeof(header)) % sizeof(struct access_log_record) != 0) {
+      logging_error("%s is not an access log which can be appended to\n", path);
+      close(file_descriptor);
+      return false;
+    }
+  }
+  access_log->file_descriptor = file_descriptor;
+
+  struct timespec real, monotonic;
+  clock_gettime(CLOCK_REALTIME, &real);
+  clock_gettime(CLOCK_MONOTONIC, &monotonic);
+  access_log->clock_offset =
+      (real.tv_sec - monotonic.tv_sec) * 1000000000ll + (real.tv_nsec - monotonic.tv_nsec);
+
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&access_log->wake, &attributes);
+  pthread_condattr_destroy(&attributes);
+  pthread_create(&access_log->writer, NULL, run_writer, access_log);
+  atexit(stop_writer);
+  return true;
+}
+
+uint64_t access_log_get_clock_offset(void) { return get_access_log()->clock_offset; }
+
+static struct ring *get_ring(struct access_log *access_log) {
+  static _Thread_local struct ring *ring = NULL;
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(struct ring));
+    pthread_mutex_lock(&access_log->lock);
+    ring->next = access_log->rings;
+    access_log->rings = ring;
+    pthread_mutex_unlock(&access_log->lock);
+  }
+  return ring;
+}
+
+void access_log_append(const struct access_log_record *record) {
+  struct access_log *access_log = get_access_log();
+  struct ring *ring = get_ring(access_log);
+  size_t head = ring->head;
+  size_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (used == RingRecords) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  ring->records[head & (RingRecords - 1)] = *record;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  // wake the writer up early if it may not keep up, otherwise the record waits for the next batch
+  if (used + 1 == RingRecords / 2) {
+    pthread_cond_signal(&access_log->wake);
+  }
+}
\ No newline at end of file
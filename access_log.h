@@ -0,0 +1,68 @@
+#ifndef ACCESS_LOG_H_
+#define ACCESS_LOG_H_
+#include <stdbool.h>
+#include <stdint.h>
+// a log of every request made of fixed-size binary records, which tools/access_log_decoder converts to JSON
+//  lines
+//  a record is copied into a ring buffer of the calling thread without locks or system calls, while a
+//   background thread appends what every ring holds to the file with a single writev(2) per ring, once a
+//   second or once a ring fills up by half
+//  a record is dropped if the ring of its thread is full, which is logged as a warning
+struct access_log_record;
+
+// open the access log at path for appending and start its writer
+//  return false if the file cannot be opened or holds something else than an access log
+bool access_log_open(const char *path);
+
+// append record to the access log, which shall be open
+void access_log_append(const struct access_log_record *record);
+
+// get the offset in nanoseconds from the monotonic clock to the real time clock, which is taken once the
+//  access log is opened, so records are stamped in real time without reading that clock per request
+uint64_t access_log_get_clock_offset(void);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the following is shared with tools/access_log_decoder.c
+
+// all integers are in the byte order of the host writing the log, which is checked by the magic
+#define ACCESS_LOG_MAGIC "hSSalog1"
+enum {
+  ACCESS_LOG_MAGIC_LENGTH = 8,
+  // method of a request which is not parsed, otherwise it is enum http_request_method
+  ACCESS_LOG_METHOD_INVALID = 0xff,
+  ACCESS_LOG_FLAG_TLS = 1 << 0,     // the request is received over TLS
+  ACCESS_LOG_FLAG_RESUMED = 1 << 1, // the TLS session is resumed from a ticket
+};
+// the log starts with the header, which is followed by records until the end of file
+struct access_log_header {
+  char magic[ACCESS_LOG_MAGIC_LENGTH];
+  uint32_t record_size;
+  uint32_t reserved;
+};
+// NOTE: if you modified these enumerates here, update the corresponding names in tools/access_log_decoder.c
+enum access_log_stage {
+  ACCESS_LOG_STAGE_RECEIVE, // from the first bytes of the request to the whole request received
+  ACCESS_LOG_STAGE_PARSE,
+  ACCESS_LOG_STAGE_RESOLVE, // resolving the path and generating the response
+  ACCESS_LOG_STAGE_RENDER,  // rendering the head of the response
+  ACCESS_LOG_STAGE_SEND,    // from the head rendered to the whole response sent, including the two below
+  ACCESS_LOG_STAGE_READ,    // reading files into memory while sending
+  ACCESS_LOG_STAGE_WAIT,    // waiting for content read or compressed elsewhere while sending
+  ACCESS_LOG_STAGE_MAX      // keep this line at the bottom
+};
+struct access_log_record {
+  uint64_t time;      // nanoseconds since the epoch when the first bytes of the request are received
+  uint64_t path_hash; // hash_string of the path requested without the query, 0 if the request is invalid
+  uint64_t sent_bytes;
+  uint32_t received_bytes;
+  uint32_t latencies[ACCESS_LOG_STAGE_MAX]; // microseconds of each stage
+  uint8_t address[16]; // address of the peer in IPv6, where IPv4 addresses are mapped into ::ffff:0:0/96
+  uint16_t port;
+  uint16_t status; // e.g. 200
+  uint8_t method;
+  uint8_t flags;
+  uint8_t reserved[2];
+};
+_Static_assert(sizeof(struct access_log_record) == 80, "records shall be packed");
+#endif
\ No newline at end of file
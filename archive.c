@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <archive.h>
+#include <common.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct archive {
+  const char *base;
+  size_t size;
+  const struct archive_header *header;
+  const struct archive_slot *slots;
+  // the current archive holds one reference as long as it is current
+  size_t references;
+};
+
+static struct archive **get_current(void) {
+  static struct archive *current = NULL;
+  return &current;
+}
+
+static bool is_valid_range(const struct archive *archive, const struct archive_range *range, bool string) {
+  size_t length = range->length + (string ? 1 : 0);
+  if (range->offset > archive->size || length > archive->size - range->offset) {
+    return false;
+  }
+  return !string || archive->base[range->offset + range->length] == '\0';
+}
+static bool is_valid_variant(const struct archive *archive, const struct archive_variant *variant) {
+  return is_valid_range(archive, &variant->head, false) && is_valid_range(archive, &variant->body, false) &&
+         is_valid_range(archive, &variant->entity_tag, true) &&
+         variant->entity_tag.length < ENTITY_TAG_LENGTH;
+}
+// check that everything referred to by the index lies within the mapping, and that an empty slot ends every
+//  probe, so lookups need no check at all
+static bool is_valid(const struct archive *archive) {
+  const struct archive_header *header = archive->header;
+  if (archive->size < sizeof(struct archive_header) ||
+      memcmp(header->magic, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LENGTH) != 0 ||
+      header->byte_order != ARCHIVE_BYTE_ORDER || header->n_slots == 0 ||
+      (header->n_slots & (header->n_slots - 1)) != 0 || header->n_files >= header->n_slots ||
+      header->n_slots > (archive->size - sizeof(struct archive_header)) / sizeof(struct archive_slot)) {
+    return false;
+  }
+  uint64_t n_files = 0;
+  for (size_t i = 0; i < header->n_slots; i++) {
+    uint64_t offset = archive->slots[i].file;
+    if (offset == 0) {
+      continue;
+    }
+    n_files++;
+    if (offset > archive->size || sizeof(struct archive_file) > archive->size - offset ||
+        offset % _Alignof(struct archive_file) != 0) {
+      return false;
+    }
+    const struct archive_file *file = (const struct archive_file *)(archive->base + offset);
+    if (!is_valid_range(archive, &file->path, true) || !is_valid_range(archive, &file->content_type, true) ||
+        !is_valid_range(archive, &file->last_modified, true) || !is_valid_variant(archive, &file->identity) ||
+        (file->variants & ~((1u << CONTENT_CODING_MAX) - 1)) != 0) {
+      return false;
+    }
+    for (size_t coding = 0; coding < CONTENT_CODING_MAX; coding++) {
+      if ((file->variants & (1u << coding)) != 0 && !is_valid_variant(archive, &file->encoded[coding])) {
+        return false;
+      }
+    }
+  }
+  return n_files == header->n_files;
+}
+
+bool archive_load(const char *path) {
+  int file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+  if (file_descriptor == -1) {
+    logging_error("cannot open archive %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat status;
+  if (fstat(file_descriptor, &status) == -1 || status.st_size == 0) {
+    logging_error("cannot load empty archive %s\n", path);
+    close(file_descriptor);
+    return false;
+  }
+  void *base = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+  close(file_descriptor);
+  if (base == MAP_FAILED) {
+    logging_error("cannot map archive %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct archive *archive = malloc(sizeof(struct archive));
+  archive->base = base;
+  archive->size = status.st_size;
+  archive->header = base;
+  archive->slots = (const struct archive_slot *)(archive->header + 1);
+  archive->references = 1;
+  if (!is_valid(archive)) {
+    logging_error("archive %s is corrupted or built for another host\n", path);
+    munmap(base, status.st_size);
+    free(archive);
+    return false;
+  }
+  // start reading the archive into the page cache, so that first requests rarely wait for the disk
+  madvise(base, status.st_size, MADV_WILLNEED);
+  struct archive **current = get_current();
+  if (*current != NULL) {
+    archive_release(*current);
+  }
+  *current = archive;
+  logging_information("archive %s loaded with %lu files\n", path, (unsigned long)archive->header->n_files);
+  return true;
+}
+
+struct archive *archive_acquire(void) {
+  struct archive *archive = *get_current();
+  if (archive != NULL) {
+    archive->references++;
+  }
+  return archive;
+}
+void archive_release(void *archive_) {
+  struct archive *archive = archive_;
+  if (--archive->references == 0) {
+    munmap((void *)archive->base, archive->size);
+    free(archive);
+  }
+}
+
+const struct archive_file *archive_lookup(const struct archive *archive, const char *path) {
+  uint64_t hash = hash_string(path);
+  size_t mask = archive->header->n_slots - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const struct archive_slot *slot = &archive->slots[i];
+    if (slot->file == 0) {
+      return NULL;
+    }
+    const struct archive_file *file = (const struct archive_file *)(archive->base + slot->file);
+    if (slot->hash == hash && strcmp(archive->base + file->path.offset, path) == 0) {
+      return file;
+    }
+  }
+}
+
+unsigned archive_get_variants(const struct archive_file *file) { return file->variants; }
+const char *archive_get_content_type(const struct archive *archive, const struct archive_file *file) {
+  return archive->base + file->content_type.offset;
+}
+const char *archive_get_last_modified(const struct archive *archive, const struct archive_file *file) {
+  return archive->base + file->last_modified.offset;
+}
+time_t archive_get_modification(const struct archive_file *file) { return file->modification; }
+void archive_get_representation(
+    const struct archive *archive, const struct archive_file *file, int coding,
+    struct archive_representation *representation
+) {
+  const struct archive_variant *variant = coding == -1 ? &file->identity : &file->encoded[coding];
+  representation->head = archive->base + variant->head.offset;
+  representation->head_length = variant->head.length;
+  representation->body = archive->base + variant->body.offset;
+  representation->body_length = variant->body.length;
+  representation->entity_tag = archive->base + variant->entity_tag.offset;
+}
\ No newline at end of file
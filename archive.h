@@ -0,0 +1,100 @@
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+#include <http_hl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+// a document root packed into a single immutable file by tools/archive_builder, which is mapped into memory
+//  as a whole and served in place, therefore no path resolution, open(2) or stat(2) is involved in requests
+//  the archive holds a hash index of normalized paths, and for each file its body aligned to pages, bodies of
+//   its precompressed variants, and heads of 200(OK) responses rendered with ETag, Content-Type and others
+//  loading another archive swaps it for the current one at once, the previous one is unmapped after all
+//   responses referring to it are sent
+struct archive;
+struct archive_file;
+
+// a representation of a file in the archive, all of which point into the mapping
+struct archive_representation {
+  const void *head; // the rendered head of the 200(OK) response with the whole body
+  size_t head_length;
+  const void *body;
+  size_t body_length;
+  const char *entity_tag;
+};
+
+// map the archive at path and make it the current one
+//  return false if the archive cannot be loaded, in which case the current one is kept
+bool archive_load(const char *path);
+
+// get a reference to the current archive, NULL if no archive is loaded
+//  the returned reference shall be released with archive_release
+struct archive *archive_acquire(void);
+// release a reference to the archive, archive is declared as void * so this can be used as a release hook
+void archive_release(void *archive);
+
+// get the file at path, which is relative to the document root and normalized, NULL if there is no such file
+const struct archive_file *archive_lookup(const struct archive *archive, const char *path);
+
+// get the content codings in which precompressed variants of the file are available, as a bit mask indexed
+//  by enum content_coding
+unsigned archive_get_variants(const struct archive_file *file);
+// get the media type used for Content-Type and the value of Last-Modified of the file
+const char *archive_get_content_type(const struct archive *archive, const struct archive_file *file);
+const char *archive_get_last_modified(const struct archive *archive, const struct archive_file *file);
+time_t archive_get_modification(const struct archive_file *file);
+// get the representation of the file in coding, -1 for the identity one
+//  coding shall be -1 or one in which a variant is available
+void archive_get_representation(
+    const struct archive *archive, const struct archive_file *file, int coding,
+    struct archive_representation *representation
+);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the following is shared with tools/archive_builder.c, do not use directly
+
+// all integers are in the byte order of the host building the archive, which is checked by byte_order
+#define ARCHIVE_MAGIC "hSSpack2"
+enum {
+  ARCHIVE_MAGIC_LENGTH = 8,
+  // byte_order of the header, which reads differently on a host of another byte order
+  ARCHIVE_BYTE_ORDER = 0x01020304,
+  // bodies start at multiples of this
+  ARCHIVE_ALIGNMENT = 4096,
+};
+// a range of bytes in the archive, strings are followed by a '\0' not included in length
+struct archive_range {
+  uint64_t offset;
+  uint64_t length;
+};
+// the archive starts with the header, which is followed by the slots of the index
+struct archive_header {
+  char magic[ARCHIVE_MAGIC_LENGTH];
+  uint32_t byte_order;
+  uint32_t reserved;
+  uint64_t n_slots; // a power of two
+  uint64_t n_files; // the number of slots which are not empty, at least one slot is empty
+};
+// a slot of the index, which is an open addressing hash table on hash_string of paths with linear probing
+//  file is 0 for an empty slot
+struct archive_slot {
+  uint64_t hash;
+  uint64_t file;
+};
+struct archive_variant {
+  struct archive_range head;
+  struct archive_range body;
+  struct archive_range entity_tag;
+};
+struct archive_file {
+  struct archive_range path;
+  struct archive_range content_type;
+  struct archive_range last_modified;
+  int64_t modification;
+  uint32_t variants; // the bit mask of variants available
+  uint32_t reserved;
+  struct archive_variant identity;
+  struct archive_variant encoded[CONTENT_CODING_MAX];
+};
+#endif
\ No newline at end of file
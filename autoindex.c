@@ -0,0 +1,450 @@
+#define _GNU_SOURCE
+#include <autoindex.h>
+#include <common.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+  // size of blocks the listing is rendered into
+  AutoindexBlockSize = 64 * 1024,
+  // changes of names in a directory, and of the directory itself, which invalidate its listing
+  WatchEvents =
+      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR,
+};
+
+struct autoindex_block {
+  char *content;
+  size_t length;
+};
+struct autoindex_waiter {
+  void (*wake)(void *context);
+  void *context;
+};
+struct autoindex_entry {
+  char *path;
+  uint64_t hash;
+  // -1 if the directory is not watched, in which case the entry is checked against the status of the
+  //  directory on every hit
+  int watch;
+  dev_t device;
+  ino_t inode;
+  struct timespec modification;
+  enum autoindex_state state;
+  struct autoindex_block *blocks;
+  size_t n_blocks;
+  size_t blocks_capability;
+  struct autoindex_waiter *waiters;
+  size_t n_waiters;
+  size_t waiters_capability;
+  // state of rendering, accessed only by the worker while the job is running
+  int directory;
+  char *url;
+  bool failed;
+  // links in the hash table and the LRU list, valid only if cached, which holds a reference
+  struct autoindex_entry *next_in_bucket;
+  struct autoindex_entry *lru_previous;
+  struct autoindex_entry *lru_next;
+  bool cached;
+  // the cache holds one reference while the entry is cached, and so does the job while rendering
+  size_t references;
+};
+struct autoindex_cache {
+  struct autoindex_entry **buckets;
+  size_t n_buckets; // a power of two
+  size_t count;
+  size_t capacity;
+  // most recently used at head
+  struct autoindex_entry *lru_head;
+  struct autoindex_entry *lru_tail;
+  int notification; // the inotify instance, -1 if directories cannot be watched
+  struct worker_pool *pool; // NULL if listings are rendered on the event loop
+};
+
+static struct autoindex_cache *get_cache(void) {
+  static struct autoindex_cache cache = {.notification = -1};
+  return &cache;
+}
+
+static void lru_unlink(struct autoindex_cache *cache, struct autoindex_entry *entry) {
+  *(entry->lru_previous == NULL ? &cache->lru_head : &entry->lru_previous->lru_next) = entry->lru_next;
+  *(entry->lru_next == NULL ? &cache->lru_tail : &entry->lru_next->lru_previous) = entry->lru_previous;
+  entry->lru_previous = NULL;
+  entry->lru_next = NULL;
+}
+static void lru_push(struct autoindex_cache *cache, struct autoindex_entry *entry) {
+  entry->lru_previous = NULL;
+  entry->lru_next = cache->lru_head;
+  *(cache->lru_head == NULL ? &cache->lru_tail : &cache->lru_head->lru_previous) = entry;
+  cache->lru_head = entry;
+}
+
+void autoindex_release(void *entry_) {
+  struct autoindex_entry *entry = entry_;
+  if (--entry->references != 0) {
+    return;
+  }
+  for (size_t i = 0; i < entry->n_blocks; i++) {
+    free(entry->blocks[i].content);
+  }
+  free(entry->blocks);
+  free(entry->waiters);
+  free(entry->url);
+  free(entry->path);
+  free(entry);
+}
+// remove the watch unless a cached entry shares it, which is the case if the same directory is reached by
+//  different paths
+static void unwatch(int watch) {
+  struct autoindex_cache *cache = get_cache();
+  if (watch == -1) {
+    return;
+  }
+  for (struct autoindex_entry *entry = cache->lru_head; entry != NULL; entry = entry->lru_next) {
+    if (entry->watch == watch) {
+      return;
+    }
+  }
+  inotify_rm_watch(cache->notification, watch);
+}
+// remove the entry from the cache, along with its watch unless it is already removed by the kernel
+//  an entry being rendered is freed by its job once done
+static void evict(struct autoindex_entry *entry, bool watched) {
+  struct autoindex_cache *cache = get_cache();
+  if (!entry->cached) {
+    return;
+  }
+  entry->cached = false;
+  struct autoindex_entry **target = &cache->buckets[entry->hash & (cache->n_buckets - 1)];
+  while (*target != entry) {
+    target = &(*target)->next_in_bucket;
+  }
+  *target = entry->next_in_bucket;
+  lru_unlink(cache, entry);
+  cache->count--;
+  if (watched) {
+    unwatch(entry->watch);
+  }
+  autoindex_release(entry);
+}
+static struct autoindex_entry *lookup(const char *path, uint64_t hash) {
+  struct autoindex_cache *cache = get_cache();
+  for (struct autoindex_entry *entry = cache->buckets[hash & (cache->n_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket) {
+    if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+bool autoindex_initialize(size_t capacity) {
+  struct autoindex_cache *cache = get_cache();
+  if (capacity == 0) {
+    return true;
+  }
+  cache->notification = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cache->notification == -1) {
+    logging_warning(
+        "cannot initialize inotify, directory listings are checked on every hit: %s\n", strerror(errno)
+    );
+  }
+  cache->capacity = capacity;
+  cache->n_buckets = 1;
+  while (cache->n_buckets < capacity) {
+    cache->n_buckets <<= 1;
+  }
+  cache->buckets = calloc(cache->n_buckets, sizeof(struct autoindex_entry *));
+  return true;
+}
+
+int autoindex_get_notification_descriptor(void) { return get_cache()->notification; }
+
+void autoindex_offload_rendering(struct worker_pool *pool) { get_cache()->pool = pool; }
+
+void autoindex_handle_notification(void *context) {
+  (void)context;
+  struct autoindex_cache *cache = get_cache();
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (true) {
+    ssize_t size = read(cache->notification, buffer, sizeof(buffer));
+    if (size <= 0) {
+      return;
+    }
+    for (char *target = buffer; target < buffer + size;) {
+      const struct inotify_event *event = (const struct inotify_event *)target;
+      target += sizeof(struct inotify_event) + event->len;
+      // events are lost with IN_Q_OVERFLOW, in which case nothing can be trusted
+      struct autoindex_entry *entry = cache->lru_head;
+      while (entry != NULL) {
+        struct autoindex_entry *next = entry->lru_next;
+        if ((event->mask & IN_Q_OVERFLOW) || entry->watch == event->wd) {
+          // the watch is already removed by the kernel with IN_IGNORED
+          evict(entry, (event->mask & IN_IGNORED) == 0);
+        }
+        entry = next;
+      }
+    }
+  }
+}
+
+// append length bytes of data to the listing, starting a new block once the last one is full
+static void append(struct autoindex_entry *entry, const char *data, size_t length) {
+  while (length != 0) {
+    struct autoindex_block *block = entry->n_blocks == 0 ? NULL : &entry->blocks[entry->n_blocks - 1];
+    if (block == NULL || block->length == AutoindexBlockSize) {
+      if (entry->n_blocks == entry->blocks_capability) {
+        entry->blocks_capability = entry->blocks_capability == 0 ? 4 : entry->blocks_capability * 2;
+        entry->blocks = realloc(entry->blocks, sizeof(struct autoindex_block) * entry->blocks_capability);
+      }
+      block = &entry->blocks[entry->n_blocks++];
+      block->content = malloc(AutoindexBlockSize);
+      block->length = 0;
+    }
+    size_t size = AutoindexBlockSize - block->length < length ? AutoindexBlockSize - block->length : length;
+    memcpy(block->content + block->length, data, size);
+    block->length += size;
+    data += size;
+    length -= size;
+  }
+}
+// append text with characters special to HTML escaped
+static void append_escaped(struct autoindex_entry *entry, const char *text) {
+  for (const char *c = text; *c != '\0'; c++) {
+    // copy runs of ordinary characters at once
+    size_t run = strcspn(c, "&<>\"");
+    if (run != 0) {
+      append(entry, c, run);
+      c += run - 1;
+      continue;
+    }
+    switch (*c) {
+    case '&':
+      append(entry, "&amp;", 5);
+      break;
+    case '<':
+      append(entry, "&lt;", 4);
+      break;
+    case '>':
+      append(entry, "&gt;", 4);
+      break;
+    case '"':
+      append(entry, "&quot;", 6);
+      break;
+    }
+  }
+}
+// append a name as a relative reference, with everything but unreserved characters percent-encoded
+static void append_reference(struct autoindex_entry *entry, const char *name) {
+  for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++) {
+    if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-' ||
+        *c == '.' || *c == '_' || *c == '~' || (*c == '/' && c[1] == '\0')) {
+      append(entry, (const char *)c, 1);
+    } else {
+      char encoded[4];
+      sprintf(encoded, "%%%02X", *c);
+      append(entry, encoded, 3);
+    }
+  }
+}
+static int compare_name(const void *lhs, const void *rhs) {
+  return strcmp(*(char *const *)lhs, *(char *const *)rhs);
+}
+// read the directory and render its listing into entry, return false if the directory cannot be read
+static bool render(struct autoindex_entry *entry, int directory, const char *url) {
+  DIR *handle = fdopendir(directory);
+  if (handle == NULL) {
+    close(directory);
+    return false;
+  }
+  char **names = NULL;
+  size_t n_names = 0;
+  size_t names_capability = 0;
+  struct dirent *dirent;
+  while ((dirent = readdir(handle)) != NULL) {
+    if (dirent->d_name[0] == '.') {
+      continue;
+    }
+    // directories are listed with a trailing '/', which is where symbolic links to them lead as well
+    bool is_directory = dirent->d_type == DT_DIR;
+    if (dirent->d_type == DT_UNKNOWN || dirent->d_type == DT_LNK) {
+      struct stat status;
+      is_directory = fstatat(dirfd(handle), dirent->d_name, &status, 0) == 0 && S_ISDIR(status.st_mode);
+    }
+    if (n_names == names_capability) {
+      names_capability = names_capability == 0 ? 64 : names_capability * 2;
+      names = realloc(names, sizeof(char *) * names_capability);
+    }
+    size_t length = strlen(dirent->d_name);
+    names[n_names] = malloc(length + 2);
+    memcpy(names[n_names], dirent->d_name, length);
+    strcpy(names[n_names] + length, is_directory ? "/" : "");
+    n_names++;
+  }
+  closedir(handle);
+  qsort(names, n_names, sizeof(char *), compare_name);
+
+  static const char head[] = "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Index of ";
+  append(entry, head, sizeof(head) - 1);
+  append_escaped(entry, url);
+  append(entry, "</title></head>\n<body><h1>Index of ", 35);
+  append_escaped(entry, url);
+  append(entry, "</h1>\n<ul>\n", 11);
+  if (strcmp(url, "/") != 0) {
+    append(entry, "<li><a href=\"../\">../</a></li>\n", 31);
+  }
+  for (size_t i = 0; i < n_names; i++) {
+    append(entry, "<li><a href=\"", 13);
+    append_reference(entry, names[i]);
+    append(entry, "\">", 2);
+    append_escaped(entry, names[i]);
+    append(entry, "</a></li>\n", 10);
+    free(names[i]);
+  }
+  free(names);
+  append(entry, "</ul></body></html>\n", 20);
+  return true;
+}
+
+static void wake_waiters(struct autoindex_entry *entry) {
+  // a waiter may release its reference when woken, so detach the list first
+  size_t n_waiters = entry->n_waiters;
+  struct autoindex_waiter waiters[n_waiters == 0 ? 1 : n_waiters];
+  memcpy(waiters, entry->waiters, sizeof(struct autoindex_waiter) * n_waiters);
+  entry->n_waiters = 0;
+  for (size_t i = 0; i < n_waiters; i++) {
+    waiters[i].wake(waiters[i].context);
+  }
+}
+// render the listing of the entry, this runs on a worker thread
+static void render_listing(void *context) {
+  struct autoindex_entry *entry = context;
+  entry->failed = !render(entry, entry->directory, entry->url);
+}
+// wake requests waiting for the listing, this runs on the event loop thread
+static void complete_listing(void *context) {
+  struct autoindex_entry *entry = context;
+  entry->state = entry->failed ? AUTOINDEX_STATE_FAILED : AUTOINDEX_STATE_COMPLETE;
+  if (entry->failed) {
+    evict(entry, entry->watch != -1);
+  }
+  wake_waiters(entry);
+  autoindex_release(entry);
+}
+// check if the directory of an entry not watched is the same as when it was read, which changes its time of
+//  modification as soon as a name in it changes
+static bool is_same_directory(const struct autoindex_entry *entry) {
+  struct stat status;
+  return fstatat(get_document_root(), entry->path, &status, 0) == 0 && status.st_dev == entry->device &&
+         status.st_ino == entry->inode && status.st_mtim.tv_sec == entry->modification.tv_sec &&
+         status.st_mtim.tv_nsec == entry->modification.tv_nsec;
+}
+
+struct autoindex_entry *autoindex_acquire(const char *path, const char *url) {
+  struct autoindex_cache *cache = get_cache();
+  uint64_t hash = hash_string(path);
+  struct autoindex_entry *entry = cache->buckets == NULL ? NULL : lookup(path, hash);
+  if (entry != NULL && entry->watch == -1 && entry->state == AUTOINDEX_STATE_COMPLETE &&
+      !is_same_directory(entry)) {
+    evict(entry, false);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+    entry->references++;
+    return entry;
+  }
+  int directory = open_beneath(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory == -1) {
+    errno = ENOENT;
+    return NULL;
+  }
+  struct stat status;
+  fstat(directory, &status);
+  entry = calloc(1, sizeof(struct autoindex_entry));
+  entry->path = strdup(path);
+  entry->hash = hash;
+  entry->references = 1;
+  entry->watch = -1;
+  entry->device = status.st_dev;
+  entry->inode = status.st_ino;
+  entry->modification = status.st_mtim;
+  entry->state = AUTOINDEX_STATE_RUNNING;
+  entry->directory = directory;
+  entry->url = strdup(url);
+  // the watch is set up on the directory opened before reading it, therefore any change is notified
+  if (cache->notification != -1) {
+    char link[32];
+    sprintf(link, "/proc/self/fd/%d", directory);
+    entry->watch = inotify_add_watch(cache->notification, link, WatchEvents);
+  }
+  if (cache->pool == NULL) {
+    render_listing(entry);
+    entry->state = entry->failed ? AUTOINDEX_STATE_FAILED : AUTOINDEX_STATE_COMPLETE;
+  } else if (worker_pool_submit(cache->pool, render_listing, complete_listing, entry)) {
+    // the job holds a reference until it completes
+    entry->references++;
+  } else {
+    // a listing is never rendered on the event loop while the pool is busy
+    close(directory);
+    unwatch(entry->watch);
+    autoindex_release(entry);
+    errno = EAGAIN;
+    return NULL;
+  }
+  if (entry->state == AUTOINDEX_STATE_FAILED) {
+    unwatch(entry->watch);
+    autoindex_release(entry);
+    errno = ENOENT;
+    return NULL;
+  }
+  if (cache->buckets != NULL) {
+    if (cache->count == cache->capacity) {
+      evict(cache->lru_tail, cache->lru_tail->watch != -1);
+    }
+    struct autoindex_entry **bucket = &cache->buckets[hash & (cache->n_buckets - 1)];
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+    lru_push(cache, entry);
+    entry->cached = true;
+    entry->references++;
+    cache->count++;
+  }
+  return entry;
+}
+
+enum autoindex_state autoindex_get_state(const struct autoindex_entry *entry) { return entry->state; }
+
+void autoindex_wait(struct autoindex_entry *entry, void (*wake)(void *context), void *context) {
+  if (entry->n_waiters == entry->waiters_capability) {
+    entry->waiters_capability = entry->waiters_capability == 0 ? 4 : entry->waiters_capability * 2;
+    entry->waiters = realloc(entry->waiters, sizeof(struct autoindex_waiter) * entry->waiters_capability);
+  }
+  entry->waiters[entry->n_waiters].wake = wake;
+  entry->waiters[entry->n_waiters].context = context;
+  entry->n_waiters++;
+}
+
+void autoindex_cancel_wait(struct autoindex_entry *entry, void *context) {
+  for (size_t i = 0; i < entry->n_waiters; i++) {
+    if (entry->waiters[i].context == context) {
+      entry->waiters[i] = entry->waiters[--entry->n_waiters];
+      return;
+    }
+  }
+}
+
+size_t autoindex_get_block_count(const struct autoindex_entry *entry) { return entry->n_blocks; }
+void autoindex_get_block(
+    const struct autoindex_entry *entry, size_t index, const void **content, size_t *length
+) {
+  *content = entry->blocks[index].content;
+  *length = entry->blocks[index].length;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef AUTOINDEX_H_
+#define AUTOINDEX_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <worker_pool.h>
+// listings of directories rendered as HTML, which are served for directories without an index file
+//  a listing is rendered once, sorted by name, into blocks which are sent one after another, therefore a
+//   directory with a huge number of entries is neither read nor rendered again on each request
+//  listings are cached until names in the directory change, which is notified through inotify(7), or found
+//   by checking the directory with stat(2) on every hit if it cannot be watched
+//  names starting with '.' are not listed
+struct autoindex_entry;
+
+enum autoindex_state {
+  AUTOINDEX_STATE_RUNNING, // the listing is being rendered, blocks are not available yet
+  AUTOINDEX_STATE_COMPLETE,
+  AUTOINDEX_STATE_FAILED, // the directory cannot be read
+};
+
+// set up the cache holding at most capacity listings, 0 disables caching, in which case every acquisition
+//  renders the listing again
+//  return false if the cache cannot be set up, in which case caching is disabled as well
+bool autoindex_initialize(size_t capacity);
+
+// get the file descriptor which becomes readable when a listed directory changes, -1 if directories cannot be
+//  watched
+int autoindex_get_notification_descriptor(void);
+
+// render listings on pool instead of the event loop, where a listing being rendered is waited for with
+//  autoindex_wait
+void autoindex_offload_rendering(struct worker_pool *pool);
+
+// drop listings of directories changed, this shall be called when the descriptor above becomes readable,
+//  context is unused so this can be registered as an event handler
+void autoindex_handle_notification(void *context);
+
+// get the listing of the directory at path, which is relative to the document root and normalized, where url
+//  is the path requested, which is shown as the title
+//  the listing may still be rendering on the pool, see autoindex_get_state
+//  return NULL with errno ENOENT if the directory cannot be opened, or EAGAIN if the pool is at its capacity,
+//   as a listing is then refused rather than rendered on the event loop
+//  the returned reference shall be released with autoindex_release
+struct autoindex_entry *autoindex_acquire(const char *path, const char *url);
+
+// release a reference to the entry, entry is declared as void * so this can be used as a release hook
+void autoindex_release(void *entry);
+
+enum autoindex_state autoindex_get_state(const struct autoindex_entry *entry);
+// call wake(context) on the event loop thread once the listing is no longer rendering
+void autoindex_wait(struct autoindex_entry *entry, void (*wake)(void *context), void *context);
+// stop waiting, which shall be called if context is gone before woken
+void autoindex_cancel_wait(struct autoindex_entry *entry, void *context);
+
+// get number of blocks of the listing, which shall be complete
+size_t autoindex_get_block_count(const struct autoindex_entry *entry);
+// get the block at index, which is valid until the reference is released
+void autoindex_get_block(
+    const struct autoindex_entry *entry, size_t index, const void **content, size_t *length
+);
+#endif
\ No newline at end of file
@@ -1,77 +1,303 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
-#include <assert.h>
 #include <common.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
 
-const char *get_address(struct connection_information *connection) {
-  static char buffer[INET6_ADDRSTRLEN];
+void cache_address(struct connection_information *connection) {
   void *target = NULL;
   if (connection->address.ss_family == AF_INET) {
     target = &((struct sockaddr_in *)&connection->address)->sin_addr;
   } else {
     target = &((struct sockaddr_in6 *)&connection->address)->sin6_addr;
   }
-  inet_ntop(connection->address.ss_family, target, buffer, sizeof(buffer));
-  return buffer;
+  if (inet_ntop(connection->address.ss_family, target, connection->address_text, INET6_ADDRSTRLEN) == NULL) {
+    strcpy(connection->address_text, "?");
+  }
 }
+const char *get_address(struct connection_information *connection) { return connection->address_text; }
 uint16_t get_port(struct connection_information *connection) {
   uint16_t port = *(uint16_t *)(((void *)&connection->address) + sizeof(connection->address.ss_family));
   return ntohs(port);
 }
 
+uint64_t hash_string(const char *string) {
+  // 64-bit FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (; *string != '\0'; string++) {
+    hash = (hash ^ (unsigned char)*string) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+int get_document_root(void) {
+  static bool initialize = true;
+  static int document_root = -1;
+  if (initialize) {
+    document_root = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (document_root == -1) {
+      logging_fatal("cannot open document root: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    initialize = false;
+  }
+  return document_root;
+}
+
+int open_beneath(const char *path, int flags) {
+  struct open_how how = {
+      .flags = flags,
+      .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+  };
+  // glibc provides no wrapper of openat2(2)
+  return syscall(SYS_openat2, get_document_root(), path, &how, sizeof(how));
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // logging
-#define forward_log(level)                                                                                   \
-  do {                                                                                                       \
-    va_list args;                                                                                            \
-    va_start(args, format);                                                                                  \
-    logging_implementation(level, format, args);                                                             \
-    va_end(args);                                                                                            \
-  } while (false)
+enum {
+  // bytes of the ring of each thread, a power of two
+  LoggingRingSize = 1 << 16,
+  // a message longer than this is truncated
+  LoggingMessageMaximum = 2048,
+  // milliseconds the writer sleeps between batches, unless a ring fills up by half earlier
+  LoggingInterval = 20,
+  // blocks of memory written by a single writev(2)
+  LoggingBatch = 64,
+};
 
-static enum logging_log_level *log_level(void) {
 #ifdef LOGGING_LOG_LEVEL
-  static enum logging_log_level log_level = LOGGING_LOG_LEVEL;
+enum logging_log_level logging_level = LOGGING_LOG_LEVEL;
 #else
-  static enum logging_log_level log_level = LOGGING_LOG_LEVEL_INFORMATION;
+enum logging_log_level logging_level = LOGGING_LOG_LEVEL_INFORMATION;
 #endif
-  return &log_level;
+
+// messages of a thread, which is a single-producer single-consumer queue of bytes
+//  head is only advanced by the thread owning the ring, and tail by whoever holds the lock of the logger
+struct logging_ring {
+  char buffer[LoggingRingSize];
+  size_t head;
+  size_t tail;
+  size_t dropped;  // messages dropped as the ring is full, counted by the owner
+  size_t reported; // messages dropped which are already reported
+  char report[64];
+  struct logging_ring *next;
+};
+struct logger {
+  pthread_mutex_t lock; // guards the list of rings and draining them
+  pthread_cond_t wake;
+  struct logging_ring *rings;
+  pthread_t writer;
+  bool stopping;
+  uint64_t origin; // nanoseconds of the monotonic clock when logging started
+};
+
+static uint64_t get_monotonic_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// write blocks as a whole, retrying on short writes
+static void write_vector(struct iovec *vector, int count) {
+  while (count > 0) {
+    ssize_t written = writev(STDERR_FILENO, vector, count);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    for (; count > 0 && (size_t)written >= vector->iov_len; vector++, count--) {
+      written -= vector->iov_len;
+    }
+    if (count > 0) {
+      vector->iov_base = (char *)vector->iov_base + written;
+      vector->iov_len -= written;
+    }
+  }
+}
+// write what every ring holds, which shall be called with the lock held
+static void drain(struct logger *logger) {
+  struct iovec vector[LoggingBatch];
+  struct logging_ring *batch[LoggingBatch];
+  size_t heads[LoggingBatch];
+  int count = 0, n_rings = 0;
+  for (struct logging_ring *ring = logger->rings; ring != NULL || count > 0;) {
+    // flush the batch once it cannot take another ring, or every ring is walked
+    if (ring == NULL || count + 3 > LoggingBatch) {
+      write_vector(vector, count);
+      for (int i = 0; i < n_rings; i++) {
+        __atomic_store_n(&batch[i]->tail, heads[i], __ATOMIC_RELEASE);
+      }
+      count = n_rings = 0;
+      continue;
+    }
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->reported) {
+      int length = snprintf(
+          ring->report, sizeof(ring->report), "[logging] %zu messages dropped\n", dropped - ring->reported
+      );
+      vector[count++] = (struct iovec){ring->report, length};
+      ring->reported = dropped;
+    }
+    if (head != ring->tail) {
+      size_t start = ring->tail & (LoggingRingSize - 1);
+      size_t size = head - ring->tail;
+      size_t first = size < LoggingRingSize - start ? size : LoggingRingSize - start;
+      vector[count++] = (struct iovec){ring->buffer + start, first};
+      if (first < size) {
+        vector[count++] = (struct iovec){ring->buffer, size - first};
+      }
+      batch[n_rings] = ring;
+      heads[n_rings++] = head;
+    }
+    ring = ring->next;
+  }
+}
+static void *run_writer(void *context) {
+  struct logger *logger = context;
+  pthread_mutex_lock(&logger->lock);
+  while (!__atomic_load_n(&logger->stopping, __ATOMIC_RELAXED)) {
+    drain(logger);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += LoggingInterval * 1000000l;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000l;
+    deadline.tv_nsec %= 1000000000l;
+    pthread_cond_timedwait(&logger->wake, &logger->lock, &deadline);
+  }
+  drain(logger);
+  pthread_mutex_unlock(&logger->lock);
+  return NULL;
 }
-static void logging_implementation(enum logging_log_level level, const char *format, va_list args) {
-  // this implementation is not thread-safe, but this will not harm since we are single-threaded
-  if (*log_level() > level) {
+static struct logger *get_logger(void);
+// stop the writer once everything logged is written, which is registered with atexit(3)
+static void stop_writer(void) {
+  struct logger *logger = get_logger();
+  pthread_mutex_lock(&logger->lock);
+  __atomic_store_n(&logger->stopping, true, __ATOMIC_RELAXED);
+  pthread_cond_signal(&logger->wake);
+  pthread_mutex_unlock(&logger->lock);
+  pthread_join(logger->writer, NULL);
+}
+// get the logger, whose writer is started by the first message, so programs never logging run none
+static struct logger *get_logger(void) {
+  static struct logger logger = {.lock = PTHREAD_MUTEX_INITIALIZER};
+  static bool started = false;
+  if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&logger.lock);
+    if (!started) {
+      pthread_condattr_t attributes;
+      pthread_condattr_init(&attributes);
+      pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+      pthread_cond_init(&logger.wake, &attributes);
+      pthread_condattr_destroy(&attributes);
+      logger.origin = get_monotonic_time();
+      pthread_create(&logger.writer, NULL, run_writer, &logger);
+      atexit(stop_writer);
+      __atomic_store_n(&started, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&logger.lock);
+  }
+  return &logger;
+}
+static struct logging_ring *get_ring(struct logger *logger) {
+  static _Thread_local struct logging_ring *ring = NULL;
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(struct logging_ring));
+    pthread_mutex_lock(&logger->lock);
+    ring->next = logger->rings;
+    logger->rings = ring;
+    pthread_mutex_unlock(&logger->lock);
+  }
+  return ring;
+}
+// append message of size bytes to ring, or drop it if there is no room
+static void push(struct logger *logger, struct logging_ring *ring, const char *message, size_t size) {
+  size_t head = ring->head;
+  size_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (LoggingRingSize - used < size) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&logger->wake);
     return;
   }
+  size_t start = head & (LoggingRingSize - 1);
+  size_t first = size < LoggingRingSize - start ? size : LoggingRingSize - start;
+  memcpy(ring->buffer + start, message, first);
+  memcpy(ring->buffer, message + first, size - first);
+  __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+  // wake the writer up early if it may not keep up, otherwise the message waits for the next batch
+  if (used < LoggingRingSize / 2 && used + size >= LoggingRingSize / 2) {
+    pthread_cond_signal(&logger->wake);
+  }
+}
+
+void logging_write(enum logging_log_level level, const char *format, ...) {
   // keep this as the same length
-  static char *name[] = {"PLACEHOLDER", "TRACE", "DEBUG", "INFOR", "WARNI", "ERROR", "FATAL"};
-  static char *before_output[] = {
+  static const char *name[] = {"PLACEHOLDER", "TRACE", "DEBUG", "INFOR", "WARNI", "ERROR", "FATAL"};
+  static const char *before_output[] = {
       "PLACEHOLDER", "\e[2m", "", "\e[36m", "\e[33m", "\e[35m", "\e[1;4;31m",
   };
-  static char *after_output[] = {
-      "PLACEHOLDER", "\e[0m", "\e[0m", "\e[0m", "\e[0m", "\e[0m", "\e[0m",
-  };
-  assert(sizeof(name) / sizeof(name[0]) == LOGGING_LOG_LEVEL_OFF);
-  assert(sizeof(before_output) / sizeof(before_output[0]) == LOGGING_LOG_LEVEL_OFF);
-  assert(sizeof(after_output) / sizeof(after_output[0]) == LOGGING_LOG_LEVEL_OFF);
-  fprintf(stderr, "%s", before_output[level]);
+  static const char after_output[] = "\e[0m";
+  _Static_assert(sizeof(name) / sizeof(name[0]) == LOGGING_LOG_LEVEL_OFF, "unmapped level");
+  _Static_assert(sizeof(before_output) / sizeof(before_output[0]) == LOGGING_LOG_LEVEL_OFF, "unmapped level");
+  if (level <= LOGGING_LOG_LEVEL_FULL || level >= LOGGING_LOG_LEVEL_OFF) {
+    return;
+  }
+  struct logger *logger = get_logger();
   // add time and level
-  fprintf(stderr, "[%013.06f][%s] ", (double)clock() / CLOCKS_PER_SEC, name[level]);
-  vfprintf(stderr, format, args);
-  fprintf(stderr, "%s", after_output[level]);
+  char message[LoggingMessageMaximum];
+  uint64_t elapsed = get_monotonic_time() - logger->origin;
+  size_t length = snprintf(
+      message, sizeof(message), "%s[%06lu.%06lu][%s] ", before_output[level], elapsed / 1000000000,
+      elapsed / 1000 % 1000000, name[level]
+  );
+  size_t room = sizeof(message) - length - sizeof(after_output);
+  va_list args;
+  va_start(args, format);
+  int size = vsnprintf(message + length, room, format, args);
+  va_end(args);
+  if (size < 0) {
+    return;
+  }
+  if ((size_t)size >= room) {
+    // mark the message truncated
+    length += room - 1;
+    memcpy(message + length - 4, "...\n", 4);
+  } else {
+    length += size;
+  }
+  memcpy(message + length, after_output, sizeof(after_output) - 1);
+  length += sizeof(after_output) - 1;
+
+  struct logging_ring *ring = get_ring(logger);
+  if (level == LOGGING_LOG_LEVEL_FATAL || __atomic_load_n(&logger->stopping, __ATOMIC_RELAXED)) {
+    // the process is likely to exit right after, or the writer is gone already, so write everything now
+    pthread_mutex_lock(&logger->lock);
+    drain(logger);
+    push(logger, ring, message, length);
+    drain(logger);
+    pthread_mutex_unlock(&logger->lock);
+    return;
+  }
+  push(logger, ring, message, length);
 }
-void logging_trace(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_TRACE); }
-void logging_debug(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_DEBUG); }
-void logging_information(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_INFORMATION); }
-void logging_warning(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_WARNING); }
-void logging_error(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_ERROR); }
-void logging_fatal(const char *format, ...) { forward_log(LOGGING_LOG_LEVEL_FATAL); }
 
 void logging_set_level(enum logging_log_level level) {
   if (level < LOGGING_LOG_LEVEL_FULL || level > LOGGING_LOG_LEVEL_OFF) {
     return;
   }
-  *log_level() = level;
+  __atomic_store_n(&logging_level, level, __ATOMIC_RELAXED);
 }
\ No newline at end of file
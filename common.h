@@ -1,11 +1,15 @@
 #ifndef COMMON_H_
 #define COMMON_H_
+#include <netinet/in.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+// value of Server, which is also rendered into heads packed by tools/archive_builder
+#define SERVER_NAME "hSS/0.0.1-alpha"
 struct buffer {
   void *buffer;      // the real buffer
   size_t capability; // total space allocated for the buffer
@@ -16,33 +20,116 @@ struct connection_information {
   enum connection_status {
     ConnectionStatusWaitingRequest,
     ConnectionStatusWritingResponse,
+    ConnectionStatusWaitingContent, // the response is being generated elsewhere, resumed once more is ready
+    ConnectionStatusClosing,        // the connection is being shut down, freed once done or at its deadline
   } state;
   int file_descriptor;
   struct buffer buffer;
   struct http_request *request;
   struct http_response *response;
+  // progress of sending body of the response: the part being sent and bytes of which already sent
+  size_t body_part;
+  size_t body_offset;
+  // content compressed on the fly which is sent after the body as chunks, and index of the next block to send
+  struct compression_entry *stream;
+  size_t stream_block;
+  // listing of a directory being rendered, which the response is generated from once it is done
+  struct autoindex_entry *listing;
+  // file of the last range requested, used to read ahead of clients streaming a file by consecutive ranges
+  struct access_pattern {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    off_t next;      // offset where the last range ended
+    bool sequential; // the last range started where the one before it ended
+    off_t advised;   // content before this offset is advised to be read ahead
+    off_t dropped;   // content before this offset is advised to be dropped from the page cache
+  } pattern;
+
+  // sequence number of the connection since startup, which identifies it in probes
+  uint64_t id;
+  // when the connection is established and when bytes are transferred last, in nanoseconds of the monotonic
+  //  clock, and bytes transferred since it is established
+  uint64_t established;
+  uint64_t active;
+  size_t received_bytes;
+  size_t sent_bytes;
 
   // abstract recv/send functions unify plain TCP and TLS connections
   ssize_t (*recv)(struct connection_information *connection, void *buf, size_t nbytes);
   ssize_t (*send)(struct connection_information *connection, const void *buf, size_t n);
-  // destructor of underlying structures
+  // send n bytes from offset of a file directly, updating offset, as sendfile(2) does
+  //  this is NULL if the underlying connection cannot send from a file without reading it into memory
+  ssize_t (*send_file)(
+      struct connection_information *connection, int file_descriptor, off_t *offset, size_t n
+  );
+  // send count blocks of memory at once, as writev(2) does
+  //  this is NULL if the underlying connection cannot gather blocks in a single send
+  ssize_t (*send_vector)(struct connection_information *connection, const struct iovec *vector, int count);
+  // send bytes held back by send, which shall be called once a response is written or waits for content
+  //  return 0 once done, or -1 with errno set, which is EAGAIN if it shall be called again when writable
+  //  this is NULL if send never holds bytes back
+  int (*flush)(struct connection_information *connection);
+  // shut down the connection gracefully, e.g. by exchanging close_notify alerts, without blocking
+  //  return 0 once done, either gracefully or not, or -1 with errno set to EAGAIN if it waits for the peer
+  //  this is NULL if the underlying connection is closed at once
+  int (*shutdown)(struct connection_information *connection);
+  // destructor of underlying structures, which shall not block either
+  //  this may take over the socket still in use elsewhere by setting file_descriptor to -1, in which case the
+  //   socket is no longer watched, and closed by the underlying once done with it
   void (*destroy_underlying)(struct connection_information *connection);
 
-  // address information of peer
+  // address information of peer, and its text which is converted once as the connection is established
   struct sockaddr_storage address;
+  char address_text[INET6_ADDRSTRLEN];
+  // the request being received arrived, at least in part, as TLS early data (0-RTT), which may be replayed
+  bool early_data;
+  // the TLS session of the connection is resumed from a ticket
+  bool resumed;
+  // stages of the request being responded to, in nanoseconds of the monotonic clock, and what it costs
+  struct request_timing {
+    uint64_t started;   // the first bytes of the request are received
+    uint64_t received;  // the whole request is received
+    uint64_t parsed;    // the request is parsed
+    uint64_t resolved;  // the path is resolved and the response is generated
+    uint64_t rendered;  // the head of the response is rendered
+    uint64_t reading;   // time spent reading files into buffer
+    uint64_t waiting;   // time spent waiting for content, which is read or compressed elsewhere
+    uint64_t waited;    // when the wait for content started
+    size_t calls;       // calls receiving, sending or reading
+    size_t received_bytes;
+    size_t sent_bytes;
+    int method;         // enum http_request_method of the request, negative if it is invalid
+    char *url;          // the url requested, kept only if slow requests or the access log are enabled
+  } timing;
 
   // extra fields for underlying
   void *underlying;
 };
 
+// convert the (IPv4/IPv6) address of the peer on connection supplied into text, which get_address returns
+//  this shall be called once the address is filled in
+void cache_address(struct connection_information *connection);
+
 // get the (IPv4/IPv6) address of the peer on connection supplied
-//  the returned buffer is statically allocated and shall be overwritten with subsequent call to this function
+//  the returned buffer is owned by the connection, therefore this is cheap and safe to call from any thread
 const char *get_address(struct connection_information *connection);
 
 // get the port number of the peer on connection supplied
 //  the byte order is shifted properly
 uint16_t get_port(struct connection_information *connection);
 
+// hash a null-terminated string for hash tables, this is not suitable for cryptographic usage
+uint64_t hash_string(const char *string);
+
+// get a file descriptor of the document root, which is the working directory when this is first called
+int get_document_root(void);
+
+// open path relative to the document root with flags, as openat(2), except that the resolution never goes out
+//  of the document root, through either "..", absolute symbolic links or magic links in /proc
+//  return -1 with errno set on failure, EXDEV if the resolution goes out of the document root
+int open_beneath(const char *path, int flags);
+
 // logging utilities
 enum logging_log_level {
   LOGGING_LOG_LEVEL_FULL, // keep this at top
@@ -55,12 +142,35 @@ enum logging_log_level {
   LOGGING_LOG_LEVEL_OFF // and this at bottom
 };
 
-void logging_trace(const char *format, ...);
-void logging_debug(const char *format, ...);
-void logging_information(const char *format, ...);
-void logging_warning(const char *format, ...);
-void logging_error(const char *format, ...);
-void logging_fatal(const char *format, ...);
+// messages are formatted by the calling thread into a ring buffer of its own, without locks or allocations,
+//  while a background thread writes what every ring holds to stderr in batches
+//  a message below LOGGING_COMPILED_LEVEL is eliminated at compile time, and one below the level set at run
+//   time is skipped before its arguments are evaluated, therefore arguments shall be free of side effects
+//  a message is dropped if the ring of its thread is full, which is reported once the ring is drained
+//  a fatal message is written before the call returns, along with every message logged before it
+#ifndef LOGGING_COMPILED_LEVEL
+#define LOGGING_COMPILED_LEVEL LOGGING_LOG_LEVEL_FULL
+#endif
+
+// the level set at run time, which shall only be changed with logging_set_level
+extern enum logging_log_level logging_level;
+
+#define logging_log(level, ...)                                                                              \
+  do {                                                                                                       \
+    if ((level) >= LOGGING_COMPILED_LEVEL && (level) >= __atomic_load_n(&logging_level, __ATOMIC_RELAXED)) { \
+      logging_write(level, __VA_ARGS__);                                                                     \
+    }                                                                                                        \
+  } while (false)
+#define logging_trace(...) logging_log(LOGGING_LOG_LEVEL_TRACE, __VA_ARGS__)
+#define logging_debug(...) logging_log(LOGGING_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define logging_information(...) logging_log(LOGGING_LOG_LEVEL_INFORMATION, __VA_ARGS__)
+#define logging_warning(...) logging_log(LOGGING_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define logging_error(...) logging_log(LOGGING_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define logging_fatal(...) logging_log(LOGGING_LOG_LEVEL_FATAL, __VA_ARGS__)
+
+// log a message at level regardless of the levels set, use the macros above instead
+void logging_write(enum logging_log_level level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
 
 void logging_set_level(enum logging_log_level level);
 #endif
\ No newline at end of file
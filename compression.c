@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <compression.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+enum {
+  // number of buckets in the hash table of entries
+  CompressionBuckets = 1024,
+  // size of input compressed in a single job
+  CompressionChunkSize = 128 * 1024,
+  // maximum number of files being compressed at the same time
+  CompressionConcurrency = 8,
+  // files smaller than this are not worth compressing since the gain is eaten by the overhead
+  CompressionMinimumSize = 256,
+  // compression level of gzip, which balances ratio against speed for first requests
+  CompressionGzipLevel = 6,
+};
+
+struct compression_block {
+  void *content;
+  size_t length;
+};
+struct compression_waiter {
+  void (*wake)(void *context);
+  void *context;
+};
+struct compression_entry {
+  // identity of the compressed content
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modification;
+  enum content_coding coding;
+  // links in the hash table and the LRU list, valid only if cached
+  struct compression_entry *next_in_bucket;
+  struct compression_entry *lru_previous;
+  struct compression_entry *lru_next;
+  bool cached;
+  // the cache holds one reference while the entry is cached, and so does the job in flight while running, so
+  //  the entry is torn down by its job even if evicted meanwhile
+  size_t references;
+  enum compression_state state;
+  struct compression_block *blocks;
+  size_t n_blocks;
+  size_t blocks_capability;
+  size_t length; // total length of blocks
+  struct compression_waiter *waiters;
+  size_t n_waiters;
+  size_t waiters_capability;
+  // state of the compression, accessed only by the worker while a job is running or before it is submitted
+  int file_descriptor;
+  off_t input_offset;
+  z_stream stream;
+  struct compression_block output; // output of the last job
+  bool finished;                   // the last job consumed the last of input
+  bool failed;                     // the last job failed
+};
+struct compression_cache {
+  struct compression_entry *buckets[CompressionBuckets];
+  // most recently used at head
+  struct compression_entry *lru_head;
+  struct compression_entry *lru_tail;
+  size_t budget;
+  size_t used;
+  size_t running;
+  struct worker_pool *pool;
+};
+
+static struct compression_cache *get_cache(void) {
+  static struct compression_cache cache;
+  return &cache;
+}
+static size_t get_bucket(dev_t device, ino_t inode, enum content_coding coding) {
+  uint64_t hash = (uint64_t)device * 0x9e3779b97f4a7c15ull;
+  hash ^= ((uint64_t)inode * 0xbf58476d1ce4e5b9ull) ^ coding;
+  return (hash ^ (hash >> 31)) % CompressionBuckets;
+}
+
+static void lru_unlink(struct compression_cache *cache, struct compression_entry *entry) {
+  *(entry->lru_previous == NULL ? &cache->lru_head : &entry->lru_previous->lru_next) = entry->lru_next;
+  *(entry->lru_next == NULL ? &cache->lru_tail : &entry->lru_next->lru_previous) = entry->lru_previous;
+  entry->lru_previous = NULL;
+  entry->lru_next = NULL;
+}
+static void lru_push(struct compression_cache *cache, struct compression_entry *entry) {
+  entry->lru_previous = NULL;
+  entry->lru_next = cache->lru_head;
+  *(cache->lru_head == NULL ? &cache->lru_tail : &cache->lru_head->lru_previous) = entry;
+  cache->lru_head = entry;
+}
+
+static void free_entry(struct compression_entry *entry) {
+  for (size_t i = 0; i < entry->n_blocks; i++) {
+    free(entry->blocks[i].content);
+  }
+  free(entry->blocks);
+  free(entry->waiters);
+  free(entry->output.content);
+  free(entry);
+}
+void compression_release(void *entry_) {
+  struct compression_entry *entry = entry_;
+  if (--entry->references == 0) {
+    free_entry(entry);
+  }
+}
+// remove the entry from the cache, the entry is freed once all other references are released
+static void evict(struct compression_entry *entry) {
+  struct compression_cache *cache = get_cache();
+  if (!entry->cached) {
+    return;
+  }
+  struct compression_entry **target = &cache->buckets[get_bucket(entry->device, entry->inode, entry->coding)];
+  while (*target != entry) {
+    target = &(*target)->next_in_bucket;
+  }
+  *target = entry->next_in_bucket;
+  lru_unlink(cache, entry);
+  entry->cached = false;
+  cache->used -= entry->length;
+  compression_release(entry);
+}
+// evict least recently used entries which are completed until the cache is within its budget
+static void enforce_budget(void) {
+  struct compression_cache *cache = get_cache();
+  struct compression_entry *target = cache->lru_tail;
+  while (cache->used > cache->budget && target != NULL) {
+    struct compression_entry *previous = target->lru_previous;
+    if (target->state == COMPRESSION_STATE_COMPLETE) {
+      evict(target);
+    }
+    target = previous;
+  }
+}
+static void wake_waiters(struct compression_entry *entry) {
+  // a waiter may release its reference or register again when woken, so detach the list first
+  size_t n_waiters = entry->n_waiters;
+  struct compression_waiter waiters[n_waiters == 0 ? 1 : n_waiters];
+  memcpy(waiters, entry->waiters, sizeof(struct compression_waiter) * n_waiters);
+  entry->n_waiters = 0;
+  for (size_t i = 0; i < n_waiters; i++) {
+    waiters[i].wake(waiters[i].context);
+  }
+}
+
+// compress the next chunk of the file, this runs on a worker thread
+static void compress_chunk(void *context) {
+  struct compression_entry *entry = context;
+  size_t to_be_read = entry->size - entry->input_offset;
+  if (to_be_read > CompressionChunkSize) {
+    to_be_read = CompressionChunkSize;
+  }
+  unsigned char *input = malloc(to_be_read);
+  ssize_t size = pread(entry->file_descriptor, input, to_be_read, entry->input_offset);
+  if (size <= 0) {
+    // the file is truncated after it was opened
+    free(input);
+    entry->failed = true;
+    return;
+  }
+  entry->input_offset += size;
+  entry->finished = entry->input_offset == entry->size;
+  // non-final blocks are flushed to byte boundaries so they can be decoded as soon as they are sent
+  int flush = entry->finished ? Z_FINISH : Z_SYNC_FLUSH;
+  size_t capability = deflateBound(&entry->stream, size) + 16;
+  entry->output.content = malloc(capability);
+  entry->output.length = 0;
+  entry->stream.next_in = input;
+  entry->stream.avail_in = size;
+  while (true) {
+    entry->stream.next_out = (unsigned char *)entry->output.content + entry->output.length;
+    entry->stream.avail_out = capability - entry->output.length;
+    int result = deflate(&entry->stream, flush);
+    entry->output.length = capability - entry->stream.avail_out;
+    if (result == Z_STREAM_END || (flush != Z_FINISH && entry->stream.avail_out != 0)) {
+      break;
+    }
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+      entry->failed = true;
+      break;
+    }
+    capability *= 2;
+    entry->output.content = realloc(entry->output.content, capability);
+  }
+  free(input);
+}
+static void finish_compression(struct compression_entry *entry) {
+  deflateEnd(&entry->stream);
+  close(entry->file_descriptor);
+  entry->file_descriptor = -1;
+  get_cache()->running--;
+}
+// append the output of the last job to the entry and continue, this runs on the event loop thread
+static void complete_chunk(void *context) {
+  struct compression_entry *entry = context;
+  struct compression_cache *cache = get_cache();
+  // the reference of the job keeps the entry alive while waiters are woken, and is passed on to the next job
+  bool continuing = false;
+  if (entry->failed) {
+    logging_warning("failed to compress file with inode %lu\n", (unsigned long)entry->inode);
+    free(entry->output.content);
+    entry->output.content = NULL;
+    entry->state = COMPRESSION_STATE_FAILED;
+    finish_compression(entry);
+    evict(entry);
+  } else {
+    if (entry->output.length != 0) {
+      if (entry->n_blocks == entry->blocks_capability) {
+        entry->blocks_capability = entry->blocks_capability == 0 ? 8 : entry->blocks_capability * 2;
+        entry->blocks = realloc(entry->blocks, sizeof(struct compression_block) * entry->blocks_capability);
+      }
+      entry->blocks[entry->n_blocks++] = entry->output;
+      entry->length += entry->output.length;
+      if (entry->cached) {
+        cache->used += entry->output.length;
+      }
+    } else {
+      free(entry->output.content);
+    }
+    entry->output.content = NULL;
+    entry->output.length = 0;
+    if (entry->finished) {
+      entry->state = COMPRESSION_STATE_COMPLETE;
+      finish_compression(entry);
+      enforce_budget();
+    } else if (!(continuing = worker_pool_submit(cache->pool, compress_chunk, complete_chunk, entry))) {
+      entry->state = COMPRESSION_STATE_FAILED;
+      finish_compression(entry);
+      evict(entry);
+    }
+  }
+  wake_waiters(entry);
+  if (!continuing) {
+    compression_release(entry);
+  }
+}
+
+void compression_initialize(size_t budget, struct worker_pool *pool) {
+  struct compression_cache *cache = get_cache();
+  cache->budget = budget;
+  cache->pool = pool;
+}
+
+bool compression_applicable(const char *type, size_t size) {
+  struct compression_cache *cache = get_cache();
+  // a single file shall never take a large share of the budget
+  if (cache->pool == NULL || size < CompressionMinimumSize || size > cache->budget / 4) {
+    return false;
+  }
+  static const char *const types[] = {
+      "application/javascript", "application/json", "application/wasm", "application/xml",
+      "application/xhtml+xml",  "image/svg+xml",    "image/x-icon",     "font/ttf",
+      "font/otf",
+  };
+  if (strncmp(type, "text/", 5) == 0) {
+    return true;
+  }
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (strcmp(type, types[i]) == 0) {
+      return true;
+    }
+  }
+  // structured syntax suffixes, e.g. application/ld+json
+  size_t length = strlen(type);
+  return (length > 5 && strcmp(type + length - 5, "+json") == 0) ||
+         (length > 4 && strcmp(type + length - 4, "+xml") == 0);
+}
+
+struct compression_entry *
+compression_acquire(int file_descriptor, const struct stat *status, enum content_coding coding) {
+  struct compression_cache *cache = get_cache();
+  if (coding != CONTENT_CODING_GZIP || cache->pool == NULL) {
+    return NULL;
+  }
+  struct compression_entry **bucket = &cache->buckets[get_bucket(status->st_dev, status->st_ino, coding)];
+  for (struct compression_entry *entry = *bucket; entry != NULL; entry = entry->next_in_bucket) {
+    if (entry->device == status->st_dev && entry->inode == status->st_ino && entry->coding == coding) {
+      if (entry->size == status->st_size && entry->modification.tv_sec == status->st_mtim.tv_sec &&
+          entry->modification.tv_nsec == status->st_mtim.tv_nsec) {
+        lru_unlink(cache, entry);
+        lru_push(cache, entry);
+        entry->references++;
+        return entry;
+      }
+      // the file is modified since compressed, drop the stale entry from the cache, while a running one is
+      //  torn down once its job completes, as the job holds a reference of its own
+      evict(entry);
+      break;
+    }
+  }
+  if (cache->running >= CompressionConcurrency) {
+    return NULL;
+  }
+  struct compression_entry *entry = calloc(1, sizeof(struct compression_entry));
+  entry->device = status->st_dev;
+  entry->inode = status->st_ino;
+  entry->size = status->st_size;
+  entry->modification = status->st_mtim;
+  entry->coding = coding;
+  entry->state = COMPRESSION_STATE_RUNNING;
+  // windowBits of 15 + 16 selects gzip wrapper
+  int result = deflateInit2(&entry->stream, CompressionGzipLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  if (result != Z_OK) {
+    free(entry);
+    return NULL;
+  }
+  entry->file_descriptor = fcntl(file_descriptor, F_DUPFD_CLOEXEC, 0);
+  if (entry->file_descriptor == -1) {
+    logging_error("cannot duplicate file descriptor for compression: %s\n", strerror(errno));
+    deflateEnd(&entry->stream);
+    free(entry);
+    return NULL;
+  }
+  if (!worker_pool_submit(cache->pool, compress_chunk, complete_chunk, entry)) {
+    close(entry->file_descriptor);
+    deflateEnd(&entry->stream);
+    free(entry);
+    return NULL;
+  }
+  cache->running++;
+  entry->cached = true;
+  entry->next_in_bucket = *bucket;
+  *bucket = entry;
+  lru_push(cache, entry);
+  // one for the cache, one for the job and one for the caller
+  entry->references = 3;
+  return entry;
+}
+
+enum compression_state compression_get_state(const struct compression_entry *entry) { return entry->state; }
+
+size_t compression_get_block_count(const struct compression_entry *entry) { return entry->n_blocks; }
+
+bool compression_get_block(
+    const struct compression_entry *entry, size_t index, const void **content, size_t *length
+) {
+  if (index >= entry->n_blocks) {
+    return false;
+  }
+  *content = entry->blocks[index].content;
+  *length = entry->blocks[index].length;
+  return true;
+}
+
+void compression_wait(struct compression_entry *entry, void (*wake)(void *context), void *context) {
+  if (entry->n_waiters == entry->waiters_capability) {
+    entry->waiters_capability = entry->waiters_capability == 0 ? 4 : entry->waiters_capability * 2;
+    entry->waiters = realloc(entry->waiters, sizeof(struct compression_waiter) * entry->waiters_capability);
+  }
+  entry->waiters[entry->n_waiters].wake = wake;
+  entry->waiters[entry->n_waiters].context = context;
+  entry->n_waiters++;
+}
+
+void compression_cancel_wait(struct compression_entry *entry, void *context) {
+  for (size_t i = 0; i < entry->n_waiters; i++) {
+    if (entry->waiters[i].context == context) {
+      entry->waiters[i] = entry->waiters[--entry->n_waiters];
+      return;
+    }
+  }
+}
\ No newline at end of file
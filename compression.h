@@ -0,0 +1,51 @@
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+#include <http_hl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <worker_pool.h>
+// compressed variants of files generated on the fly, kept in a cache with a budget of bytes
+//  compressing a file is split into jobs on a worker pool, each of which compresses a chunk of the file into
+//   a block, and blocks are appended to the entry on the event loop thread as jobs complete, therefore an
+//   entry can be streamed while it is still being compressed, and requests for the same file share the work
+//  only gzip is supported for now
+struct compression_entry;
+
+enum compression_state {
+  COMPRESSION_STATE_RUNNING,  // more blocks are to be appended
+  COMPRESSION_STATE_COMPLETE, // all blocks are available
+  COMPRESSION_STATE_FAILED,   // compression is aborted, the entry shall not be used any more
+};
+
+// set up the cache with a budget in bytes of compressed content, and the pool on which compression runs
+//  a budget of 0 disables compression
+void compression_initialize(size_t budget, struct worker_pool *pool);
+
+// check if a file of the media type and size is worth compressing on the fly
+bool compression_applicable(const char *type, size_t size);
+
+// get the entry of the file identified by status in coding, starting compression if not cached
+//  file_descriptor is only used during this call, a duplicate is made if compression starts
+//  return NULL if compression cannot be started now, e.g. too many files are being compressed
+//  the returned reference shall be released with compression_release
+struct compression_entry *
+compression_acquire(int file_descriptor, const struct stat *status, enum content_coding coding);
+
+// release a reference to the entry, entry is declared as void * so this can be used as a release hook
+void compression_release(void *entry);
+
+enum compression_state compression_get_state(const struct compression_entry *entry);
+// get number of blocks available
+size_t compression_get_block_count(const struct compression_entry *entry);
+// get the block at index, return false if it is not available yet
+bool compression_get_block(
+    const struct compression_entry *entry, size_t index, const void **content, size_t *length
+);
+
+// register a waiter, wake(context) is called once on the event loop thread when a block is appended or the
+//  state changes, whichever happens first
+void compression_wait(struct compression_entry *entry, void (*wake)(void *context), void *context);
+// unregister the waiter identified by context, if it is still waiting
+void compression_cancel_wait(struct compression_entry *entry, void *context);
+#endif
\ No newline at end of file
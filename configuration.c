@@ -0,0 +1,222 @@
+#include <common.h>
+#include <configuration.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct configuration *mutable_configuration(void) {
+  static struct configuration configuration = {
+      .entity_tag_content_hash = false,
+      .compression_cache_size = 64 * 1024 * 1024,
+      .file_cache_size = 4096,
+      .content_cache_size = 32 * 1024 * 1024,
+      .early_hints_manifest = NULL,
+      .archive = NULL,
+      .index_file = "index.html",
+      .autoindex = false,
+      .path_filter = false,
+      .scanner_penalty = 0,
+      .tls_early_data = false,
+      .n_tls_key_pairs = 0,
+      .slow_request_threshold = 0,
+  };
+  return &configuration;
+}
+const struct configuration *get_configuration(void) { return mutable_configuration(); }
+
+static void print_usage(const char *program) {
+  fprintf(
+      stderr,
+      "usage: %s [options]\n"
+      "  --etag-content-hash   derive ETag from file content instead of inode, size and modification time\n"
+      "  --compression-cache-size=BYTES\n"
+      "                        budget of content compressed on the fly, 0 disables it (default 67108864)\n"
+      "  --file-cache-size=N   number of files kept open with their metadata, 0 disables it (default 4096)\n"
+      "  --content-cache-size=BYTES\n"
+      "                        budget of small files kept in memory, 0 disables it (default 33554432)\n"
+      "  --early-hints-manifest=PATH\n"
+      "                        send 103 Early Hints with preload links of pages listed in the manifest\n"
+      "  --archive=PATH        serve the archive packed by tools/archive_builder in place of document root\n"
+      "  --index-file=NAME     file served for a directory, empty for none (default index.html)\n"
+      "  --autoindex           list a directory without an index file\n"
+      "  --path-filter         answer paths missing from document root without looking them up\n"
+      "  --scanner-penalty=N   refuse clients missing N times within a minute, 0 disables it (default 0)\n"
+      "  --tls-early-data      accept requests sent as early data (0-RTT) by resumed TLS sessions\n"
+      "  --tls-certificate=PATH\n"
+      "  --tls-key=PATH        certificate and its key in PEM, which are paired in order, repeat them for\n"
+      "                        keys of other types, e.g. ECDSA along with RSA (default keys/cnlab.cert and\n"
+      "                        keys/cnlab.prikey)\n"
+      "  --slow-request-threshold=MS\n"
+      "                        log requests taking MS milliseconds or longer with time of each stage, 0\n"
+      "                        disables it (default 0)\n"
+      "  --access-log=PATH     append a binary record of every request to PATH, which\n"
+      "                        tools/access_log_decoder converts to JSON lines\n"
+      "  --help                print this message and exit\n",
+      program
+  );
+}
+
+// parse a non-negative decimal integer, return false if value is not entirely such a number
+static bool parse_size(const char *value, size_t *result) {
+  if (*value < '0' || *value > '9') {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(value, &end, 10);
+  if (errno != 0 || *end != '\0' || parsed > SIZE_MAX) {
+    return false;
+  }
+  *result = parsed;
+  return true;
+}
+
+void configuration_parse(int argc, char *argv[]) {
+  enum {
+    OptionEntityTagContentHash = 256,
+    OptionCompressionCacheSize,
+    OptionFileCacheSize,
+    OptionContentCacheSize,
+    OptionEarlyHintsManifest,
+    OptionArchive,
+    OptionIndexFile,
+    OptionAutoindex,
+    OptionPathFilter,
+    OptionScannerPenalty,
+    OptionTLSEarlyData,
+    OptionTLSCertificate,
+    OptionTLSKey,
+    OptionSlowRequestThreshold,
+    OptionAccessLog,
+    OptionHelp,
+  };
+  static const struct option options[] = {
+      {"etag-content-hash", no_argument, NULL, OptionEntityTagContentHash},
+      {"compression-cache-size", required_argument, NULL, OptionCompressionCacheSize},
+      {"file-cache-size", required_argument, NULL, OptionFileCacheSize},
+      {"content-cache-size", required_argument, NULL, OptionContentCacheSize},
+      {"early-hints-manifest", required_argument, NULL, OptionEarlyHintsManifest},
+      {"archive", required_argument, NULL, OptionArchive},
+      {"index-file", required_argument, NULL, OptionIndexFile},
+      {"autoindex", no_argument, NULL, OptionAutoindex},
+      {"path-filter", no_argument, NULL, OptionPathFilter},
+      {"scanner-penalty", required_argument, NULL, OptionScannerPenalty},
+      {"tls-early-data", no_argument, NULL, OptionTLSEarlyData},
+      {"tls-certificate", required_argument, NULL, OptionTLSCertificate},
+      {"tls-key", required_argument, NULL, OptionTLSKey},
+      {"slow-request-threshold", required_argument, NULL, OptionSlowRequestThreshold},
+      {"access-log", required_argument, NULL, OptionAccessLog},
+      {"help", no_argument, NULL, OptionHelp},
+      {NULL, 0, NULL, 0},
+  };
+  struct configuration *configuration = mutable_configuration();
+  size_t n_tls_certificates = 0, n_tls_keys = 0;
+  int option;
+  while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (option) {
+    case OptionEntityTagContentHash:
+      configuration->entity_tag_content_hash = true;
+      break;
+    case OptionCompressionCacheSize:
+      if (!parse_size(optarg, &configuration->compression_cache_size)) {
+        logging_fatal("invalid compression cache size: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OptionFileCacheSize:
+      if (!parse_size(optarg, &configuration->file_cache_size)) {
+        logging_fatal("invalid file cache size: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OptionContentCacheSize:
+      if (!parse_size(optarg, &configuration->content_cache_size)) {
+        logging_fatal("invalid content cache size: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OptionEarlyHintsManifest:
+      configuration->early_hints_manifest = optarg;
+      break;
+    case OptionArchive:
+      configuration->archive = optarg;
+      break;
+    case OptionIndexFile:
+      // a name with '/' would reach beyond the directory
+      if (strchr(optarg, '/') != NULL || strcmp(optarg, ".") == 0 || strcmp(optarg, "..") == 0) {
+        logging_fatal("invalid index file: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      configuration->index_file = *optarg == '\0' ? NULL : optarg;
+      break;
+    case OptionAutoindex:
+      configuration->autoindex = true;
+      break;
+    case OptionPathFilter:
+      configuration->path_filter = true;
+      break;
+    case OptionScannerPenalty:
+      if (!parse_size(optarg, &configuration->scanner_penalty)) {
+        logging_fatal("invalid scanner penalty: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OptionTLSEarlyData:
+      configuration->tls_early_data = true;
+      break;
+    case OptionTLSCertificate:
+      if (n_tls_certificates == TLS_KEY_PAIRS_MAXIMUM) {
+        logging_fatal("too many certificates, at most %d are allowed\n", TLS_KEY_PAIRS_MAXIMUM);
+        exit(EXIT_FAILURE);
+      }
+      configuration->tls_certificates[n_tls_certificates++] = optarg;
+      break;
+    case OptionTLSKey:
+      if (n_tls_keys == TLS_KEY_PAIRS_MAXIMUM) {
+        logging_fatal("too many keys, at most %d are allowed\n", TLS_KEY_PAIRS_MAXIMUM);
+        exit(EXIT_FAILURE);
+      }
+      configuration->tls_keys[n_tls_keys++] = optarg;
+      break;
+    case OptionSlowRequestThreshold:
+      if (!parse_size(optarg, &configuration->slow_request_threshold)) {
+        logging_fatal("invalid slow request threshold: %s\n", optarg);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OptionAccessLog:
+      configuration->access_log = optarg;
+      break;
+    case OptionHelp:
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc) {
+    logging_fatal("unexpected argument: %s\n", argv[optind]);
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (n_tls_certificates != n_tls_keys) {
+    logging_fatal("%zu certificates are given with %zu keys\n", n_tls_certificates, n_tls_keys);
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  configuration->n_tls_key_pairs = n_tls_certificates;
+  if (configuration->n_tls_key_pairs == 0) {
+    configuration->tls_certificates[0] = "keys/cnlab.cert";
+    configuration->tls_keys[0] = "keys/cnlab.prikey";
+    configuration->n_tls_key_pairs = 1;
+  }
+}
\ No newline at end of file
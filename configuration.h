@@ -0,0 +1,53 @@
+#ifndef CONFIGURATION_H_
+#define CONFIGURATION_H_
+#include <stdbool.h>
+#include <stddef.h>
+// maximum number of certificate and key pairs of the server, one per key type is enough
+#define TLS_KEY_PAIRS_MAXIMUM 4
+// settings of the server, which are determined from command line arguments once at startup and never change
+//  afterwards
+struct configuration {
+  // derive ETag from a hash of file content instead of inode, size and modification time
+  //  this keeps ETag stable across copies of the same content (e.g. among multiple servers) at the cost of
+  //  reading the whole file to validate a request
+  bool entity_tag_content_hash;
+  // budget in bytes of content compressed on the fly, 0 disables compression on the fly
+  size_t compression_cache_size;
+  // maximum number of files kept open along with their metadata, 0 disables the file cache
+  size_t file_cache_size;
+  // budget in bytes of small files kept in memory along with their rendered heads, 0 disables the cache
+  size_t content_cache_size;
+  // path of the manifest of sub-resources announced with 103(Early Hints), NULL if early hints are disabled
+  const char *early_hints_manifest;
+  // path of the archive packed by tools/archive_builder which is served in place of the document root, NULL
+  //  if files are served from the document root
+  const char *archive;
+  // name of the file served for a directory, NULL if directories have no index file
+  const char *index_file;
+  // serve a generated listing for a directory without an index file
+  bool autoindex;
+  // answer requests for paths known not to exist from a bloom filter of the document root, before touching
+  //  the filesystem
+  bool path_filter;
+  // number of misses within a minute after which a client is refused for a while, 0 disables the penalty
+  size_t scanner_penalty;
+  // accept TLS early data (0-RTT) from resumed sessions, which may be replayed, therefore requests with
+  //  effects received as early data are refused
+  bool tls_early_data;
+  // paths of certificate and key pairs of the server in PEM, where tls_certificates[i] goes with tls_keys[i]
+  const char *tls_certificates[TLS_KEY_PAIRS_MAXIMUM];
+  const char *tls_keys[TLS_KEY_PAIRS_MAXIMUM];
+  size_t n_tls_key_pairs;
+  // requests taking at least this many milliseconds are logged with the time of each stage, 0 disables it
+  size_t slow_request_threshold;
+  // path of the binary access log which records every request, NULL if requests are not logged
+  const char *access_log;
+};
+
+// parse command line arguments into the global configuration
+//  this function calls exit(3) if the arguments are invalid or help is requested
+void configuration_parse(int argc, char *argv[]);
+
+// get the global configuration
+const struct configuration *get_configuration(void);
+#endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <content_cache.h>
+#include <prefetch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+  // number of buckets in the hash table of entries
+  ContentCacheBuckets = 4096,
+  // files larger than this are streamed from the file instead
+  ContentCacheFileLimit = 64 * 1024,
+};
+
+struct content_cache_entry {
+  char *path;
+  uint64_t hash;
+  // identity of the file cached
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modification;
+  bool vary;
+  // the rendered head and the body, which are sent together as two vectors
+  char *head;
+  size_t head_length;
+  char *body;
+  size_t body_length;
+  struct content_cache_entry *next_in_bucket;
+  // links in the ring scanned by the clock hand
+  struct content_cache_entry *ring_previous;
+  struct content_cache_entry *ring_next;
+  bool referenced; // hit since the hand passed it last time
+  // the cache holds one reference while the entry is cached
+  size_t references;
+};
+struct content_cache {
+  struct content_cache_entry *buckets[ContentCacheBuckets];
+  struct content_cache_entry *hand; // NULL if the ring is empty
+  size_t budget;
+  struct content_cache_statistics statistics;
+};
+
+static struct content_cache *get_cache(void) {
+  static struct content_cache cache;
+  return &cache;
+}
+static size_t entry_size(const struct content_cache_entry *entry) {
+  return sizeof(struct content_cache_entry) + strlen(entry->path) + entry->head_length + entry->body_length;
+}
+
+void content_cache_release(void *entry_) {
+  struct content_cache_entry *entry = entry_;
+  if (--entry->references == 0) {
+    free(entry->path);
+    free(entry->head);
+    free(entry->body);
+    free(entry);
+  }
+}
+// remove the entry from the cache, the entry is freed once all other references are released
+static void evict(struct content_cache_entry *entry) {
+  struct content_cache *cache = get_cache();
+  struct content_cache_entry **target = &cache->buckets[entry->hash % ContentCacheBuckets];
+  while (*target != entry) {
+    target = &(*target)->next_in_bucket;
+  }
+  *target = entry->next_in_bucket;
+  if (entry->ring_next == entry) {
+    cache->hand = NULL;
+  } else {
+    entry->ring_previous->ring_next = entry->ring_next;
+    entry->ring_next->ring_previous = entry->ring_previous;
+    if (cache->hand == entry) {
+      cache->hand = entry->ring_next;
+    }
+  }
+  cache->statistics.entries--;
+  cache->statistics.bytes -= entry_size(entry);
+  content_cache_release(entry);
+}
+// advance the clock hand until an entry not referenced recently is found and evict it
+static void evict_one(void) {
+  struct content_cache *cache = get_cache();
+  while (cache->hand->referenced) {
+    cache->hand->referenced = false;
+    cache->hand = cache->hand->ring_next;
+  }
+  evict(cache->hand);
+  cache->statistics.evictions++;
+}
+
+void content_cache_initialize(size_t budget) { get_cache()->budget = budget; }
+
+bool content_cache_applicable(size_t size) {
+  // a single file shall never take a large share of the budget
+  return size <= ContentCacheFileLimit && size <= get_cache()->budget / 8;
+}
+
+static bool is_same_file(const struct content_cache_entry *entry, const struct stat *status) {
+  return entry->device == status->st_dev && entry->inode == status->st_ino &&
+         entry->size == status->st_size && entry->modification.tv_sec == status->st_mtim.tv_sec &&
+         entry->modification.tv_nsec == status->st_mtim.tv_nsec;
+}
+
+struct content_cache_entry *content_cache_acquire(const char *path, const struct stat *status, bool vary) {
+  struct content_cache *cache = get_cache();
+  uint64_t hash = hash_string(path);
+  for (struct content_cache_entry *entry = cache->buckets[hash % ContentCacheBuckets]; entry != NULL;
+       entry = entry->next_in_bucket) {
+    if (entry->hash != hash || strcmp(entry->path, path) != 0) {
+      continue;
+    }
+    if (!is_same_file(entry, status) || entry->vary != vary) {
+      // the file changed since cached, or its head does
+      evict(entry);
+      cache->statistics.invalidations++;
+      break;
+    }
+    entry->referenced = true;
+    entry->references++;
+    cache->statistics.hits++;
+    return entry;
+  }
+  cache->statistics.misses++;
+  return NULL;
+}
+
+struct content_cache_entry *content_cache_insert(
+    const char *path, const struct stat *status, bool vary, int file_descriptor,
+    struct http_response *response
+) {
+  struct content_cache *cache = get_cache();
+  struct content_cache_entry *entry = calloc(1, sizeof(struct content_cache_entry));
+  entry->path = strdup(path);
+  entry->hash = hash_string(path);
+  entry->device = status->st_dev;
+  entry->inode = status->st_ino;
+  entry->size = status->st_size;
+  entry->modification = status->st_mtim;
+  entry->vary = vary;
+  entry->references = 1;
+  // read the body first, whose length is needed to render the head
+  entry->body_length = status->st_size;
+  entry->body = malloc(entry->body_length == 0 ? 1 : entry->body_length);
+  size_t read_length = 0;
+  while (read_length < entry->body_length) {
+    ssize_t size = prefetch_read(
+        file_descriptor, entry->body + read_length, entry->body_length - read_length, read_length, NULL, NULL
+    );
+    if (size <= 0) {
+      // the file shrank or cannot be read, which is left to the ordinary path
+      //  so is a file not in the page cache, which is being read into it for the next request
+      content_cache_release(entry);
+      return NULL;
+    }
+    read_length += size;
+  }
+  http_response_append_body_reference(response, entry->body, entry->body_length);
+  http_response_render_head(response, NULL, &entry->head_length);
+  entry->head = malloc(entry->head_length);
+  http_response_render_head(response, entry->head, &entry->head_length);
+
+  size_t size = entry_size(entry);
+  while (cache->hand != NULL && cache->statistics.bytes + size > cache->budget) {
+    evict_one();
+  }
+  struct content_cache_entry **bucket = &cache->buckets[entry->hash % ContentCacheBuckets];
+  entry->next_in_bucket = *bucket;
+  *bucket = entry;
+  // insert right behind the hand, which is the last to be examined
+  if (cache->hand == NULL) {
+    entry->ring_previous = entry;
+    entry->ring_next = entry;
+    cache->hand = entry;
+  } else {
+    entry->ring_next = cache->hand;
+    entry->ring_previous = cache->hand->ring_previous;
+    entry->ring_previous->ring_next = entry;
+    cache->hand->ring_previous = entry;
+  }
+  entry->references++;
+  cache->statistics.insertions++;
+  cache->statistics.entries++;
+  cache->statistics.bytes += size;
+  return entry;
+}
+
+void content_cache_get_head(const struct content_cache_entry *entry, const void **head, size_t *length) {
+  *head = entry->head;
+  *length = entry->head_length;
+}
+
+void content_cache_get_body(const struct content_cache_entry *entry, const void **body, size_t *length) {
+  *body = entry->body;
+  *length = entry->body_length;
+}
+
+void content_cache_get_statistics(struct content_cache_statistics *statistics) {
+  *statistics = get_cache()->statistics;
+}
\ No newline at end of file
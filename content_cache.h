@@ -0,0 +1,53 @@
+#ifndef CONTENT_CACHE_H_
+#define CONTENT_CACHE_H_
+#include <http.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+// content of small files kept in memory next to the head of the 200(OK) response serving it as a whole, which
+//  is rendered once when the file is cached, therefore a hit is sent as is without touching the filesystem
+//  entries are keyed by path along with the identity of the file (device, inode, size and modification
+//   time), so a changed file never hits the stale entry, which is replaced or evicted in time
+//  the total size of entries is kept within a budget with CLOCK eviction
+struct content_cache_entry;
+
+// counters of the cache since it is set up
+struct content_cache_statistics {
+  size_t hits;
+  size_t misses;
+  size_t insertions;
+  size_t evictions;     // entries dropped to keep within the budget
+  size_t invalidations; // entries dropped since the file changed
+  size_t entries;       // number of entries currently cached
+  size_t bytes;         // total size of entries currently cached
+};
+
+// set up the cache with a budget in bytes, 0 disables the cache
+void content_cache_initialize(size_t budget);
+
+// check if a file of size is small enough to be cached
+bool content_cache_applicable(size_t size);
+
+// get the entry of the file at path with status, whose head carries Vary: Accept-Encoding if vary is true
+//  return NULL on miss
+//  the returned reference shall be released with content_cache_release
+struct content_cache_entry *content_cache_acquire(const char *path, const struct stat *status, bool vary);
+
+// read the file at path with status from file_descriptor and cache it along with the head rendered from
+//  response, whose body shall be empty and is set to refer to the content
+//  return NULL if the file cannot be cached now, e.g. it changes while being read or is not in page cache
+//  the returned reference shall be released with content_cache_release
+struct content_cache_entry *content_cache_insert(
+    const char *path, const struct stat *status, bool vary, int file_descriptor,
+    struct http_response *response
+);
+
+// release a reference to the entry, entry is declared as void * so this can be used as a release hook
+void content_cache_release(void *entry);
+
+// get the rendered head and the body, which are valid until the reference is released
+void content_cache_get_head(const struct content_cache_entry *entry, const void **head, size_t *length);
+void content_cache_get_body(const struct content_cache_entry *entry, const void **body, size_t *length);
+
+void content_cache_get_statistics(struct content_cache_statistics *statistics);
+#endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <ctype.h>
+#include <early_hints.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct early_hints_entry {
+  char *path;
+  uint64_t hash;
+  char *links; // value of Link header
+};
+// an open addressing hash table, whose size is a power of two no less than twice the number of entries
+struct early_hints_table {
+  struct early_hints_entry *entries;
+  size_t size;
+  size_t count;
+};
+
+static struct early_hints_table *get_table(void) {
+  static struct early_hints_table table = {.entries = NULL, .size = 0, .count = 0};
+  return &table;
+}
+static void destroy_table(struct early_hints_table *table) {
+  for (size_t i = 0; i < table->size; i++) {
+    free(table->entries[i].path);
+    free(table->entries[i].links);
+  }
+  free(table->entries);
+  table->entries = NULL;
+  table->size = 0;
+  table->count = 0;
+}
+// find the slot of path, which is either the entry of path or an empty slot where it shall be inserted
+static struct early_hints_entry *
+find_slot(const struct early_hints_table *table, const char *path, uint64_t hash) {
+  for (size_t i = hash & (table->size - 1);; i = (i + 1) & (table->size - 1)) {
+    struct early_hints_entry *entry = &table->entries[i];
+    if (entry->path == NULL || (entry->hash == hash && strcmp(entry->path, path) == 0)) {
+      return entry;
+    }
+  }
+}
+static void grow_table(struct early_hints_table *table) {
+  struct early_hints_table grown = {
+      .entries = calloc(table->size == 0 ? 16 : table->size * 2, sizeof(struct early_hints_entry)),
+      .size = table->size == 0 ? 16 : table->size * 2,
+      .count = table->count,
+  };
+  for (size_t i = 0; i < table->size; i++) {
+    if (table->entries[i].path != NULL) {
+      *find_slot(&grown, table->entries[i].path, table->entries[i].hash) = table->entries[i];
+    }
+  }
+  free(table->entries);
+  *table = grown;
+}
+static void add_link(struct early_hints_table *table, const char *path, const char *link) {
+  if ((table->count + 1) * 2 > table->size) {
+    grow_table(table);
+  }
+  uint64_t hash = hash_string(path);
+  struct early_hints_entry *entry = find_slot(table, path, hash);
+  if (entry->path == NULL) {
+    entry->path = strdup(path);
+    entry->hash = hash;
+    entry->links = strdup(link);
+    table->count++;
+    return;
+  }
+  size_t length = strlen(entry->links);
+  entry->links = realloc(entry->links, length + strlen(link) + 3);
+  sprintf(entry->links + length, ", %s", link);
+}
+
+bool early_hints_load(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    logging_error("cannot open early hints manifest %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct early_hints_table loaded = {.entries = NULL, .size = 0, .count = 0};
+  char *line = NULL;
+  size_t capability = 0;
+  size_t line_number = 0;
+  bool succeed = true;
+  while (getline(&line, &capability, file) != -1) {
+    line_number++;
+    // trim trailing spaces, including the line break
+    size_t length = strlen(line);
+    while (length != 0 && isspace((unsigned char)line[length - 1])) {
+      line[--length] = '\0';
+    }
+    char *target = line;
+    while (isspace((unsigned char)*target)) {
+      target++;
+    }
+    if (*target == '\0' || *target == '#') {
+      continue;
+    }
+    char *link = target + strcspn(target, " \t");
+    if (*target != '/' || *link == '\0') {
+      logging_error("invalid line %zu in early hints manifest %s\n", line_number, path);
+      succeed = false;
+      break;
+    }
+    *link++ = '\0';
+    link += strspn(link, " \t");
+    add_link(&loaded, target, link);
+  }
+  free(line);
+  fclose(file);
+  if (!succeed) {
+    destroy_table(&loaded);
+    return false;
+  }
+  destroy_table(get_table());
+  *get_table() = loaded;
+  logging_information("loaded early hints of %zu paths from %s\n", loaded.count, path);
+  return true;
+}
+
+const char *early_hints_lookup(const char *path) {
+  struct early_hints_table *table = get_table();
+  if (table->count == 0) {
+    return NULL;
+  }
+  return find_slot(table, path, hash_string(path))->links;
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef EARLY_HINTS_H_
+#define EARLY_HINTS_H_
+#include <stdbool.h>
+// sub-resources critical to a page, announced with a 103(Early Hints) response ahead of the page itself
+//  the manifest is a text file with a path and a link value per line, e.g.
+//   /index.html </style.css>; rel=preload; as=style
+//   /index.html </app.js>; rel=preload; as=script
+//  multiple lines of the same path are combined into a single Link header, while empty lines and those
+//   starting with '#' are ignored
+
+// load the manifest from a file, replacing any loaded before, return false on failure
+bool early_hints_load(const char *path);
+
+// get the value of Link header announcing the sub-resources of a page at path, which is the path component of
+//  the request target, NULL if there is none
+//  the returned string is valid until the manifest is loaded again
+const char *early_hints_lookup(const char *path);
+#endif
\ No newline at end of file
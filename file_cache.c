@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <configuration.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <file_cache.h>
+#include <limits.h>
+#include <mime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+enum {
+  // changes of the filesystem that may invalidate an entry
+  WatchEvents = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR,
+  // changes of names in a directory, which may affect everything under the name
+  NamespaceEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO,
+};
+
+struct file_cache_entry {
+  char *path;
+  uint64_t hash;
+  // -1 if the path cannot be served, which is a negative entry
+  int file_descriptor;
+  bool directory; // the path is a directory, only for a negative entry
+  // the last component of the path is a symbolic link, whose target may be in a directory never watched
+  bool linked;
+  struct stat status;
+  const char *content_type;
+  char entity_tag[ENTITY_TAG_LENGTH];
+  char last_modified[HTTP_DATE_LENGTH];
+  // links in the hash table and the LRU list, valid only if cached, which holds a reference
+  struct file_cache_entry *next_in_bucket;
+  struct file_cache_entry *lru_previous;
+  struct file_cache_entry *lru_next;
+  size_t references;
+};
+// a watched directory, multiple directories may share a watch descriptor if they are the same one
+struct watch {
+  int descriptor;
+  char *directory; // relative to the document root without trailing '/', empty for the root itself
+};
+struct file_cache {
+  struct file_cache_entry **buckets;
+  size_t n_buckets; // a power of two
+  size_t count;
+  size_t capacity;
+  // most recently used at head
+  struct file_cache_entry *lru_head;
+  struct file_cache_entry *lru_tail;
+  int notification; // the inotify instance, -1 if caching is disabled
+  struct watch *watches;
+  size_t n_watches;
+  size_t watches_capability;
+};
+
+static struct file_cache *get_cache(void) {
+  static struct file_cache cache = {.notification = -1};
+  return &cache;
+}
+
+// generate ETag of an open file with status into buffer of ENTITY_TAG_LENGTH bytes, as the configuration says
+static void generate_entity_tag(char *buffer, int file_descriptor, const struct stat *status) {
+  if (!get_configuration()->entity_tag_content_hash) {
+    format_entity_tag(buffer, status->st_ino, status->st_size, &status->st_mtim);
+  } else if (status->st_size == 0) {
+    format_content_entity_tag(buffer, NULL, 0);
+  } else {
+    void *content = mmap(NULL, status->st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (content == MAP_FAILED) {
+      // fall back to metadata, which is still a valid validator though not shared among servers
+      format_entity_tag(buffer, status->st_ino, status->st_size, &status->st_mtim);
+      return;
+    }
+    format_content_entity_tag(buffer, content, status->st_size);
+    munmap(content, status->st_size);
+  }
+}
+
+static void lru_unlink(struct file_cache *cache, struct file_cache_entry *entry) {
+  *(entry->lru_previous == NULL ? &cache->lru_head : &entry->lru_previous->lru_next) = entry->lru_next;
+  *(entry->lru_next == NULL ? &cache->lru_tail : &entry->lru_next->lru_previous) = entry->lru_previous;
+  entry->lru_previous = NULL;
+  entry->lru_next = NULL;
+}
+static void lru_push(struct file_cache *cache, struct file_cache_entry *entry) {
+  entry->lru_previous = NULL;
+  entry->lru_next = cache->lru_head;
+  *(cache->lru_head == NULL ? &cache->lru_tail : &cache->lru_head->lru_previous) = entry;
+  cache->lru_head = entry;
+}
+
+void file_cache_release(void *entry_) {
+  struct file_cache_entry *entry = entry_;
+  if (--entry->references != 0) {
+    return;
+  }
+  if (entry->file_descriptor != -1) {
+    close(entry->file_descriptor);
+  }
+  free(entry->path);
+  free(entry);
+}
+// remove the entry from the cache, the file is closed once all other references are released
+static void evict(struct file_cache_entry *entry) {
+  struct file_cache *cache = get_cache();
+  struct file_cache_entry **target = &cache->buckets[entry->hash & (cache->n_buckets - 1)];
+  while (*target != entry) {
+    target = &(*target)->next_in_bucket;
+  }
+  *target = entry->next_in_bucket;
+  lru_unlink(cache, entry);
+  cache->count--;
+  file_cache_release(entry);
+}
+// check if the path of an entry still resolves to the file opened, the same as content_cache does
+static bool is_same_file(const struct file_cache_entry *entry) {
+  struct stat status;
+  return fstatat(get_document_root(), entry->path, &status, 0) == 0 &&
+         status.st_dev == entry->status.st_dev && status.st_ino == entry->status.st_ino &&
+         status.st_size == entry->status.st_size &&
+         status.st_mtim.tv_sec == entry->status.st_mtim.tv_sec &&
+         status.st_mtim.tv_nsec == entry->status.st_mtim.tv_nsec;
+}
+static struct file_cache_entry *lookup(const char *path, uint64_t hash) {
+  struct file_cache *cache = get_cache();
+  for (struct file_cache_entry *entry = cache->buckets[hash & (cache->n_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket) {
+    if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+// evict entries whose path is under directory, which ends with '/'
+static void evict_under(const char *directory) {
+  struct file_cache *cache = get_cache();
+  size_t length = strlen(directory);
+  struct file_cache_entry *target = cache->lru_head;
+  while (target != NULL) {
+    struct file_cache_entry *next = target->lru_next;
+    if (strncmp(target->path, directory, length) == 0) {
+      evict(target);
+    }
+    target = next;
+  }
+}
+static void evict_all(void) {
+  struct file_cache *cache = get_cache();
+  while (cache->lru_head != NULL) {
+    evict(cache->lru_head);
+  }
+}
+
+// make sure that directory and all its ancestors are watched, directory is modified temporarily
+//  return false if any of them cannot be watched, in which case entries under it shall not be cached
+static bool watch_directory(char *directory) {
+  struct file_cache *cache = get_cache();
+  for (size_t i = 0; i < cache->n_watches; i++) {
+    if (strcmp(cache->watches[i].directory, directory) == 0) {
+      return true;
+    }
+  }
+  // watch ancestors first, so that a change to any of them is never missed once this is watched
+  char *slash = strrchr(directory, '/');
+  if (slash != NULL) {
+    *slash = '\0';
+    bool watched = watch_directory(directory);
+    *slash = '/';
+    if (!watched) {
+      return false;
+    }
+  } else if (*directory != '\0') {
+    if (!watch_directory("")) {
+      return false;
+    }
+  }
+  // the working directory is the document root
+  int descriptor = inotify_add_watch(cache->notification, *directory == '\0' ? "." : directory, WatchEvents);
+  if (descriptor == -1) {
+    if (errno != ENOENT && errno != ENOTDIR) {
+      logging_warning("cannot watch directory /%s: %s\n", directory, strerror(errno));
+    }
+    return false;
+  }
+  if (cache->n_watches == cache->watches_capability) {
+    cache->watches_capability = cache->watches_capability == 0 ? 16 : cache->watches_capability * 2;
+    cache->watches = realloc(cache->watches, sizeof(struct watch) * cache->watches_capability);
+  }
+  cache->watches[cache->n_watches].descriptor = descriptor;
+  cache->watches[cache->n_watches].directory = strdup(directory);
+  cache->n_watches++;
+  return true;
+}
+// forget watches with descriptor, which is removed by the kernel
+static void drop_watch(int descriptor) {
+  struct file_cache *cache = get_cache();
+  for (size_t i = 0; i < cache->n_watches;) {
+    if (cache->watches[i].descriptor == descriptor) {
+      free(cache->watches[i].directory);
+      cache->watches[i] = cache->watches[--cache->n_watches];
+    } else {
+      i++;
+    }
+  }
+}
+// invalidate entries affected by an event on name in a watched directory
+static void handle_event(const struct watch *watch, const struct inotify_event *event) {
+  size_t length = strlen(watch->directory);
+  char path[length + event->len + 3];
+  if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+    // the directory itself is gone, so is everything under it
+    if (length == 0) {
+      evict_all();
+    } else {
+      sprintf(path, "%s/", watch->directory);
+      evict_under(path);
+    }
+    return;
+  }
+  if (event->len == 0) {
+    return;
+  }
+  sprintf(path, length == 0 ? "%s%s" : "%s/%s", watch->directory, event->name);
+  struct file_cache_entry *entry = lookup(path, hash_string(path));
+  if (entry != NULL) {
+    evict(entry);
+  }
+  // a name replaced may be a directory or a symbolic link to one, e.g. when a release is switched
+  if (event->mask & NamespaceEvents) {
+    strcat(path, "/");
+    evict_under(path);
+  }
+}
+
+void file_cache_handle_notification(void *context) {
+  (void)context;
+  struct file_cache *cache = get_cache();
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (true) {
+    ssize_t size = read(cache->notification, buffer, sizeof(buffer));
+    if (size <= 0) {
+      return;
+    }
+    for (char *target = buffer; target < buffer + size;) {
+      const struct inotify_event *event = (const struct inotify_event *)target;
+      target += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // events are lost, nothing can be trusted
+        logging_warning("file change notifications overflowed, the file cache is flushed\n");
+        evict_all();
+        continue;
+      }
+      for (size_t i = 0; i < cache->n_watches; i++) {
+        if (cache->watches[i].descriptor == event->wd) {
+          handle_event(&cache->watches[i], event);
+        }
+      }
+      if (event->mask & IN_IGNORED) {
+        drop_watch(event->wd);
+      }
+    }
+  }
+}
+
+bool file_cache_initialize(size_t capacity) {
+  struct file_cache *cache = get_cache();
+  // leave at least half of the open files for connections
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+      capacity > limit.rlim_cur / 2) {
+    capacity = limit.rlim_cur / 2;
+    logging_information("file cache is limited to %zu entries by the limit of open files\n", capacity);
+  }
+  if (capacity == 0) {
+    return true;
+  }
+  cache->notification = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cache->notification == -1) {
+    logging_error("cannot initialize inotify, the file cache is disabled: %s\n", strerror(errno));
+    return false;
+  }
+  cache->capacity = capacity;
+  cache->n_buckets = 1;
+  while (cache->n_buckets < capacity) {
+    cache->n_buckets <<= 1;
+  }
+  cache->buckets = calloc(cache->n_buckets, sizeof(struct file_cache_entry *));
+  return true;
+}
+
+int file_cache_get_notification_descriptor(void) { return get_cache()->notification; }
+
+// open path and fill the entry accordingly, which becomes a negative one if path cannot be served
+//  return false if the result is transient and shall not be cached, e.g. running out of file descriptors
+static bool open_entry(struct file_cache_entry *entry) {
+  // a symbolic link as the last component is followed only after trying not to, so it is known to be one
+  entry->file_descriptor = open_beneath(entry->path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (entry->file_descriptor == -1 && errno == ELOOP) {
+    entry->linked = true;
+    entry->file_descriptor = open_beneath(entry->path, O_RDONLY | O_CLOEXEC);
+  }
+  if (entry->file_descriptor == -1) {
+    return errno == ENOENT || errno == ENOTDIR || errno == EXDEV || errno == ELOOP || errno == EACCES;
+  }
+  fstat(entry->file_descriptor, &entry->status);
+  if (!S_ISREG(entry->status.st_mode)) {
+    entry->directory = S_ISDIR(entry->status.st_mode);
+    close(entry->file_descriptor);
+    entry->file_descriptor = -1;
+    return true;
+  }
+  entry->content_type = mime_type_lookup(entry->path);
+  generate_entity_tag(entry->entity_tag, entry->file_descriptor, &entry->status);
+  format_http_date(entry->status.st_mtim.tv_sec, entry->last_modified);
+  return true;
+}
+
+struct file_cache_entry *file_cache_acquire(const char *path, bool *directory) {
+  struct file_cache *cache = get_cache();
+  uint64_t hash = hash_string(path);
+  struct file_cache_entry *entry = cache->notification == -1 ? NULL : lookup(path, hash);
+  if (entry != NULL && entry->linked && !is_same_file(entry)) {
+    // a file edited through another name is never notified, so an entry reached through a symbolic link is
+    //  checked against the filesystem on every hit instead
+    evict(entry);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+    if (entry->file_descriptor == -1) {
+      if (directory != NULL) {
+        *directory = entry->directory;
+      }
+      return NULL;
+    }
+    entry->references++;
+    return entry;
+  }
+  entry = calloc(1, sizeof(struct file_cache_entry));
+  entry->path = strdup(path);
+  entry->hash = hash;
+  entry->references = 1;
+  // the watch is set up before opening, therefore any change after the file is opened is notified
+  bool watched = false;
+  if (cache->notification != -1) {
+    char directory[strlen(path) + 1];
+    strcpy(directory, path);
+    char *slash = strrchr(directory, '/');
+    *(slash == NULL ? directory : slash) = '\0';
+    watched = watch_directory(directory);
+  }
+  if (open_entry(entry) && watched) {
+    if (cache->count == cache->capacity) {
+      evict(cache->lru_tail);
+    }
+    struct file_cache_entry **bucket = &cache->buckets[hash & (cache->n_buckets - 1)];
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+    lru_push(cache, entry);
+    entry->references++;
+    cache->count++;
+  }
+  if (entry->file_descriptor == -1) {
+    if (directory != NULL) {
+      *directory = entry->directory;
+    }
+    file_cache_release(entry);
+    return NULL;
+  }
+  return entry;
+}
+
+int file_cache_get_descriptor(const struct file_cache_entry *entry) { return entry->file_descriptor; }
+
+const struct stat *file_cache_get_status(const struct file_cache_entry *entry) { return &entry->status; }
+
+const char *file_cache_get_content_type(const struct file_cache_entry *entry) { return entry->content_type; }
+
+const char *file_cache_get_entity_tag(const struct file_cache_entry *entry) { return entry->entity_tag; }
+
+const char *file_cache_get_last_modified(const struct file_cache_entry *entry) {
+  return entry->last_modified;
+}
\ No newline at end of file
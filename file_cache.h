@@ -0,0 +1,46 @@
+#ifndef FILE_CACHE_H_
+#define FILE_CACHE_H_
+#include <http_hl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+// files opened for requests are kept open in a cache keyed by their path relative to the document root, along
+//  with their status and headers derived from it, therefore a hit costs no system call at all, except for a
+//  path ending in a symbolic link, which is checked with stat(2) on every hit
+//  paths that cannot be served are cached as well, so repeated requests for them are answered directly
+//  entries are invalidated as soon as the filesystem changes under them through inotify(7) watches on the
+//   directories involved, which include all ancestors of a cached path up to the document root
+struct file_cache_entry;
+
+// set up the cache holding at most capacity entries, 0 disables caching, in which case every acquisition
+//  opens the file again
+//  capacity is reduced if it does not fit in the limit of open files of the process
+//  return false if the cache cannot be set up, in which case caching is disabled as well
+bool file_cache_initialize(size_t capacity);
+
+// get the file descriptor which becomes readable when the filesystem changes, -1 if caching is disabled
+int file_cache_get_notification_descriptor(void);
+
+// invalidate entries affected by the changes notified, this shall be called when the descriptor above becomes
+//  readable, context is unused so this can be registered as an event handler
+void file_cache_handle_notification(void *context);
+
+// get the entry of the regular file at path, which is relative to the document root and normalized
+//  return NULL if there is no such file that can be served, in which case directory is set to whether path is
+//   a directory, unless directory is NULL
+//  the returned reference shall be released with file_cache_release
+struct file_cache_entry *file_cache_acquire(const char *path, bool *directory);
+
+// release a reference to the entry, entry is declared as void * so this can be used as a release hook
+void file_cache_release(void *entry);
+
+// get the open file, which is valid until the reference is released
+int file_cache_get_descriptor(const struct file_cache_entry *entry);
+// get status of the file when it was opened
+const struct stat *file_cache_get_status(const struct file_cache_entry *entry);
+// get media type of the file used for Content-Type
+const char *file_cache_get_content_type(const struct file_cache_entry *entry);
+// get validators of the file used for ETag and Last-Modified
+const char *file_cache_get_entity_tag(const struct file_cache_entry *entry);
+const char *file_cache_get_last_modified(const struct file_cache_entry *entry);
+#endif
\ No newline at end of file
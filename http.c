@@ -1,10 +1,12 @@
 #include "http.h"
 #include <assert.h>
 #include <ctype.h>
+#include <probes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #ifndef NDEBUG
 #define debug(fmt, ...) fprintf(stderr, fmt __VA_OPT__(, ) __VA_ARGS__)
 #else
@@ -318,6 +320,22 @@ int http_request_get_url(
   return HTTP_ERROR_CODE_SUCCEED;
 }
 
+int http_request_get_version(
+    const struct http_request *_Nonnull restrict request, char *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+) {
+  if (request->state != HTTP_REQUEST_STATE_PARSED) {
+    return HTTP_ERROR_CODE_REQUEST_NO_VALID_DATA;
+  }
+  if (buffer == NULL || (buffer != NULL && *length < request->start_line.http_version_length + 1)) {
+    *length = request->start_line.http_version_length + 1;
+    return buffer == NULL ? HTTP_ERROR_CODE_SUCCEED : HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE;
+  }
+  strcpy(buffer, request->start_line.http_version);
+  *length = request->start_line.http_version_length;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
 int http_request_get_header(
     const struct http_request *_Nonnull restrict request, const char *_Nonnull restrict name,
     char *_Nullable restrict buffer, size_t *_Nonnull restrict length
@@ -363,10 +381,92 @@ struct state_line {
   char *description;
   size_t description_length;
 };
+// body of a response is a sequence of parts, each of which is either a block of memory or a range of the file
+//  attached to the response
+//  content of all parts in memory is kept in a single pool, referenced by offset since the pool may move
+struct body_part {
+  enum body_part_type {
+    BODY_PART_MEMORY,    // offset is into the pool
+    BODY_PART_FILE,      // offset is into the attached file
+    BODY_PART_REFERENCE, // offset is the address of memory not owned by the response
+  } type;
+  size_t offset;
+  size_t length;
+};
+struct body_parts {
+  struct body_part *parts;
+  size_t count;
+  size_t capability;
+  struct body pool;
+  size_t pool_capability;
+  int file_descriptor; // the attached file, -1 if there is not one
+  bool file_owned;     // the attached file is closed with the response
+  size_t length;       // total length of all parts
+  size_t file_length;  // total length of parts in file
+};
+// callbacks run when the response is destroyed, which release resources borrowed by the response
+struct release_hook {
+  void (*release)(void *context);
+  void *context;
+  struct release_hook *next;
+};
+
+static void initialize_body_parts(struct body_parts *body) {
+  body->parts = NULL;
+  body->count = 0;
+  body->capability = 0;
+  body->pool.body = NULL;
+  body->pool.length = 0;
+  body->pool_capability = 0;
+  body->file_descriptor = -1;
+  body->file_owned = false;
+  body->length = 0;
+  body->file_length = 0;
+}
+static void destroy_body_parts(struct body_parts *body) {
+  free(body->parts);
+  destroy_body(&body->pool);
+  if (body->file_descriptor != -1 && body->file_owned) {
+    close(body->file_descriptor);
+  }
+  initialize_body_parts(body);
+}
+static void
+append_body_part(struct body_parts *body, enum body_part_type type, size_t offset, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  body->length += length;
+  if (type == BODY_PART_FILE) {
+    body->file_length += length;
+  }
+  // extend the last part if the new one follows it directly
+  if (body->count != 0) {
+    struct body_part *last = &body->parts[body->count - 1];
+    if (last->type == type && last->offset + last->length == offset) {
+      last->length += length;
+      return;
+    }
+  }
+  if (body->count == body->capability) {
+    body->capability = body->capability == 0 ? 4 : body->capability * 2;
+    body->parts = realloc(body->parts, sizeof(struct body_part) * body->capability);
+  }
+  body->parts[body->count].type = type;
+  body->parts[body->count].offset = offset;
+  body->parts[body->count].length = length;
+  body->count++;
+}
+
 struct http_response {
   struct state_line state_line;
   struct headers headers;
-  struct body body;
+  // an interim response is present if interim_headers is not NULL
+  struct state_line interim_state_line;
+  struct headers *interim_headers;
+  struct body_parts body;
+  bool head_prerendered; // the head is supplied in the body
+  struct release_hook *release_hooks;
 };
 const size_t http_response_size = sizeof(struct http_response);
 
@@ -374,16 +474,33 @@ int http_response_initialize(struct http_response *_Nonnull response) {
   response->state_line.description = NULL;
   response->state_line.description_length = 0;
   response->headers.header_list = NULL;
-  response->body.body = NULL;
-  response->body.length = 0;
+  response->interim_state_line.description = NULL;
+  response->interim_state_line.description_length = 0;
+  response->interim_headers = NULL;
+  initialize_body_parts(&response->body);
+  response->head_prerendered = false;
+  response->release_hooks = NULL;
   return HTTP_ERROR_CODE_SUCCEED;
 }
 
 // get default description of a state code, NULL if such code is not matched
 static const char *get_default_description(enum http_response_code code) {
   static char *descriptions[] = {
-      "OK",        "No Content", "Partial Content",       "Moved Permanently", "Bad Request",
-      "Forbidden", "Not Found",  "Internal Server Error", "Not Implemented",   "HTTP Version Not Supported",
+      "Early Hints",
+      "OK",
+      "No Content",
+      "Partial Content",
+      "Moved Permanently",
+      "Not Modified",
+      "Bad Request",
+      "Forbidden",
+      "Not Found",
+      "Range Not Satisfiable",
+      "Too Early",
+      "Internal Server Error",
+      "Not Implemented",
+      "Service Unavailable",
+      "HTTP Version Not Supported",
   };
   assert(sizeof(descriptions) / sizeof(descriptions[0]) == HTTP_RESPONSE_CODE_MAX);
   if (code >= HTTP_RESPONSE_CODE_MAX || code < 0) {
@@ -393,7 +510,9 @@ static const char *get_default_description(enum http_response_code code) {
   return descriptions[code];
 }
 static const char *get_representative_state_code(enum http_response_code code) {
-  static char *state[] = {"200", "204", "206", "301", "400", "403", "404", "500", "501", "505"};
+  static char *state[] = {
+      "103", "200", "204", "206", "301", "304", "400", "403", "404", "416", "425", "500", "501", "503", "505",
+  };
   static char buffer[16];
   assert(sizeof(state) / sizeof(state[0]) == HTTP_RESPONSE_CODE_MAX);
   if (code >= HTTP_RESPONSE_CODE_MAX || code < 0) {
@@ -404,33 +523,42 @@ static const char *get_representative_state_code(enum http_response_code code) {
   return state[code];
 }
 
-int http_response_set_code(
-    struct http_response *_Nonnull restrict response, enum http_response_code code,
-    const char *_Nullable restrict description
-) {
-  if (response->state_line.description != NULL) {
-    free(response->state_line.description);
-    response->state_line.description_length = 0;
+static void
+set_state_line(struct state_line *state_line, enum http_response_code code, const char *description) {
+  if (state_line->description != NULL) {
+    free(state_line->description);
+    state_line->description = NULL;
+    state_line->description_length = 0;
   }
   if (description == NULL) {
     description = get_default_description(code);
   }
-  response->state_line.code = code;
+  state_line->code = code;
   if (description != NULL) {
-    response->state_line.description_length = strlen(description);
-    response->state_line.description = malloc(response->state_line.description_length + 1);
-    strcpy(response->state_line.description, description);
+    state_line->description_length = strlen(description);
+    state_line->description = malloc(state_line->description_length + 1);
+    strcpy(state_line->description, description);
   }
-  return HTTP_ERROR_CODE_SUCCEED;
 }
 
-int http_response_set_header(
-    struct http_response *_Nonnull restrict response, const char *_Nonnull restrict key,
-    const char *_Nonnull restrict value
+int http_response_set_code(
+    struct http_response *_Nonnull restrict response, enum http_response_code code,
+    const char *_Nullable restrict description
 ) {
+  set_state_line(&response->state_line, code, description);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+enum http_response_code http_response_get_code(const struct http_response *_Nonnull response) {
+  return response->state_line.code;
+}
+const char *_Nonnull http_response_code_get_digits(enum http_response_code code) {
+  return get_representative_state_code(code);
+}
+
+static void set_header(struct headers *headers, const char *key, const char *value) {
   struct header **prev = NULL;
   struct header *target = NULL;
-  lookup_header(&response->headers, key, &target, &prev);
+  lookup_header(headers, key, &target, &prev);
   if (target != NULL) {
     free(target->value);
     target->value = malloc(strlen(value) + 1);
@@ -444,6 +572,44 @@ int http_response_set_header(
     target->next = *prev;
     *prev = target;
   }
+}
+
+int http_response_set_header(
+    struct http_response *_Nonnull restrict response, const char *_Nonnull restrict key,
+    const char *_Nonnull restrict value
+) {
+  set_header(&response->headers, key, value);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+// drop the interim response if there is one
+static void clear_interim(struct http_response *response) {
+  free(response->interim_state_line.description);
+  response->interim_state_line.description = NULL;
+  response->interim_state_line.description_length = 0;
+  if (response->interim_headers != NULL) {
+    destroy_headers(response->interim_headers);
+    free(response->interim_headers);
+    response->interim_headers = NULL;
+  }
+}
+
+int http_response_set_interim_code(struct http_response *_Nonnull response, enum http_response_code code) {
+  clear_interim(response);
+  set_state_line(&response->interim_state_line, code, NULL);
+  response->interim_headers = malloc(sizeof(struct headers));
+  response->interim_headers->header_list = NULL;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_set_interim_header(
+    struct http_response *_Nonnull restrict response, const char *_Nonnull restrict key,
+    const char *_Nonnull restrict value
+) {
+  if (response->interim_headers == NULL) {
+    return HTTP_ERROR_CODE_NO_INTERIM_RESPONSE;
+  }
+  set_header(response->interim_headers, key, value);
   return HTTP_ERROR_CODE_SUCCEED;
 }
 
@@ -451,37 +617,143 @@ int http_response_set_body(
     struct http_response *_Nonnull restrict response, const void *_Nonnull restrict body,
     const size_t *_Nullable restrict length
 ) {
-  destroy_body(&response->body);
-  response->body.length = length == NULL ? strlen(body) : *length;
-  response->body.body = malloc(response->body.length);
-  memcpy(response->body.body, body, response->body.length);
-  // regenerate Content-Length
-  char buffer[64]; // such size shall be overwhelmingly large
-  sprintf(buffer, "%lu", response->body.length);
-  return http_response_set_header(response, "Content-Length", buffer);
+  destroy_body_parts(&response->body);
+  return http_response_append_body(response, body, length == NULL ? strlen(body) : *length);
+}
+
+int http_response_set_body_file(struct http_response *_Nonnull response, int file_descriptor) {
+  http_response_set_body_file_reference(response, file_descriptor);
+  response->body.file_owned = true;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_set_body_file_reference(struct http_response *_Nonnull response, int file_descriptor) {
+  if (response->body.file_descriptor != -1 && response->body.file_owned) {
+    close(response->body.file_descriptor);
+  }
+  response->body.file_descriptor = file_descriptor;
+  response->body.file_owned = false;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_append_body(
+    struct http_response *_Nonnull restrict response, const void *_Nonnull restrict content, size_t length
+) {
+  struct body *pool = &response->body.pool;
+  if (pool->length + length > response->body.pool_capability) {
+    size_t capability = response->body.pool_capability == 0 ? 256 : response->body.pool_capability;
+    while (capability < pool->length + length) {
+      capability *= 2;
+    }
+    pool->body = realloc(pool->body, capability);
+    response->body.pool_capability = capability;
+  }
+  memcpy(pool->body + pool->length, content, length);
+  append_body_part(&response->body, BODY_PART_MEMORY, pool->length, length);
+  pool->length += length;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_append_body_file(struct http_response *_Nonnull response, size_t offset, size_t length) {
+  if (response->body.file_descriptor == -1) {
+    return HTTP_ERROR_CODE_NO_BODY_FILE;
+  }
+  append_body_part(&response->body, BODY_PART_FILE, offset, length);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_append_body_reference(
+    struct http_response *_Nonnull restrict response, const void *_Nonnull restrict content, size_t length
+) {
+  append_body_part(&response->body, BODY_PART_REFERENCE, (uintptr_t)content, length);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_add_release_hook(
+    struct http_response *_Nonnull response, void (*_Nonnull release)(void *_Nullable context),
+    void *_Nullable context
+) {
+  struct release_hook *hook = malloc(sizeof(struct release_hook));
+  hook->release = release;
+  hook->context = context;
+  hook->next = response->release_hooks;
+  response->release_hooks = hook;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+static size_t get_headers_memory(const struct headers *headers) {
+  size_t total = 0;
+  for (const struct header *target = headers->header_list; target != NULL; target = target->next) {
+    total += sizeof(struct header) + strlen(target->key) + strlen(target->value) + 2;
+  }
+  return total;
+}
+void http_response_get_memory(
+    const struct http_response *_Nonnull restrict response,
+    struct http_response_memory *_Nonnull restrict memory
+) {
+  memory->body_length = response->body.length;
+  memory->pool_capacity = response->body.pool_capability;
+  memory->pool_length = response->body.pool.length;
+  memory->overhead = get_headers_memory(&response->headers) + response->state_line.description_length +
+                     sizeof(struct body_part) * response->body.capability;
+  if (response->interim_headers != NULL) {
+    memory->overhead += sizeof(struct headers) + get_headers_memory(response->interim_headers) +
+                        response->interim_state_line.description_length;
+  }
+  for (const struct release_hook *hook = response->release_hooks; hook != NULL; hook = hook->next) {
+    memory->overhead += sizeof(struct release_hook);
+  }
+}
+
+size_t http_response_get_body_part_count(const struct http_response *_Nonnull response) {
+  return response->body.count;
+}
+
+int http_response_get_body_part(
+    const struct http_response *_Nonnull restrict response, size_t index,
+    struct http_body_part *_Nonnull restrict part
+) {
+  if (index >= response->body.count) {
+    return HTTP_ERROR_CODE_NO_SUCH_BODY_PART;
+  }
+  const struct body_part *target = &response->body.parts[index];
+  part->length = target->length;
+  if (target->type == BODY_PART_MEMORY) {
+    part->content = response->body.pool.body + target->offset;
+    part->file_descriptor = -1;
+    part->offset = 0;
+  } else if (target->type == BODY_PART_REFERENCE) {
+    part->content = (const void *)(uintptr_t)target->offset;
+    part->file_descriptor = -1;
+    part->offset = 0;
+  } else {
+    part->content = NULL;
+    part->file_descriptor = response->body.file_descriptor;
+    part->offset = target->offset;
+  }
+  return HTTP_ERROR_CODE_SUCCEED;
 }
 
 // HTTP version used for response
 static const char *const HTTP_VERSION = "HTTP/1.1";
 static const size_t http_version_length = strlen(HTTP_VERSION);
 static const size_t state_code_length = 3;
-// measure the size of buffer required to render the response
-static size_t measure_response_size(const struct http_response *response) {
+// measure the size of buffer required to render status line and headers
+static size_t measure_head_size(const struct state_line *state_line, const struct headers *headers) {
   size_t result = 0;
   // start line: [<VERSION> <STATE_CODE>{ <DESCRIPTION>}\r\n]
-  if (response->state_line.description_length != 0) {
-    result += http_version_length + state_code_length + response->state_line.description_length + 4;
+  if (state_line->description_length != 0) {
+    result += http_version_length + state_code_length + state_line->description_length + 4;
   } else {
     result += http_version_length + state_code_length + 3;
   }
   // each header: [<KEY>: <VALUE>\r\n]
-  for (struct header *target = response->headers.header_list; target != NULL; target = target->next) {
+  for (struct header *target = headers->header_list; target != NULL; target = target->next) {
     result += strlen(target->key) + strlen(target->value) + 4;
   }
   // empty line splitting headers and body
   result += 2;
-  // body size
-  result += response->body.length;
   return result;
 }
 
@@ -490,31 +762,19 @@ static inline void copy_and_advance(void *restrict *destination, const void *res
   *destination += size;
 }
 
-int http_response_render(
-    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
-    size_t *_Nonnull restrict length
-) {
-  // update Content-Length if body was not set
-  if (response->body.length == 0) {
-    assert(response->body.body == NULL);
-    http_response_set_header(response, "Content-Length", "0");
-  }
-  size_t size = measure_response_size(response);
-  if (buffer == NULL || *length < size) {
-    *length = size;
-    return buffer == NULL ? HTTP_ERROR_CODE_SUCCEED : HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE;
-  }
+// render status line and headers into buffer, which is assumed to be sufficient, return the end of rendered
+static void *render_head(const struct state_line *state_line, const struct headers *headers, void *buffer) {
   // state line
   copy_and_advance(&buffer, HTTP_VERSION, http_version_length);
   copy_and_advance(&buffer, " ", 1);
-  copy_and_advance(&buffer, get_representative_state_code(response->state_line.code), 3);
-  if (response->state_line.description_length != 0) {
+  copy_and_advance(&buffer, get_representative_state_code(state_line->code), 3);
+  if (state_line->description_length != 0) {
     copy_and_advance(&buffer, " ", 1);
-    copy_and_advance(&buffer, response->state_line.description, response->state_line.description_length);
+    copy_and_advance(&buffer, state_line->description, state_line->description_length);
   }
   copy_and_advance(&buffer, "\r\n", 2);
   // headers
-  for (struct header *target = response->headers.header_list; target != NULL; target = target->next) {
+  for (struct header *target = headers->header_list; target != NULL; target = target->next) {
     copy_and_advance(&buffer, target->key, strlen(target->key));
     copy_and_advance(&buffer, ": ", 2);
     copy_and_advance(&buffer, target->value, strlen(target->value));
@@ -522,8 +782,98 @@ int http_response_render(
   }
   // empty line
   copy_and_advance(&buffer, "\r\n", 2);
+  return buffer;
+}
+// generate Content-Length from the body
+static void update_content_length(struct http_response *response) {
+  // 204(No Content) and 304(Not Modified) never carry a body, so no Content-Length is generated for them
+  if (response->state_line.code == HTTP_RESPONSE_CODE_NO_CONTENT ||
+      response->state_line.code == HTTP_RESPONSE_CODE_NOT_MODIFIED) {
+    return;
+  }
+  // the length is not known in advance if the body is sent with a transfer coding
+  struct header **prev = NULL;
+  struct header *target = NULL;
+  lookup_header(&response->headers, "Transfer-Encoding", &target, &prev);
+  if (target != NULL) {
+    return;
+  }
+  char buffer[32]; // such size shall be overwhelmingly large
+  sprintf(buffer, "%zu", response->body.length);
+  http_response_set_header(response, "Content-Length", buffer);
+}
+
+int http_response_render_head(
+    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+) {
+  if (response->head_prerendered) {
+    *length = 0;
+    return HTTP_ERROR_CODE_SUCCEED;
+  }
+  update_content_length(response);
+  size_t size = measure_head_size(&response->state_line, &response->headers);
+  if (buffer == NULL || *length < size) {
+    *length = size;
+    return buffer == NULL ? HTTP_ERROR_CODE_SUCCEED : HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE;
+  }
+  render_head(&response->state_line, &response->headers, buffer);
+  *length = size;
+  PROBE2(response__rendered, get_representative_state_code(response->state_line.code), size);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_set_head_prerendered(struct http_response *_Nonnull response) {
+  response->head_prerendered = true;
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_render_interim(
+    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+) {
+  if (response->interim_headers == NULL) {
+    return HTTP_ERROR_CODE_NO_INTERIM_RESPONSE;
+  }
+  size_t size = measure_head_size(&response->interim_state_line, response->interim_headers);
+  if (buffer == NULL || *length < size) {
+    *length = size;
+    return buffer == NULL ? HTTP_ERROR_CODE_SUCCEED : HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE;
+  }
+  render_head(&response->interim_state_line, response->interim_headers, buffer);
+  *length = size;
+  clear_interim(response);
+  return HTTP_ERROR_CODE_SUCCEED;
+}
+
+int http_response_render(
+    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+) {
+  if (response->body.file_length != 0) {
+    return HTTP_ERROR_CODE_BODY_NOT_IN_MEMORY;
+  }
+  size_t size = response->body.length;
+  if (!response->head_prerendered) {
+    update_content_length(response);
+    size += measure_head_size(&response->state_line, &response->headers);
+  }
+  if (buffer == NULL || *length < size) {
+    *length = size;
+    return buffer == NULL ? HTTP_ERROR_CODE_SUCCEED : HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE;
+  }
+  if (!response->head_prerendered) {
+    buffer = render_head(&response->state_line, &response->headers, buffer);
+  }
   // body
-  copy_and_advance(&buffer, response->body.body, response->body.length);
+  for (size_t i = 0; i < response->body.count; i++) {
+    const struct body_part *part = &response->body.parts[i];
+    if (part->type == BODY_PART_REFERENCE) {
+      copy_and_advance(&buffer, (const void *)(uintptr_t)part->offset, part->length);
+    } else {
+      copy_and_advance(&buffer, response->body.pool.body + part->offset, part->length);
+    }
+  }
   *length = size;
   return HTTP_ERROR_CODE_SUCCEED;
 }
@@ -531,7 +881,14 @@ int http_response_render(
 int http_response_destroy(struct http_response *_Nonnull response) {
   free(response->state_line.description);
   destroy_headers(&response->headers);
-  destroy_body(&response->body);
+  clear_interim(response);
+  destroy_body_parts(&response->body);
+  while (response->release_hooks != NULL) {
+    struct release_hook *hook = response->release_hooks;
+    response->release_hooks = hook->next;
+    hook->release(hook->context);
+    free(hook);
+  }
   return http_response_initialize(response);
 }
 
@@ -552,6 +909,14 @@ const char *http_get_error_string(enum http_error_code error_code) {
     return "the attempt to add multiple headers with the same key is rejected";
   case HTTP_ERROR_CODE_NO_SUCH_HEADER:
     return "the requested key does not exist in headers";
+  case HTTP_ERROR_CODE_NO_BODY_FILE:
+    return "no file is attached to the response to supply the body";
+  case HTTP_ERROR_CODE_NO_SUCH_BODY_PART:
+    return "the requested part of body does not exist";
+  case HTTP_ERROR_CODE_BODY_NOT_IN_MEMORY:
+    return "the body contains parts in file which cannot be rendered into buffer";
+  case HTTP_ERROR_CODE_NO_INTERIM_RESPONSE:
+    return "no interim response is set to the response";
   case HTTP_ERROR_CODE_SUCCEED:
     return "not an error, the operation succeed";
   }
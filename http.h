@@ -22,6 +22,14 @@ enum http_error_code {
   HTTP_ERROR_CODE_DUPLICATE_HEADER_KEY,
   // the specified key does not exist in headers
   HTTP_ERROR_CODE_NO_SUCH_HEADER,
+  // attempting to add a range of file to body without a file attached
+  HTTP_ERROR_CODE_NO_BODY_FILE,
+  // the specified index of body part is out of range
+  HTTP_ERROR_CODE_NO_SUCH_BODY_PART,
+  // attempting to render a body with parts in file into buffer
+  HTTP_ERROR_CODE_BODY_NOT_IN_MEMORY,
+  // attempting to render an interim response while none is set
+  HTTP_ERROR_CODE_NO_INTERIM_RESPONSE,
   // indicates a successful call
   HTTP_ERROR_CODE_SUCCEED = 0
 };
@@ -65,6 +73,13 @@ int http_request_get_url(
     size_t *_Nonnull restrict length
 );
 
+// get HTTP version of the request, e.g. HTTP/1.1
+//  see also http_request_get_url
+int http_request_get_version(
+    const struct http_request *_Nonnull restrict request, char *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+);
+
 // get header content
 //  see also http_request_get_url
 int http_request_get_header(
@@ -92,15 +107,20 @@ int http_response_initialize(struct http_response *_Nonnull response);
 //  otherwise, use the supplied description directly while assuming it is null-terminated
 // NOTE: if you modified this enumerate here, update the corresponding mapping in http.c
 enum http_response_code {
+  HTTP_RESPONSE_CODE_EARLY_HINTS,                // 103
   HTTP_RESPONSE_CODE_OK,                         // 200
   HTTP_RESPONSE_CODE_NO_CONTENT,                 // 204
   HTTP_RESPONSE_CODE_PARTIAL_CONTENT,            // 206
   HTTP_RESPONSE_CODE_MOVE_MOVED_PERMANENTLY,     // 301
+  HTTP_RESPONSE_CODE_NOT_MODIFIED,               // 304
   HTTP_RESPONSE_CODE_BAD_REQUEST,                // 400
   HTTP_RESPONSE_CODE_FORBIDDEN,                  // 403
   HTTP_RESPONSE_CODE_NOT_FOUND,                  // 404
+  HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE,      // 416
+  HTTP_RESPONSE_CODE_TOO_EARLY,                  // 425
   HTTP_RESPONSE_CODE_INTERNAL_SERVER_ERROR,      // 500
   HTTP_RESPONSE_CODE_NOT_IMPLEMENTED,            // 501
+  HTTP_RESPONSE_CODE_SERVICE_UNAVAILABLE,        // 503
   HTTP_RESPONSE_CODE_HTTP_VERSION_NOT_SUPPORTED, // 505
   HTTP_RESPONSE_CODE_MAX                         // keep this line at the bottom
 };
@@ -108,33 +128,135 @@ int http_response_set_code(
     struct http_response *_Nonnull restrict response, enum http_response_code code,
     const char *_Nullable restrict description
 );
+// get response code
+enum http_response_code http_response_get_code(const struct http_response *_Nonnull response);
+// get the three digits of code, e.g. "200" for HTTP_RESPONSE_CODE_OK
+const char *_Nonnull http_response_code_get_digits(enum http_response_code code);
 
 // set response header
 //  both key and value is null-terminated
 //  if a header with the same key already exists, its value will be replaced
 //  User NOTE: there is no need to care about Content-Length since which will be automatically calculated add
-//   added to the response
+//   added to the response when rendered, except for responses that never carry a body (204 and 304) and
+//   those with Transfer-Encoding, whose body is sent by the caller after the head
 int http_response_set_header(
     struct http_response *_Nonnull restrict response, const char *_Nonnull restrict key,
     const char *_Nonnull restrict value
 );
 
+// set an interim response with code, which is sent ahead of the final response, e.g. 103(Early Hints)
+//  any interim response set previously is replaced, including its headers
+//  code shall be an informational (1xx) one
+int http_response_set_interim_code(struct http_response *_Nonnull response, enum http_response_code code);
+
+// set header of the interim response, see also http_response_set_header
+//  Content-Length is never generated for an interim response
+int http_response_set_interim_header(
+    struct http_response *_Nonnull restrict response, const char *_Nonnull restrict key,
+    const char *_Nonnull restrict value
+);
+
+// body of response is a sequence of parts, each of which is either a block of memory held by the response or
+//  a range of the file attached to the response, the latter of which is never read into memory by the
+//  response but streamed from the file by the sender
+
 // set body of response
 //  if NULL is passed to the nullable argument length, treat body as null-terminated
 //  otherwise, body may not be null-terminated, whose length shall be determined by the argument
-//  if body is already set, it will be replaced
+//  if body is already set, it will be replaced, including any file attached
 int http_response_set_body(
     struct http_response *_Nonnull restrict response, const void *_Nonnull restrict body,
     const size_t *_Nullable restrict length
 );
 
+// attach a file to the response, ranges of which can then be appended to the body
+//  the response takes over the file descriptor, which is closed when the response is destroyed
+//  if a file is already attached, it is closed and replaced
+int http_response_set_body_file(struct http_response *_Nonnull response, int file_descriptor);
+
+// attach a file to the response without taking it over, see also http_response_set_body_file
+//  the file descriptor shall be kept open until the response is destroyed, see http_response_add_release_hook
+int http_response_set_body_file_reference(struct http_response *_Nonnull response, int file_descriptor);
+
+// append a copy of content to the body
+int http_response_append_body(
+    struct http_response *_Nonnull restrict response, const void *_Nonnull restrict content, size_t length
+);
+
+// append a range of the attached file to the body, which is not read until sent
+int http_response_append_body_file(struct http_response *_Nonnull response, size_t offset, size_t length);
+
+// append content to the body without copying it
+//  the content shall be kept valid until the response is destroyed, see http_response_add_release_hook
+int http_response_append_body_reference(
+    struct http_response *_Nonnull restrict response, const void *_Nonnull restrict content, size_t length
+);
+
+// register a callback called with context when the response is destroyed, e.g. to release what is referenced
+//  by http_response_append_body_reference
+//  callbacks are called in the reversed order of registration
+int http_response_add_release_hook(
+    struct http_response *_Nonnull response, void (*_Nonnull release)(void *_Nullable context),
+    void *_Nullable context
+);
+
+// a part of the body as seen by the sender
+//  for a part in memory, content points to the data, which is valid until the response is modified
+//  for a part in file, content is NULL, and the data is at offset of file_descriptor
+struct http_body_part {
+  const void *_Nullable content;
+  int file_descriptor;
+  size_t offset;
+  size_t length;
+};
+// get number of parts in the body
+size_t http_response_get_body_part_count(const struct http_response *_Nonnull response);
+// get the part of body at index
+int http_response_get_body_part(
+    const struct http_response *_Nonnull restrict response, size_t index,
+    struct http_body_part *_Nonnull restrict part
+);
+
+// memory held by a response beyond its structure, which is reported for diagnostics
+struct http_response_memory {
+  size_t body_length;   // bytes of the body, including parts in file and those referenced
+  size_t pool_capacity; // bytes allocated for the pool holding parts of the body in memory
+  size_t pool_length;   // bytes of the pool in use
+  size_t overhead;      // bytes of headers, descriptions, the list of parts and release hooks
+};
+// get memory held by response
+void http_response_get_memory(
+    const struct http_response *_Nonnull restrict response,
+    struct http_response_memory *_Nonnull restrict memory
+);
+
 // render the structure to a buffer
 //  see also http_request_get_url
+//  this fails if any part of the body is in file, use http_response_render_head in that case
 int http_response_render(
     struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
     size_t *_Nonnull restrict length
 );
 
+// render status line and headers only, including the empty line ending them, to a buffer
+//  the body shall then be sent part by part, see also http_response_render
+int http_response_render_head(
+    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+);
+
+// mark the head of response as rendered elsewhere and supplied at the beginning of the body, e.g. a head
+//  rendered once and cached, which is appended with http_response_append_body_reference
+//  rendering the head then produces nothing, while the status and headers set are ignored
+int http_response_set_head_prerendered(struct http_response *_Nonnull response);
+
+// render the interim response to a buffer, see also http_response_render_head
+//  the interim response is cleared once rendered successfully, therefore it is sent at most once
+int http_response_render_interim(
+    struct http_response *_Nonnull restrict response, void *_Nullable restrict buffer,
+    size_t *_Nonnull restrict length
+);
+
 // cleanup HTTP response, see also http_request_destroy
 int http_response_destroy(struct http_response *_Nonnull response);
 
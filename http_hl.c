@@ -1,107 +1,377 @@
-#include <assert.h>
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <http_hl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-static struct range parse_single_range(const char *representation, size_t size) {
-  // no space is allowed here which simplifies the procedure
-  struct range range = {.start = 0, .end = 0};
+#include <strings.h>
+#include <time.h>
+// parse a non-empty sequence of digits, return NULL on error or overflow, or the first character after it
+static const char *parse_position(const char *representation, size_t *position) {
+  if (!isdigit(*representation)) {
+    return NULL;
+  }
+  size_t value = 0;
+  for (; isdigit(*representation); representation++) {
+    size_t digit = *representation - '0';
+    if (value > (SIZE_MAX - digit) / 10) {
+      return NULL;
+    }
+    value = value * 10 + digit;
+  }
+  *position = value;
+  return representation;
+}
+// parse a single range-spec, return NULL on syntax error, or the first character after it
+//  *satisfiable is set to false if the range does not overlap with the representation
+static const char *
+parse_single_range(const char *representation, size_t size, struct range *range, bool *satisfiable) {
+  *satisfiable = true;
   if (*representation == '-') {
     // suffix-range
-    range.start = size - strtoll(representation + 1, NULL, 10);
-    range.end = size;
-  } else {
-    // int-range
-    // get first-pos
-    char *mid = NULL;
-    range.start = strtoll(representation, &mid, 10);
-    assert(*mid == '-');
-    if (isdigit(mid[1])) {
-      // get last-pos
-      range.end = strtoll(mid + 1, NULL, 10) + 1;
-    } else {
-      // no end-pos
-      range.end = size;
+    size_t length;
+    representation = parse_position(representation + 1, &length);
+    if (representation == NULL) {
+      return NULL;
     }
+    if (length == 0 || size == 0) {
+      *satisfiable = false;
+    }
+    range->start = length < size ? size - length : 0;
+    range->end = size;
+    return representation;
   }
-  if (range.start >= range.end) {
-    range.start = 0;
-    range.end = 0;
+  // int-range
+  size_t first, last = SIZE_MAX;
+  representation = parse_position(representation, &first);
+  if (representation == NULL || *representation != '-') {
+    return NULL;
   }
-  return range;
-}
-static int compare_range(const void *lhs_, const void *rhs_) {
-  const struct range *lhs = lhs_;
-  const struct range *rhs = rhs_;
-  if (lhs->start != rhs->start) {
-    return lhs->start < rhs->start ? -1 : 1;
+  representation++;
+  if (isdigit(*representation)) {
+    representation = parse_position(representation, &last);
+    if (representation == NULL || last < first) {
+      return NULL;
+    }
   }
-  if (lhs->end != rhs->end) {
-    return lhs->end < rhs->end ? -1 : 1;
+  if (first >= size) {
+    *satisfiable = false;
   }
-  return 0;
+  range->start = first;
+  range->end = last >= size ? size : last + 1;
+  return representation;
 }
-struct range parse_range(const char *representation, size_t size) {
-  struct range range = {.start = 0, .end = 0};
+enum range_result parse_range(const char *representation, size_t size, struct range_set *set) {
+  set->count = 0;
   if (representation == NULL) {
-    return range;
+    return RANGE_RESULT_FULL;
   }
   // check the unit
   while (isspace(*representation)) {
     representation++;
   }
   if (strncmp(representation, "bytes=", 6) != 0) {
-    return range;
+    return RANGE_RESULT_FULL;
   }
   representation += 6;
-  // count number of ranges
-  size_t n_ranges = 1;
-  for (const char *target = representation; *target != '\0'; target++) {
-    if (*target == ',') {
-      n_ranges++;
+  size_t n_specifiers = 0;
+  while (true) {
+    // empty elements are allowed in a list
+    while (isspace(*representation) || *representation == ',') {
+      representation++;
+    }
+    if (*representation == '\0') {
+      break;
+    }
+    if (++n_specifiers > RANGE_SET_CAPACITY) {
+      set->count = 0;
+      return RANGE_RESULT_FULL;
+    }
+    struct range range;
+    bool satisfiable;
+    representation = parse_single_range(representation, size, &range, &satisfiable);
+    if (representation == NULL) {
+      set->count = 0;
+      return RANGE_RESULT_FULL;
     }
-  }
-  struct range *ranges = malloc(sizeof(struct range) * n_ranges);
-  for (size_t i = 0; i < n_ranges; i++) {
     while (isspace(*representation)) {
       representation++;
     }
-    ranges[i] = parse_single_range(representation, size);
-    do {
+    if (*representation != ',' && *representation != '\0') {
+      set->count = 0;
+      return RANGE_RESULT_FULL;
+    }
+    if (!satisfiable) {
+      continue;
+    }
+    // insert in order of start, which is cheap enough for such a small set
+    size_t i = set->count++;
+    for (; i > 0 && set->ranges[i - 1].start > range.start; i--) {
+      set->ranges[i] = set->ranges[i - 1];
+    }
+    set->ranges[i] = range;
+  }
+  if (n_specifiers == 0) {
+    return RANGE_RESULT_FULL;
+  }
+  if (set->count == 0) {
+    return RANGE_RESULT_UNSATISFIABLE;
+  }
+  // coalesce overlapping and close ranges
+  size_t n_coalesced = 1;
+  for (size_t i = 1; i < set->count; i++) {
+    struct range *last = &set->ranges[n_coalesced - 1];
+    if (set->ranges[i].start <= last->end + RANGE_COALESCE_GAP) {
+      if (set->ranges[i].end > last->end) {
+        last->end = set->ranges[i].end;
+      }
+    } else {
+      set->ranges[n_coalesced++] = set->ranges[i];
+    }
+  }
+  set->count = n_coalesced;
+  return RANGE_RESULT_PARTIAL;
+}
+
+void format_http_date(time_t time, char *buffer) {
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  strftime(buffer, HTTP_DATE_LENGTH, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+bool parse_http_date(const char *representation, time_t *time) {
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  const char *end = strptime(representation, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (end == NULL || *end != '\0') {
+    return false;
+  }
+  *time = timegm(&tm);
+  return true;
+}
+
+void format_entity_tag(char *buffer, uint64_t inode, uint64_t size, const struct timespec *modification) {
+  uint64_t nanoseconds = (uint64_t)modification->tv_sec * 1000000000 + modification->tv_nsec;
+  snprintf(
+      buffer, ENTITY_TAG_LENGTH, "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"", inode, size, nanoseconds
+  );
+}
+void format_content_entity_tag(char *buffer, const void *content, size_t length) {
+  // this is not a cryptographic hash, but a fast one processing 8 bytes a time is good enough to identify
+  //  versions of a file
+  const unsigned char *target = content;
+  uint64_t hash = 0xcbf29ce484222325ull ^ length;
+  for (; length >= 8; length -= 8, target += 8) {
+    uint64_t word;
+    memcpy(&word, target, 8);
+    hash = (hash ^ word) * 0x100000001b3ull;
+    hash ^= hash >> 31;
+  }
+  for (; length > 0; length--, target++) {
+    hash = (hash ^ *target) * 0x100000001b3ull;
+  }
+  hash ^= hash >> 29;
+  snprintf(buffer, ENTITY_TAG_LENGTH, "\"h%016" PRIx64 "\"", hash);
+}
+bool match_entity_tag(const char *list, const char *entity_tag, bool weak) {
+  if (strncmp(entity_tag, "W/", 2) == 0) {
+    if (!weak) {
+      return false;
+    }
+    entity_tag += 2;
+  }
+  size_t length = strlen(entity_tag);
+  while (*list != '\0') {
+    while (isspace(*list) || *list == ',') {
+      list++;
+    }
+    if (*list == '*') {
+      return true;
+    }
+    bool weak_candidate = strncmp(list, "W/", 2) == 0;
+    if (weak_candidate) {
+      list += 2;
+    }
+    if (*list != '"') {
+      // not a valid entity tag, ignore the whole list
+      return false;
+    }
+    const char *end = strchr(list + 1, '"');
+    if (end == NULL) {
+      return false;
+    }
+    end++;
+    if ((weak || !weak_candidate) && (size_t)(end - list) == length &&
+        memcmp(list, entity_tag, length) == 0) {
+      return true;
+    }
+    list = end;
+  }
+  return false;
+}
+
+const char *content_coding_name(enum content_coding coding) {
+  static const char *names[] = {"br", "zstd", "gzip"};
+  _Static_assert(sizeof(names) / sizeof(names[0]) == CONTENT_CODING_MAX, "unmapped content coding");
+  return names[coding];
+}
+// parse a qvalue, return the quality in thousandths, or 1000 if representation is not a valid qvalue
+static unsigned parse_quality(const char *representation, size_t length) {
+  if (length == 0 || (representation[0] != '0' && representation[0] != '1')) {
+    return 1000;
+  }
+  unsigned quality = (representation[0] - '0') * 1000;
+  if (length > 1 && representation[1] == '.') {
+    unsigned scale = 100;
+    for (size_t i = 2; i < length && i < 5 && isdigit(representation[i]); i++, scale /= 10) {
+      quality += (representation[i] - '0') * scale;
+    }
+  }
+  return quality > 1000 ? 1000 : quality;
+}
+int select_content_coding(const char *representation, unsigned available) {
+  if (representation == NULL) {
+    return -1;
+  }
+  // quality of each coding in thousandths, -1 if not mentioned
+  int quality[CONTENT_CODING_MAX];
+  int wildcard = -1;
+  for (size_t i = 0; i < CONTENT_CODING_MAX; i++) {
+    quality[i] = -1;
+  }
+  while (*representation != '\0') {
+    while (isspace(*representation) || *representation == ',') {
+      representation++;
+    }
+    const char *name = representation;
+    while (*representation != '\0' && *representation != ',' && *representation != ';' &&
+           !isspace(*representation)) {
       representation++;
-    } while (representation[-1] != ',' && representation[-1] != '\0');
-  }
-  struct range partial_result = ranges[0];
-  qsort(ranges, n_ranges, sizeof(ranges[0]), compare_range);
-  for (size_t i = 0; i < n_ranges; i++) {
-    // if a full range is found, it shall always be returned since it represents an error
-    if (ranges[i].start == 0 && ranges[i].end == 0) {
-      partial_result.start = 0;
-      partial_result.end = 0;
+    }
+    size_t name_length = representation - name;
+    if (name_length == 0) {
       break;
     }
-    if (i != 0) {
-      // detect overlapping ranges
-      //  due to the way we sort the ranges, we have
-      //    ranges[i].start >= ranges[i-1].start
-      //   and
-      //    ranges[i].end >= ranges[i-1].end
-      if (ranges[i].start < ranges[i - 1].end) {
-        partial_result.start = 0;
-        partial_result.end = 0;
+    unsigned value = 1000;
+    // parameters, of which only q is recognized
+    while (true) {
+      while (isspace(*representation)) {
+        representation++;
+      }
+      if (*representation != ';') {
         break;
       }
+      representation++;
+      while (isspace(*representation)) {
+        representation++;
+      }
+      const char *parameter = representation;
+      while (*representation != '\0' && *representation != ',' && *representation != ';' &&
+             !isspace(*representation)) {
+        representation++;
+      }
+      if (strncasecmp(parameter, "q=", 2) == 0) {
+        value = parse_quality(parameter + 2, representation - parameter - 2);
+      }
+    }
+    if (name_length == 1 && *name == '*') {
+      wildcard = value;
+    } else {
+      for (size_t i = 0; i < CONTENT_CODING_MAX; i++) {
+        const char *candidate = content_coding_name(i);
+        if (strlen(candidate) == name_length && strncasecmp(name, candidate, name_length) == 0) {
+          quality[i] = value;
+        }
+      }
+      // x-gzip is an alias of gzip
+      if (name_length == 6 && strncasecmp(name, "x-gzip", 6) == 0) {
+        quality[CONTENT_CODING_GZIP] = value;
+      }
+    }
+  }
+  int result = -1;
+  int best = 0;
+  for (size_t i = 0; i < CONTENT_CODING_MAX; i++) {
+    if ((available & (1u << i)) == 0) {
+      continue;
+    }
+    int value = quality[i] == -1 ? wildcard : quality[i];
+    if (value > best) {
+      best = value;
+      result = i;
+    }
+  }
+  return result;
+}
+
+// value of a hexadecimal digit, -1 if c is not one
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+bool normalize_path(char *target) {
+  if (*target != '/') {
+    return false;
+  }
+  target[strcspn(target, "?#")] = '\0';
+  // decoding never lengthens the string, so it is done in place
+  char *output = target;
+  for (const char *input = target; *input != '\0'; output++) {
+    if (*input != '%') {
+      *output = *input++;
+      continue;
+    }
+    int high = hex_value(input[1]);
+    int low = high == -1 ? -1 : hex_value(input[2]);
+    if (low == -1 || (high == 0 && low == 0)) {
+      return false;
+    }
+    *output = high << 4 | low;
+    input += 3;
+  }
+  *output = '\0';
+  // remove dot segments, the result is target[0, length) which never overtakes the segment being read
+  size_t length = 0;
+  bool directory = false;
+  const char *input = target;
+  while (*input == '/') {
+    const char *segment = input + 1;
+    size_t segment_length = strcspn(segment, "/");
+    input = segment + segment_length;
+    directory = true;
+    if (segment_length == 0 || (segment_length == 1 && segment[0] == '.')) {
+      continue;
+    }
+    if (segment_length == 2 && segment[0] == '.' && segment[1] == '.') {
+      // drop the last segment along with the slash before it, if there is one
+      while (length != 0 && target[--length] != '/') {
+      }
+      continue;
     }
-    // try to merge with current partial result
-    if (ranges[i].end == partial_result.start) {
-      partial_result.start = ranges[i].start;
-    } else if (ranges[i].start == partial_result.end) {
-      partial_result.end = ranges[i].end;
+    target[length++] = '/';
+    memmove(target + length, segment, segment_length);
+    length += segment_length;
+    directory = false;
+  }
+  if (directory || length == 0) {
+    target[length++] = '/';
+  }
+  target[length] = '\0';
+  return true;
+}
+size_t encode_path(const char *path, char *output) {
+  char *start = output;
+  for (const unsigned char *c = (const unsigned char *)path; *c != '\0'; c++) {
+    if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-' ||
+        *c == '.' || *c == '_' || *c == '~' || *c == '/') {
+      *output++ = *c;
+    } else {
+      output += sprintf(output, "%%%02X", *c);
     }
   }
-  range = partial_result;
-  free(ranges);
-  return range;
+  *output = '\0';
+  return output - start;
 }
\ No newline at end of file
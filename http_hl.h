@@ -1,18 +1,81 @@
 #ifndef HTTP_HL_H_
 #define HTTP_HL_H_
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 // representation of a range, treat start as inclusive while end as exclusive
-//  start == 0 and end == 0 represents a full range regardless the real size of underlying target
 struct range {
   size_t start;
   size_t end;
 };
-// parse the Range header in HTTP request, generating a structure range
-//  this will select the first continues range of the specifier
-//  if there are adjacent yet non-overleaping specifiers, they will be silently merged
-//  if overleaping specifiers exists, or other error(s) detected, a full range will be returned to effectively
-//   ignore the Range Request, allowing the server to respond with an 200(OK) without further adjustment
-//  such range is also returned if the representation is NULL
-struct range parse_range(const char *representation, size_t size);
+enum {
+  // maximum number of range specifiers honoured in a single Range header, a header with more specifiers is
+  //  ignored to prevent amplification by a large number of small ranges
+  RANGE_SET_CAPACITY = 16,
+  // ranges no more than this number of bytes apart are coalesced, since the overhead of an extra part in
+  //  multipart/byteranges is comparable to sending the gap
+  RANGE_COALESCE_GAP = 80,
+};
+// ranges selected by a Range header, sorted in ascending order and neither overlapping nor adjacent
+struct range_set {
+  size_t count;
+  struct range ranges[RANGE_SET_CAPACITY];
+};
+enum range_result {
+  RANGE_RESULT_FULL,          // the Range header is absent or ignored, respond with the full representation
+  RANGE_RESULT_PARTIAL,       // at least one range is satisfiable, respond with 206(Partial Content)
+  RANGE_RESULT_UNSATISFIABLE, // no range is satisfiable, respond with 416(Range Not Satisfiable)
+};
+// parse the Range header in HTTP request of a representation with size bytes into set
+//  the header is ignored if representation is NULL, the unit is not bytes, the syntax is invalid or there are
+//   more than RANGE_SET_CAPACITY specifiers
+//  unsatisfiable specifiers are dropped, and the rest are sorted and coalesced
+//  no memory is allocated during parsing
+enum range_result parse_range(const char *representation, size_t size, struct range_set *set);
+
+// length of buffer required to hold an HTTP-date, including the null-terminator
+enum { HTTP_DATE_LENGTH = 30 };
+// format time as an HTTP-date in IMF-fixdate, e.g. Sun, 06 Nov 1994 08:49:37 GMT
+void format_http_date(time_t time, char *buffer);
+// parse an HTTP-date, return false if the representation is not a valid IMF-fixdate
+//  the obsolete formats are not accepted, which makes the conditional header using them ignored
+bool parse_http_date(const char *representation, time_t *time);
+
+// length of buffer required to hold an entity tag generated below, including quotes and the null-terminator
+enum { ENTITY_TAG_LENGTH = 64 };
+// generate a strong entity tag from identity and state of a file
+void format_entity_tag(char *buffer, uint64_t inode, uint64_t size, const struct timespec *modification);
+// generate a strong entity tag from content of a file, which is stable among copies of the same content
+void format_content_entity_tag(char *buffer, const void *content, size_t length);
+// check if an entity tag matches one in list, which is the value of If-None-Match or If-Range
+//  "*" matches any entity tag
+//  with weak comparison, W/ prefix is ignored on both sides; with strong comparison, weak tags never match
+bool match_entity_tag(const char *list, const char *entity_tag, bool weak);
+
+// content codings supported, in the order of preference among equally acceptable ones
+enum content_coding {
+  CONTENT_CODING_BROTLI,
+  CONTENT_CODING_ZSTD,
+  CONTENT_CODING_GZIP,
+  CONTENT_CODING_MAX, // keep this line at the bottom
+};
+// get the name of a content coding as used in Accept-Encoding and Content-Encoding
+const char *content_coding_name(enum content_coding coding);
+// select the most acceptable content coding according to the value of Accept-Encoding among those available,
+//  which is a bit mask indexed by enum content_coding
+//  return -1 if none of them is acceptable, in which case the identity coding shall be used
+//  NULL representation accepts no coding
+int select_content_coding(const char *representation, unsigned available);
+
+// normalize the request target in place into a path: drop query and fragment, decode percent-encoded octets,
+//  then remove dot segments and empty segments, therefore the result is an absolute path never going above
+//  the root, which ends with '/' if the last segment of the target is a directory one (empty, "." or "..")
+//  this is done lexically, the filesystem is never consulted
+//  return false if the target is not an absolute path or contains an invalid or NUL percent-encoding
+bool normalize_path(char *target);
+// percent-encode a path back into output, which shall hold 3 * strlen(path) + 1 bytes, keeping '/' and
+//  unreserved characters as they are, so any path normalized above can be put into a header again
+//  return the length written, not counting the terminating NUL
+size_t encode_path(const char *path, char *output);
 #endif
\ No newline at end of file
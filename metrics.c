@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <metrics.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum {
+  // buckets per power of two, as a power of two itself
+  SubBucketBits = 2,
+  SubBuckets = 1 << SubBucketBits,
+  // values below 2^HistogramBits are bucketed, larger ones are only counted in +Inf
+  HistogramBits = 36,
+  HistogramBuckets = SubBuckets + (HistogramBits - SubBucketBits) * SubBuckets,
+};
+
+struct histogram {
+  uint64_t buckets[HistogramBuckets + 1]; // the last one counts values out of range
+  uint64_t sum;
+};
+// counters of a thread, which are written by that thread only
+struct shard {
+  uint64_t counters[METRICS_COUNTER_MAX];
+  uint64_t responses[HTTP_RESPONSE_CODE_MAX];
+  struct histogram histograms[METRICS_HISTOGRAM_MAX];
+  struct shard *next;
+};
+// shards of all threads ever recorded anything, which are kept after their threads exit
+struct registry {
+  pthread_mutex_t lock;
+  struct shard *shards;
+};
+
+static struct registry *get_registry(void) {
+  static struct registry registry = {PTHREAD_MUTEX_INITIALIZER, NULL};
+  return &registry;
+}
+static struct shard *get_shard(void) {
+  static _Thread_local struct shard *shard = NULL;
+  if (shard == NULL) {
+    shard = calloc(1, sizeof(struct shard));
+    struct registry *registry = get_registry();
+    pthread_mutex_lock(&registry->lock);
+    shard->next = registry->shards;
+    registry->shards = shard;
+    pthread_mutex_unlock(&registry->lock);
+  }
+  return shard;
+}
+// add value to a counter of the calling thread, which is read by other threads while exporting
+//  this is the only writer, therefore a relaxed load and store never lose an update
+static void bump(uint64_t *counter, uint64_t value) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+static uint64_t peek(const uint64_t *counter) { return __atomic_load_n(counter, __ATOMIC_RELAXED); }
+
+uint64_t metrics_get_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void metrics_add(enum metrics_counter counter, uint64_t value) {
+  bump(&get_shard()->counters[counter], value);
+}
+
+void metrics_count_response(enum http_response_code code) {
+  if (code >= 0 && code < HTTP_RESPONSE_CODE_MAX) {
+    bump(&get_shard()->responses[code], 1);
+  }
+}
+
+// get the bucket of value: values below SubBuckets have one each, the others are bucketed by their leading
+//  SubBucketBits + 1 bits
+static size_t get_bucket(uint64_t value) {
+  if (value < SubBuckets) {
+    return value;
+  }
+  size_t exponent = 63 - __builtin_clzll(value);
+  if (exponent >= HistogramBits) {
+    return HistogramBuckets;
+  }
+  return SubBuckets + (exponent - SubBucketBits) * SubBuckets +
+         ((value >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+}
+// get the largest value in bucket
+static uint64_t get_bucket_bound(size_t bucket) {
+  if (bucket < SubBuckets) {
+    return bucket;
+  }
+  size_t exponent = (bucket - SubBuckets) / SubBuckets + SubBucketBits;
+  uint64_t sub_bucket = (bucket - SubBuckets) % SubBuckets;
+  return ((SubBuckets + sub_bucket + 1) << (exponent - SubBucketBits)) - 1;
+}
+
+void metrics_observe(enum metrics_histogram histogram, uint64_t value) {
+  struct histogram *target = &get_shard()->histograms[histogram];
+  bump(&target->buckets[get_bucket(value)], 1);
+  bump(&target->sum, value);
+}
+
+void metrics_render(FILE *output) {
+  static const struct {
+    const char *name;
+    const char *help;
+  } counters[] = {
+      {"received_bytes_total", "Bytes of requests received."},
+      {"sent_bytes_total", "Bytes of responses sent."},
+      {"accepted_connections_total", "Connections accepted."},
+  };
+  static const struct {
+    const char *name;
+    const char *help;
+    double scale; // from the unit recorded to that exported
+  } histograms[] = {
+      {"http_request_duration_seconds", "Time from a request received to its response sent.", 1e-6},
+      {"event_loop_iteration_seconds", "Time handling events returned by a single epoll_wait.", 1e-9},
+      {"epoll_wait_events", "Number of events returned by a single epoll_wait.", 1},
+  };
+  _Static_assert(sizeof(counters) / sizeof(counters[0]) == METRICS_COUNTER_MAX, "unmapped counter");
+  _Static_assert(sizeof(histograms) / sizeof(histograms[0]) == METRICS_HISTOGRAM_MAX, "unmapped histogram");
+
+  // sum up shards, which are only ever prepended, therefore the list can be walked once its head is taken
+  struct shard total = {0};
+  struct registry *registry = get_registry();
+  pthread_mutex_lock(&registry->lock);
+  struct shard *shards = registry->shards;
+  pthread_mutex_unlock(&registry->lock);
+  for (const struct shard *shard = shards; shard != NULL; shard = shard->next) {
+    for (size_t i = 0; i < METRICS_COUNTER_MAX; i++) {
+      total.counters[i] += peek(&shard->counters[i]);
+    }
+    for (size_t i = 0; i < HTTP_RESPONSE_CODE_MAX; i++) {
+      total.responses[i] += peek(&shard->responses[i]);
+    }
+    for (size_t i = 0; i < METRICS_HISTOGRAM_MAX; i++) {
+      for (size_t j = 0; j <= HistogramBuckets; j++) {
+        total.histograms[i].buckets[j] += peek(&shard->histograms[i].buckets[j]);
+      }
+      total.histograms[i].sum += peek(&shard->histograms[i].sum);
+    }
+  }
+
+  fprintf(output, "# HELP http_responses_total Responses sent by status code.\n");
+  fprintf(output, "# TYPE http_responses_total counter\n");
+  for (size_t i = 0; i < HTTP_RESPONSE_CODE_MAX; i++) {
+    // interim responses are not counted
+    if (i != HTTP_RESPONSE_CODE_EARLY_HINTS) {
+      fprintf(
+          output, "http_responses_total{code=\"%s\"} %lu\n", http_response_code_get_digits(i),
+          total.responses[i]
+      );
+    }
+  }
+  for (size_t i = 0; i < METRICS_COUNTER_MAX; i++) {
+    fprintf(output, "# HELP %s %s\n", counters[i].name, counters[i].help);
+    fprintf(output, "# TYPE %s counter\n", counters[i].name);
+    fprintf(output, "%s %lu\n", counters[i].name, total.counters[i]);
+  }
+  for (size_t i = 0; i < METRICS_HISTOGRAM_MAX; i++) {
+    const char *name = histograms[i].name;
+    const struct histogram *histogram = &total.histograms[i];
+    fprintf(output, "# HELP %s %s\n", name, histograms[i].help);
+    fprintf(output, "# TYPE %s histogram\n", name);
+    // buckets of Prometheus are cumulative
+    uint64_t count = 0;
+    for (size_t j = 0; j < HistogramBuckets; j++) {
+      count += histogram->buckets[j];
+      fprintf(
+          output, "%s_bucket{le=\"%.9g\"} %lu\n", name, get_bucket_bound(j) * histograms[i].scale, count
+      );
+    }
+    count += histogram->buckets[HistogramBuckets];
+    fprintf(output, "%s_bucket{le=\"+Inf\"} %lu\n", name, count);
+    fprintf(output, "%s_sum %.9g\n", name, histogram->sum * histograms[i].scale);
+    fprintf(output, "%s_count %lu\n", name, count);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+#include <http.h>
+#include <stdint.h>
+#include <stdio.h>
+// counters and latency histograms of the server, which are exported in the text format of Prometheus
+//  every thread updates a shard of its own with plain stores, without atomic read-modify-write or locks,
+//   therefore recording costs about as much as incrementing a variable, while shards are only summed up when
+//   exported, which may see a shard a few updates behind
+//  histograms are log-linear, as HDR histograms are: each power of two is split into 4 buckets, which bounds
+//   the relative error of a bucket to 25% across the whole range
+
+// NOTE: if you modified these enumerates here, update the corresponding mappings in metrics.c
+enum metrics_counter {
+  METRICS_COUNTER_RECEIVED_BYTES,       // bytes of requests received
+  METRICS_COUNTER_SENT_BYTES,           // bytes of responses sent, including interim responses
+  METRICS_COUNTER_ACCEPTED_CONNECTIONS, // connections accepted, including those refused at once
+  METRICS_COUNTER_MAX                   // keep this line at the bottom
+};
+enum metrics_histogram {
+  METRICS_HISTOGRAM_REQUEST_DURATION, // microseconds from a request received to its response sent
+  METRICS_HISTOGRAM_LOOP_ITERATION,   // nanoseconds handling events returned by a single epoll_wait(2)
+  METRICS_HISTOGRAM_EPOLL_BATCH,      // number of events returned by a single epoll_wait(2)
+  METRICS_HISTOGRAM_MAX               // keep this line at the bottom
+};
+
+// get nanoseconds of the monotonic clock
+uint64_t metrics_get_time(void);
+
+// add value to counter of the calling thread
+void metrics_add(enum metrics_counter counter, uint64_t value);
+
+// count a response with code, which is sent as a whole
+void metrics_count_response(enum http_response_code code);
+
+// record value in histogram of the calling thread, in the unit of the histogram
+void metrics_observe(enum metrics_histogram histogram, uint64_t value);
+
+// write counters and histograms summed up over all threads to output
+void metrics_render(FILE *output);
+#endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#include <mime.h>
+#include <mime_table.h>
+
+const char *mime_type_lookup(const char *path) {
+  // locate the extension, which is the part after the last dot of the last component
+  const char *extension = NULL;
+  const char *end = path;
+  for (; *end != '\0'; end++) {
+    if (*end == '.') {
+      extension = end + 1;
+    } else if (*end == '/') {
+      extension = NULL;
+    }
+  }
+  struct mime_key key;
+  if (extension == NULL || !mime_pack_key(extension, end - extension, &key)) {
+    return MIME_DEFAULT_TYPE;
+  }
+  uint32_t displacement = mime_displacements[mime_hash(&key, 0) & (MIME_TABLE_BUCKETS - 1)];
+  const struct mime_slot *slot = &mime_slots[mime_hash(&key, displacement) & (MIME_TABLE_SLOTS - 1)];
+  // empty slots hold a zero key which never matches a packed extension
+  if (slot->key.low != key.low || slot->key.high != key.high) {
+    return MIME_DEFAULT_TYPE;
+  }
+  return slot->type;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef MIME_H_
+#define MIME_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// media type used when the extension of a file is not recognized
+#define MIME_DEFAULT_TYPE "application/octet-stream"
+
+// get the media type of a file from the extension in its path, which is used as the value of Content-Type
+//  the lookup is done on a perfect hash table generated from mime.types at compile time, therefore no string
+//   comparison is involved
+//  MIME_DEFAULT_TYPE is returned if the path has no extension or the extension is not recognized
+//  the returned string is statically allocated and is valid during the whole lifetime of the process
+const char *mime_type_lookup(const char *path);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the following is shared with tools/mime_table_generator.c, do not use directly
+
+// maximum length of an extension that can be represented as a key
+enum { MIME_EXTENSION_MAX_LENGTH = 16 };
+// an extension packed into two integers, zero padded, with ASCII letters folded into lower case
+struct mime_key {
+  uint64_t low;
+  uint64_t high;
+};
+// pack an extension of length characters into key, return false if the extension cannot be represented
+static inline bool mime_pack_key(const char *extension, size_t length, struct mime_key *key) {
+  if (length == 0 || length > MIME_EXTENSION_MAX_LENGTH) {
+    return false;
+  }
+  uint64_t words[2] = {0, 0};
+  for (size_t i = 0; i < length; i++) {
+    uint64_t c = (unsigned char)extension[i];
+    if (c >= 'A' && c <= 'Z') {
+      c |= 0x20;
+    }
+    words[i / 8] |= c << (i % 8 * 8);
+  }
+  key->low = words[0];
+  key->high = words[1];
+  return true;
+}
+// hash a key with seed, the same function is used both to select a bucket (with seed 0) and to place a key
+//  into slot (with the displacement of the bucket as seed)
+static inline uint64_t mime_hash(const struct mime_key *key, uint64_t seed) {
+  uint64_t hash = (key->low ^ seed) * 0x9e3779b97f4a7c15ull;
+  hash ^= hash >> 32;
+  hash += key->high;
+  hash *= 0xbf58476d1ce4e5b9ull;
+  hash ^= hash >> 29;
+  return hash;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <path_filter.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+  // bits per path and number of bits set for each path, which give a false positive rate of about 1%
+  FilterBitsPerPath = 10,
+  FilterHashes = 7,
+  // number of paths the filter is sized for at least
+  FilterMinimumCapacity = 1024,
+  // directories nested deeper than this are not walked, which guards against loops of symbolic links
+  FilterMaximumDepth = 32,
+  WatchEvents =
+      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR,
+};
+
+// a watched directory, multiple directories may share a watch descriptor if they are the same one
+struct watch {
+  int descriptor;
+  char *directory; // relative to the document root without trailing '/', empty for the root itself
+};
+// hashes of paths collected while walking the document root
+struct hash_list {
+  uint64_t *hashes;
+  size_t count;
+  size_t capability;
+};
+// a directory being walked, which are chained from the innermost one to detect loops
+struct ancestor {
+  dev_t device;
+  ino_t inode;
+  const struct ancestor *parent;
+};
+struct path_filter {
+  uint64_t *bits;
+  size_t n_bits; // a power of two
+  size_t capacity; // number of paths the filter is sized for
+  size_t count;
+  size_t removed; // number of paths removed since the filter is built, which are still in it
+  bool enabled;
+  int notification;
+  struct watch *watches;
+  size_t n_watches;
+  size_t watches_capability;
+};
+
+static struct path_filter *get_filter(void) {
+  static struct path_filter filter = {.notification = -1};
+  return &filter;
+}
+
+static void set_bits(struct path_filter *filter, uint64_t hash) {
+  // derive the hashes from two halves of a single one
+  uint64_t step = ((hash >> 32) | (hash << 32)) * 0x9e3779b97f4a7c15ull | 1;
+  for (size_t i = 0; i < FilterHashes; i++, hash += step) {
+    size_t bit = hash & (filter->n_bits - 1);
+    filter->bits[bit / 64] |= 1ull << (bit % 64);
+  }
+}
+static bool test_bits(const struct path_filter *filter, uint64_t hash) {
+  uint64_t step = ((hash >> 32) | (hash << 32)) * 0x9e3779b97f4a7c15ull | 1;
+  for (size_t i = 0; i < FilterHashes; i++, hash += step) {
+    size_t bit = hash & (filter->n_bits - 1);
+    if ((filter->bits[bit / 64] & (1ull << (bit % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void add_watch(struct path_filter *filter, int descriptor, const char *directory) {
+  if (filter->n_watches == filter->watches_capability) {
+    filter->watches_capability = filter->watches_capability == 0 ? 64 : filter->watches_capability * 2;
+    filter->watches = realloc(filter->watches, sizeof(struct watch) * filter->watches_capability);
+  }
+  filter->watches[filter->n_watches].descriptor = descriptor;
+  filter->watches[filter->n_watches].directory = strdup(directory);
+  filter->n_watches++;
+}
+// forget watches with descriptor, which is removed by the kernel
+static void drop_watch(struct path_filter *filter, int descriptor) {
+  for (size_t i = 0; i < filter->n_watches;) {
+    if (filter->watches[i].descriptor == descriptor) {
+      free(filter->watches[i].directory);
+      filter->watches[i] = filter->watches[--filter->n_watches];
+    } else {
+      i++;
+    }
+  }
+}
+static void add_hash(struct hash_list *list, uint64_t hash) {
+  if (list->count == list->capability) {
+    list->capability = list->capability == 0 ? 1024 : list->capability * 2;
+    list->hashes = realloc(list->hashes, sizeof(uint64_t) * list->capability);
+  }
+  list->hashes[list->count++] = hash;
+}
+
+// watch and walk the directory, adding hashes of paths under it to list
+//  return false if the directory cannot be watched for a reason other than it is gone
+static bool walk(const char *directory, size_t depth, const struct ancestor *parent, struct hash_list *list) {
+  struct path_filter *filter = get_filter();
+  if (depth > FilterMaximumDepth) {
+    return true;
+  }
+  int file_descriptor =
+      open_beneath(*directory == '\0' ? "." : directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (file_descriptor == -1) {
+    return true;
+  }
+  struct stat status;
+  fstat(file_descriptor, &status);
+  for (const struct ancestor *ancestor = parent; ancestor != NULL; ancestor = ancestor->parent) {
+    if (ancestor->device == status.st_dev && ancestor->inode == status.st_ino) {
+      close(file_descriptor);
+      return true;
+    }
+  }
+  struct ancestor self = {.device = status.st_dev, .inode = status.st_ino, .parent = parent};
+  // the watch is set up before reading, therefore a name created afterwards is notified
+  char link[32];
+  sprintf(link, "/proc/self/fd/%d", file_descriptor);
+  int descriptor = inotify_add_watch(filter->notification, link, WatchEvents);
+  if (descriptor == -1) {
+    logging_error("cannot watch directory /%s for the path filter: %s\n", directory, strerror(errno));
+    close(file_descriptor);
+    return false;
+  }
+  add_watch(filter, descriptor, directory);
+  DIR *handle = fdopendir(file_descriptor);
+  if (handle == NULL) {
+    close(file_descriptor);
+    return true;
+  }
+  bool result = true;
+  struct dirent *entry;
+  while (result && (entry = readdir(handle)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    char path[strlen(directory) + strlen(entry->d_name) + 2];
+    sprintf(path, *directory == '\0' ? "%s%s" : "%s/%s", directory, entry->d_name);
+    add_hash(list, hash_string(path));
+    bool is_directory = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+      struct stat status;
+      is_directory = fstatat(dirfd(handle), entry->d_name, &status, 0) == 0 && S_ISDIR(status.st_mode);
+    }
+    if (is_directory) {
+      result = walk(path, depth + 1, &self, list);
+    }
+  }
+  closedir(handle);
+  return result;
+}
+
+// disable the filter for good, which happens if it cannot be kept current
+static void disable(struct path_filter *filter) {
+  logging_warning("the path filter is disabled\n");
+  filter->enabled = false;
+  close(filter->notification);
+  filter->notification = -1;
+}
+// build the filter from scratch, dropping watches of the last build
+static bool build(struct path_filter *filter) {
+  for (size_t i = 0; i < filter->n_watches; i++) {
+    inotify_rm_watch(filter->notification, filter->watches[i].descriptor);
+    free(filter->watches[i].directory);
+  }
+  filter->n_watches = 0;
+  struct hash_list list = {NULL, 0, 0};
+  if (!walk("", 0, NULL, &list)) {
+    free(list.hashes);
+    return false;
+  }
+  // leave room for paths created until the next build
+  filter->capacity = list.count * 2 < FilterMinimumCapacity ? FilterMinimumCapacity : list.count * 2;
+  filter->n_bits = 64;
+  while (filter->n_bits < filter->capacity * FilterBitsPerPath) {
+    filter->n_bits <<= 1;
+  }
+  free(filter->bits);
+  filter->bits = calloc(filter->n_bits / 64, sizeof(uint64_t));
+  for (size_t i = 0; i < list.count; i++) {
+    set_bits(filter, list.hashes[i]);
+  }
+  filter->count = list.count;
+  filter->removed = 0;
+  free(list.hashes);
+  logging_debug("path filter is built with %zu paths in %zu bits\n", filter->count, filter->n_bits);
+  return true;
+}
+
+bool path_filter_initialize(void) {
+  struct path_filter *filter = get_filter();
+  filter->notification = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (filter->notification == -1) {
+    logging_error("cannot initialize inotify for the path filter: %s\n", strerror(errno));
+    return false;
+  }
+  if (!build(filter)) {
+    disable(filter);
+    return false;
+  }
+  filter->enabled = true;
+  return true;
+}
+
+int path_filter_get_notification_descriptor(void) { return get_filter()->notification; }
+
+void path_filter_handle_notification(void *context) {
+  (void)context;
+  struct path_filter *filter = get_filter();
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool rebuild = false;
+  while (filter->enabled) {
+    ssize_t size = read(filter->notification, buffer, sizeof(buffer));
+    if (size <= 0) {
+      break;
+    }
+    for (char *target = buffer; target < buffer + size;) {
+      const struct inotify_event *event = (const struct inotify_event *)target;
+      target += sizeof(struct inotify_event) + event->len;
+      // paths under a directory moved or removed are not known, nor are changes lost on overflow
+      if (event->mask & (IN_Q_OVERFLOW | IN_MOVE_SELF | IN_DELETE_SELF)) {
+        rebuild = true;
+      }
+      if (event->mask & IN_IGNORED) {
+        drop_watch(filter, event->wd);
+      }
+      if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+        filter->removed++;
+      }
+      if ((event->mask & (IN_CREATE | IN_MOVED_TO)) == 0 || rebuild) {
+        continue;
+      }
+      // the name appears under every path of the directory, while watches appended by walking are skipped
+      size_t n_watches = filter->n_watches;
+      for (size_t i = 0; i < n_watches; i++) {
+        if (filter->watches[i].descriptor != event->wd) {
+          continue;
+        }
+        const char *directory = filter->watches[i].directory;
+        char path[strlen(directory) + event->len + 2];
+        sprintf(path, *directory == '\0' ? "%s%s" : "%s/%s", directory, event->name);
+        set_bits(filter, hash_string(path));
+        filter->count++;
+        // a directory, or a symbolic link to one, brings everything under it
+        struct stat status;
+        if (fstatat(get_document_root(), path, &status, 0) == 0 && S_ISDIR(status.st_mode)) {
+          struct hash_list list = {NULL, 0, 0};
+          if (!walk(path, 0, NULL, &list)) {
+            free(list.hashes);
+            disable(filter);
+            return;
+          }
+          for (size_t j = 0; j < list.count; j++) {
+            set_bits(filter, list.hashes[j]);
+          }
+          filter->count += list.count;
+          free(list.hashes);
+        }
+      }
+    }
+  }
+  // rebuild once names removed make up half of the filter, or it is filled beyond its capacity
+  if (filter->enabled &&
+      (rebuild || filter->count > filter->capacity || filter->removed > filter->count / 2)) {
+    if (!build(filter)) {
+      disable(filter);
+    }
+  }
+}
+
+bool path_filter_may_contain(const char *path) {
+  const struct path_filter *filter = get_filter();
+  if (!filter->enabled || strcmp(path, ".") == 0) {
+    return true;
+  }
+  // a directory is added without trailing '/'
+  size_t length = strlen(path);
+  if (path[length - 1] == '/') {
+    char trimmed[length];
+    memcpy(trimmed, path, length - 1);
+    trimmed[length - 1] = '\0';
+    return test_bits(filter, hash_string(trimmed));
+  }
+  return test_bits(filter, hash_string(path));
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef PATH_FILTER_H_
+#define PATH_FILTER_H_
+#include <stdbool.h>
+// a bloom filter of every path under the document root, therefore a request for a path not in it is known to
+//  miss without touching the filesystem, which is what most requests of vulnerability scanners do
+//  the filter is built by walking the document root, and kept current through inotify(7) watches on every
+//   directory under it: names created are added as they appear, while names removed stay in the filter until
+//   it is rebuilt once they make up a large share of it, which only costs false positives meanwhile
+//  symbolic links are followed, since they are followed when files are opened as well
+
+// build the filter from the document root
+//  return false if the filter cannot be built or kept current, e.g. there are too many directories to watch,
+//   in which case every path is considered to exist
+bool path_filter_initialize(void);
+
+// get the file descriptor which becomes readable when the document root changes, -1 if the filter is disabled
+int path_filter_get_notification_descriptor(void);
+
+// update the filter with the changes notified, this shall be called when the descriptor above becomes
+//  readable, context is unused so this can be registered as an event handler
+void path_filter_handle_notification(void *context);
+
+// check if path, which is relative to the document root and normalized, may exist
+//  false is definite, while true may be a false positive
+bool path_filter_may_contain(const char *path);
+#endif
\ No newline at end of file
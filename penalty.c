@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <common.h>
+#include <netinet/in.h>
+#include <penalty.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+  PenaltySlots = 4096,
+  // misses are counted within a window of this many seconds
+  PenaltyWindow = 60,
+  // seconds for which a client is refused once penalized
+  PenaltyDuration = 600,
+};
+
+struct penalty_slot {
+  uint8_t key[16]; // the IPv4 address mapped into IPv6, or the /64 prefix of an IPv6 address
+  time_t window; // start of the current window, 0 if the slot is empty
+  size_t misses;
+  time_t until; // end of the penalty, 0 if not penalized
+};
+struct penalty {
+  size_t threshold;
+  struct penalty_slot *slots;
+};
+
+static struct penalty *get_penalty(void) {
+  static struct penalty penalty = {0, NULL};
+  return &penalty;
+}
+
+static time_t get_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  // never 0, which marks an empty slot
+  return now.tv_sec + 1;
+}
+// get the slot of the client at address, key is filled with the key of the client
+static struct penalty_slot *get_slot(const struct sockaddr_storage *address, uint8_t key[16]) {
+  memset(key, 0, 16);
+  if (address->ss_family == AF_INET) {
+    key[10] = key[11] = 0xff;
+    memcpy(key + 12, &((const struct sockaddr_in *)address)->sin_addr, 4);
+  } else if (address->ss_family == AF_INET6) {
+    // a client usually owns the whole /64 network
+    memcpy(key, &((const struct sockaddr_in6 *)address)->sin6_addr, 8);
+  } else {
+    return NULL;
+  }
+  // 64-bit FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < 16; i++) {
+    hash = (hash ^ key[i]) * 0x100000001b3ull;
+  }
+  return &get_penalty()->slots[hash % PenaltySlots];
+}
+
+void penalty_initialize(size_t threshold) {
+  struct penalty *penalty = get_penalty();
+  if (threshold == 0) {
+    return;
+  }
+  penalty->slots = calloc(PenaltySlots, sizeof(struct penalty_slot));
+  penalty->threshold = threshold;
+}
+
+void penalty_record_miss(const struct sockaddr_storage *address) {
+  struct penalty *penalty = get_penalty();
+  uint8_t key[16];
+  struct penalty_slot *slot = penalty->slots == NULL ? NULL : get_slot(address, key);
+  if (slot == NULL) {
+    return;
+  }
+  time_t now = get_now();
+  if (memcmp(slot->key, key, 16) != 0) {
+    // a client being penalized is not evicted
+    if (slot->until > now) {
+      return;
+    }
+    memcpy(slot->key, key, 16);
+    slot->window = 0;
+    slot->until = 0;
+  }
+  if (slot->window == 0 || now - slot->window >= PenaltyWindow) {
+    slot->window = now;
+    slot->misses = 0;
+  }
+  if (++slot->misses >= penalty->threshold && slot->until <= now) {
+    slot->until = now + PenaltyDuration;
+    const void *target = address->ss_family == AF_INET
+                             ? (const void *)&((const struct sockaddr_in *)address)->sin_addr
+                             : (const void *)&((const struct sockaddr_in6 *)address)->sin6_addr;
+    char buffer[INET6_ADDRSTRLEN];
+    inet_ntop(address->ss_family, target, buffer, sizeof(buffer));
+    logging_information("client %s is penalized after %zu misses\n", buffer, slot->misses);
+  }
+}
+
+bool penalty_is_penalized(const struct sockaddr_storage *address) {
+  uint8_t key[16];
+  struct penalty_slot *slot = get_penalty()->slots == NULL ? NULL : get_slot(address, key);
+  return slot != NULL && memcmp(slot->key, key, 16) == 0 && slot->until > get_now();
+}
\ No newline at end of file
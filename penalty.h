@@ -0,0 +1,20 @@
+#ifndef PENALTY_H_
+#define PENALTY_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+// clients missing too often, which are almost always vulnerability scanners probing for well-known paths, are
+//  refused for a while, therefore they cost an accept(2) instead of a TLS handshake and a request each
+//  misses are counted per IPv4 address or IPv6 /64 network in a fixed table, where a client may evict another
+//   one sharing its slot, which only lets the evicted one start over
+//  a miss is a request for a path which does not exist
+
+// set up the table, where a client missing threshold times within a window is penalized, 0 disables penalty
+void penalty_initialize(size_t threshold);
+
+// count a miss of the client at address
+void penalty_record_miss(const struct sockaddr_storage *address);
+
+// check if connections from the client at address shall be refused
+bool penalty_is_penalized(const struct sockaddr_storage *address);
+#endif
\ No newline at end of file
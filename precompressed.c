@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <fcntl.h>
+#include <precompressed.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+  // number of entries in the cache, which is direct-mapped by hash of path
+  VariantCacheSize = 1024,
+  // seconds after which siblings are probed again even if the file itself is not changed
+  VariantProbeInterval = 10,
+};
+struct variant_entry {
+  char *path; // NULL if the entry is empty
+  uint64_t hash;
+  // identity of the file when siblings are probed
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modification;
+  time_t probed;
+  unsigned available;
+};
+
+static struct variant_entry *get_variant_cache(void) {
+  static struct variant_entry cache[VariantCacheSize];
+  return cache;
+}
+static const char *get_extension(enum content_coding coding) {
+  static const char *extensions[] = {".br", ".zst", ".gz"};
+  _Static_assert(sizeof(extensions) / sizeof(extensions[0]) == CONTENT_CODING_MAX, "unmapped content coding");
+  return extensions[coding];
+}
+static time_t now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+  return time.tv_sec;
+}
+// build path of the sibling in coding into buffer, which shall have space for path and the longest extension
+static void sibling_path(char *buffer, const char *path, size_t length, enum content_coding coding) {
+  memcpy(buffer, path, length);
+  strcpy(buffer + length, get_extension(coding));
+}
+
+unsigned precompressed_get_variants(const char *path, const struct stat *status) {
+  uint64_t hash = hash_string(path);
+  struct variant_entry *entry = &get_variant_cache()[hash % VariantCacheSize];
+  time_t current = now();
+  if (entry->path != NULL && entry->hash == hash && entry->device == status->st_dev &&
+      entry->inode == status->st_ino && entry->size == status->st_size &&
+      entry->modification.tv_sec == status->st_mtim.tv_sec &&
+      entry->modification.tv_nsec == status->st_mtim.tv_nsec &&
+      current - entry->probed < VariantProbeInterval && strcmp(entry->path, path) == 0) {
+    return entry->available;
+  }
+  // probe the siblings
+  size_t length = strlen(path);
+  char buffer[length + 8];
+  unsigned available = 0;
+  for (int coding = 0; coding < CONTENT_CODING_MAX; coding++) {
+    sibling_path(buffer, path, length, coding);
+    struct stat sibling;
+    if (fstatat(get_document_root(), buffer, &sibling, 0) != 0 || !S_ISREG(sibling.st_mode)) {
+      continue;
+    }
+    if (sibling.st_mtim.tv_sec < status->st_mtim.tv_sec ||
+        (sibling.st_mtim.tv_sec == status->st_mtim.tv_sec &&
+         sibling.st_mtim.tv_nsec < status->st_mtim.tv_nsec)) {
+      continue;
+    }
+    available |= 1u << coding;
+  }
+  // replace whatever in the slot
+  if (entry->path == NULL || strcmp(entry->path, path) != 0) {
+    free(entry->path);
+    entry->path = strdup(path);
+  }
+  entry->hash = hash;
+  entry->device = status->st_dev;
+  entry->inode = status->st_ino;
+  entry->size = status->st_size;
+  entry->modification = status->st_mtim;
+  entry->probed = current;
+  entry->available = available;
+  return available;
+}
+
+struct file_cache_entry *precompressed_acquire(const char *path, enum content_coding coding) {
+  size_t length = strlen(path);
+  char buffer[length + 8];
+  sibling_path(buffer, path, length, coding);
+  // the sibling is resolved as the file itself is, never going out of the document root
+  struct file_cache_entry *file = file_cache_acquire(buffer, NULL);
+  if (file == NULL) {
+    struct variant_entry *entry = &get_variant_cache()[hash_string(path) % VariantCacheSize];
+    if (entry->path != NULL && strcmp(entry->path, path) == 0) {
+      free(entry->path);
+      entry->path = NULL;
+    }
+  }
+  return file;
+}
\ No newline at end of file
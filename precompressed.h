@@ -0,0 +1,21 @@
+#ifndef PRECOMPRESSED_H_
+#define PRECOMPRESSED_H_
+#include <file_cache.h>
+#include <http_hl.h>
+#include <sys/stat.h>
+// precompressed variants of a file are siblings named after it with an extension of the content coding, e.g.
+//  foo.js.br, foo.js.zst and foo.js.gz for foo.js
+//  a sibling older than the file itself is considered stale and never used
+
+// get the content codings in which fresh precompressed variants of the file at path, which is relative to the
+//  document root, are available, as a bit mask indexed by enum content_coding, where status is the result of
+//  stat(2) on the file
+//  the result is cached, siblings are probed again only if the file changes or the cached result expires
+unsigned precompressed_get_variants(const char *path, const struct stat *status);
+
+// get the precompressed variant of the file at path in coding from the file cache, so it is kept open along
+//  with its validators like any other file
+//  return NULL on failure, in which case the cached result for the file is dropped
+//  the returned reference shall be released with file_cache_release
+struct file_cache_entry *precompressed_acquire(const char *path, enum content_coding coding);
+#endif
\ No newline at end of file
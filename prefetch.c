@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <common.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <prefetch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct prefetch_waiter {
+  void (*wake)(void *context);
+  void *context;
+};
+// a range of a file being read on the pool
+struct prefetch {
+  // identity of the range, files are identified by device and inode since descriptors are not shared
+  dev_t device;
+  ino_t inode;
+  off_t offset;
+  size_t length;
+  struct prefetch *next;
+  struct prefetch_waiter *waiters;
+  size_t n_waiters;
+  size_t waiters_capability;
+  // accessed only by the worker while the job is running
+  int file_descriptor;
+  void *buffer;
+};
+struct prefetch_state {
+  struct worker_pool *pool;
+  // reads in flight, which are few since they are bounded by the capacity of the pool
+  struct prefetch *running;
+};
+
+static struct prefetch_state *get_state(void) {
+  static struct prefetch_state state;
+  return &state;
+}
+
+void prefetch_initialize(struct worker_pool *pool) { get_state()->pool = pool; }
+
+static void add_waiter(struct prefetch *prefetch, void (*wake)(void *context), void *context) {
+  if (wake == NULL) {
+    return;
+  }
+  if (prefetch->n_waiters == prefetch->waiters_capability) {
+    prefetch->waiters_capability = prefetch->waiters_capability == 0 ? 4 : prefetch->waiters_capability * 2;
+    prefetch->waiters =
+        realloc(prefetch->waiters, sizeof(struct prefetch_waiter) * prefetch->waiters_capability);
+  }
+  prefetch->waiters[prefetch->n_waiters].wake = wake;
+  prefetch->waiters[prefetch->n_waiters].context = context;
+  prefetch->n_waiters++;
+}
+
+// read the range into the page cache, this runs on a worker thread
+static void read_range(void *context) {
+  struct prefetch *prefetch = context;
+  size_t read_length = 0;
+  while (read_length < prefetch->length) {
+    ssize_t size = pread(
+        prefetch->file_descriptor, prefetch->buffer, prefetch->length - read_length,
+        prefetch->offset + read_length
+    );
+    if (size <= 0) {
+      // errors are left to the retried read, which reports them as usual
+      break;
+    }
+    read_length += size;
+  }
+}
+// wake waiters of a finished read, this runs on the event loop thread
+static void complete_range(void *context) {
+  struct prefetch *prefetch = context;
+  struct prefetch **target = &get_state()->running;
+  while (*target != prefetch) {
+    target = &(*target)->next;
+  }
+  *target = prefetch->next;
+  close(prefetch->file_descriptor);
+  free(prefetch->buffer);
+  // the read is no longer in flight, so waiters which find the content evicted again start another one
+  for (size_t i = 0; i < prefetch->n_waiters; i++) {
+    prefetch->waiters[i].wake(prefetch->waiters[i].context);
+  }
+  free(prefetch->waiters);
+  free(prefetch);
+}
+
+// start reading the range on the pool or join the read in flight, return false if neither can be done
+static bool start_prefetch(
+    int file_descriptor, size_t length, off_t offset, void (*wake)(void *context), void *context
+) {
+  struct prefetch_state *state = get_state();
+  struct stat status;
+  if (fstat(file_descriptor, &status) == -1) {
+    return false;
+  }
+  for (struct prefetch *prefetch = state->running; prefetch != NULL; prefetch = prefetch->next) {
+    if (prefetch->device == status.st_dev && prefetch->inode == status.st_ino && prefetch->offset == offset &&
+        prefetch->length == length) {
+      add_waiter(prefetch, wake, context);
+      return true;
+    }
+  }
+  struct prefetch *prefetch = calloc(1, sizeof(struct prefetch));
+  prefetch->device = status.st_dev;
+  prefetch->inode = status.st_ino;
+  prefetch->offset = offset;
+  prefetch->length = length;
+  // the descriptor of the caller may be closed while the read is in flight
+  prefetch->file_descriptor = fcntl(file_descriptor, F_DUPFD_CLOEXEC, 0);
+  prefetch->buffer = malloc(length == 0 ? 1 : length);
+  if (prefetch->file_descriptor == -1 ||
+      !worker_pool_submit(state->pool, read_range, complete_range, prefetch)) {
+    if (prefetch->file_descriptor != -1) {
+      close(prefetch->file_descriptor);
+    }
+    free(prefetch->buffer);
+    free(prefetch);
+    return false;
+  }
+  add_waiter(prefetch, wake, context);
+  prefetch->next = state->running;
+  state->running = prefetch;
+  return true;
+}
+
+ssize_t prefetch_read(
+    int file_descriptor, void *buffer, size_t length, off_t offset, void (*wake)(void *context), void *context
+) {
+  if (get_state()->pool == NULL) {
+    return pread(file_descriptor, buffer, length, offset);
+  }
+  struct iovec vector = {.iov_base = buffer, .iov_len = length};
+  ssize_t size = preadv2(file_descriptor, &vector, 1, offset, RWF_NOWAIT);
+  if (size != -1 || (errno != EAGAIN && errno != EOPNOTSUPP)) {
+    return size;
+  }
+  // the filesystem does not support RWF_NOWAIT, or the pool is full, in which case the read blocks
+  if (errno == EOPNOTSUPP || !start_prefetch(file_descriptor, length, offset, wake, context)) {
+    return pread(file_descriptor, buffer, length, offset);
+  }
+  errno = EAGAIN;
+  return -1;
+}
+
+// a range of a file advised to be read ahead
+struct advice {
+  int file_descriptor;
+  off_t offset;
+  size_t length;
+};
+// this runs on a worker thread
+static void advise_range(void *context) {
+  struct advice *advice = context;
+  posix_fadvise(advice->file_descriptor, advice->offset, advice->length, POSIX_FADV_WILLNEED);
+}
+static void complete_advice(void *context) {
+  struct advice *advice = context;
+  close(advice->file_descriptor);
+  free(advice);
+}
+void prefetch_advise(int file_descriptor, off_t offset, size_t length) {
+  struct prefetch_state *state = get_state();
+  if (state->pool == NULL) {
+    posix_fadvise(file_descriptor, offset, length, POSIX_FADV_WILLNEED);
+    return;
+  }
+  struct advice *advice = malloc(sizeof(struct advice));
+  advice->file_descriptor = fcntl(file_descriptor, F_DUPFD_CLOEXEC, 0);
+  advice->offset = offset;
+  advice->length = length;
+  if (advice->file_descriptor == -1 ||
+      !worker_pool_submit(state->pool, advise_range, complete_advice, advice)) {
+    if (advice->file_descriptor != -1) {
+      close(advice->file_descriptor);
+    }
+    free(advice);
+  }
+}
+
+void prefetch_cancel_wait(void *context) {
+  for (struct prefetch *prefetch = get_state()->running; prefetch != NULL; prefetch = prefetch->next) {
+    for (size_t i = 0; i < prefetch->n_waiters; i++) {
+      if (prefetch->waiters[i].context == context) {
+        prefetch->waiters[i] = prefetch->waiters[--prefetch->n_waiters];
+        return;
+      }
+    }
+  }
+}
\ No newline at end of file
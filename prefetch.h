@@ -0,0 +1,29 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+#include <stddef.h>
+#include <sys/types.h>
+#include <worker_pool.h>
+// reads of files which never block the event loop on the disk
+//  a read is first tried with RWF_NOWAIT, which only succeeds for content in the page cache, and content
+//   which is not there is read on a worker pool into the page cache, after which the read can be tried again
+//  concurrent reads of the same range of the same file share a single read on the pool
+
+// set up the pool on which cold content is read, NULL makes every read a plain blocking one
+void prefetch_initialize(struct worker_pool *pool);
+
+// read at most length bytes at offset of the file into buffer, with the same semantic as pread(2) except that
+//  -1 with errno set to EAGAIN is returned if the content is not in the page cache, in which case it is read
+//   on the pool and wake(context) is called once on the event loop thread when that is done
+//  wake may be NULL, in which case the content is still read into the page cache for later reads
+//  if the pool is at its capacity, the read blocks instead
+ssize_t prefetch_read(
+    int file_descriptor, void *buffer, size_t length, off_t offset, void (*wake)(void *context), void *context
+);
+// unregister the waiter identified by context, if it is still waiting
+void prefetch_cancel_wait(void *context);
+
+// advise the kernel to read length bytes at offset of the file into the page cache, which is done on the pool
+//  since readahead may block on the disk as well
+//  this is a hint, which is dropped if the pool is at its capacity
+void prefetch_advise(int file_descriptor, off_t offset, size_t length);
+#endif
\ No newline at end of file
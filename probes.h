@@ -0,0 +1,34 @@
+#ifndef PROBES_H_
+#define PROBES_H_
+// USDT (user-level statically defined tracing) probes of provider hss on hot paths, which tools such as
+//  bpftrace and perf attach to without restarting the server, e.g.
+//   bpftrace -e 'usdt:./server:hss:send__complete { @bytes[str(arg1)] = sum(arg2); }'
+//  a probe not attached is a single nop, and arguments are only evaluated into registers, therefore they
+//   shall be cheap and free of side effects
+//  probes compile to nothing if <sys/sdt.h> (systemtap-sdt-dev) is absent, in which case arguments are never
+//   evaluated at all
+//  connections are identified by their sequence number, and strings are passed as pointers valid only while
+//   the probe fires
+//
+//  connection__accept(id, file descriptor, is TLS)  connection__close(id)
+//  request__parsed(id, url)                          file__resolved(id, path, size)
+//  cache__hit(id, path)                              cache__miss(id, path)
+//  response__rendered(status, head length)           send__complete(id, status, bytes sent)
+//  handshake__start(id)                              handshake__end(id, result, is resumed)
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+#define PROBE1(name, a) DTRACE_PROBE1(hss, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(hss, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(hss, name, a, b, c)
+#else
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#endif
+#endif
\ No newline at end of file
@@ -1,29 +1,69 @@
 #define _GNU_SOURCE
+#include <access_log.h>
+#include <archive.h>
 #include <arpa/inet.h>
 #include <assert.h>
+#include <autoindex.h>
 #include <common.h>
+#include <compression.h>
+#include <configuration.h>
+#include <content_cache.h>
+#include <early_hints.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <file_cache.h>
 #include <http.h>
 #include <http_hl.h>
+#include <metrics.h>
 #include <netdb.h>
+#include <path_filter.h>
+#include <penalty.h>
+#include <probes.h>
+#include <precompressed.h>
+#include <prefetch.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
-#include <sys/mman.h>
 #include <sys/random.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <tcp_connection.h>
 #include <tls_connection.h>
 #include <unistd.h>
+#include <worker_pool.h>
 
 // constants
 enum {
   AuthorizationCodeLength = 32,
+  // size of chunks in which file content is read into buffer when it cannot be sent from file directly
+  FileChunkSize = 64 * 1024,
+  // parts of body in memory are copied after the head for a single send if the total is within this size
+  CoalesceLimit = 16 * 1024,
+  // maximum number of parts of body in memory gathered into a single vector send
+  SendVectorLimit = 8,
+  // number of threads compressing content on the fly
+  CompressionThreads = 2,
+  // threads reading files not in the page cache, and how many reads can be in flight
+  ReadThreads = 4,
+  ReadCapacity = 64,
+  // threads running TLS handshakes, and how many steps of handshake can be queued or running, beyond which
+  //  handshakes run on the event loop
+  HandshakeThreads = 2,
+  HandshakeCapacity = 256,
+  // number of directory listings cached
+  AutoindexCapacity = 256,
+  // content read ahead of clients streaming a file by consecutive ranges
+  ReadaheadWindow = 2 * 1024 * 1024,
+  // content already sent to such clients is dropped from the page cache if the file is at least this large
+  DropBehindSize = 256 * 1024 * 1024,
+  // milliseconds a connection being shut down waits for the peer before it is freed regardless
+  ClosingTimeout = 1000,
 #ifdef NDEBUG
   HTTPPort = 80,
   HTTPSPort = 443,
@@ -71,40 +111,43 @@ static const char *get_authorization_code() {
   return code;
 }
 
-static const char *current_working_directory(void) {
+// get the boundary delimiting parts of multipart/byteranges, which is generated randomly once
+static const char *get_multipart_boundary(void) {
   static bool initialize = true;
-  static char current_directory[1028];
+  static char boundary[33];
   if (initialize) {
-    if (getcwd(current_directory + 4, 1024) == NULL) {
-      logging_fatal("cannot get current working directory\n");
-      exit(EXIT_FAILURE);
-    }
-    *((uint32_t *)current_directory) = strlen(current_directory + 4);
-    // ensure this path ends with a '/' therefore avoid potential bypass to the filesystem tree restriction
-    //  when we are at
-    //   /foo/bar
-    //  while an attempt is made to access
-    //   /foo/bar[^/]+/*
-    if (current_directory[4 + *((uint32_t *)current_directory) - 1] != '/') {
-      current_directory[4 + *((uint32_t *)current_directory)] = '/';
-      current_directory[4 + *((uint32_t *)current_directory) + 1] = '\0';
-      *((uint32_t *)current_directory) += 1;
-    }
     initialize = false;
+    uint8_t buffer[16];
+    getrandom(buffer, sizeof(buffer), 0);
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+      sprintf(boundary + i * 2, "%02x", buffer[i]);
+    }
   }
-  return current_directory;
+  return boundary;
 }
 
 struct file_descriptor_information {
   enum file_descriptor_type {
     LISTEN_SOCKET, // socket that represent a listening point
     TCP_SOCKET,    // socket that represent a plain TCP connection
-    TLS_SOCKET     // yes, TLS is on TCP, but we use this term in contrast to plain TCP here
+    TLS_SOCKET,    // yes, TLS is on TCP, but we use this term in contrast to plain TCP here
+    EVENT_SOURCE   // file descriptor owned by another module, e.g. a worker pool, which notifies the loop
   } type;
   int file_descriptor;
   struct file_descriptor_information *next;
   struct file_descriptor_information **prev;
-  struct connection_information *connection;
+  // neighbours in the list of connections being shut down, which is ordered by deadline, and the deadline in
+  //  milliseconds of the monotonic clock
+  struct file_descriptor_information *closing_next;
+  struct file_descriptor_information **closing_prev;
+  uint64_t closing_deadline;
+  union {
+    struct connection_information *connection; // for TCP_SOCKET and TLS_SOCKET
+    struct {
+      void (*handler)(void *context);
+      void *context;
+    } event_source; // for EVENT_SOURCE
+  };
 };
 
 void initialize_connection_information(struct file_descriptor_information *information) {
@@ -120,11 +163,30 @@ void initialize_connection_information(struct file_descriptor_information *infor
   http_request_initialize(connection->request);
   connection->response = malloc(http_response_size);
   http_response_initialize(connection->response);
+  connection->body_part = 0;
+  connection->body_offset = 0;
+  connection->stream = NULL;
+  connection->stream_block = 0;
+  connection->listing = NULL;
+  memset(&connection->pattern, 0, sizeof(connection->pattern));
+  connection->early_data = false;
+  connection->resumed = false;
+  memset(&connection->timing, 0, sizeof(connection->timing));
+  static uint64_t sequence = 0;
+  connection->id = ++sequence;
+  connection->established = connection->active = metrics_get_time();
+  connection->received_bytes = 0;
+  connection->sent_bytes = 0;
+  connection->send_file = NULL;
+  connection->send_vector = NULL;
+  connection->flush = NULL;
+  connection->shutdown = NULL;
   connection->underlying = NULL;
 
   // get remote address and save into context
   socklen_t length = sizeof(connection->address);
   getpeername(connection->file_descriptor, (struct sockaddr *)&connection->address, &length);
+  cache_address(connection);
 
   // initialize underlying structure
   if (information->type == TCP_SOCKET) {
@@ -132,7 +194,7 @@ void initialize_connection_information(struct file_descriptor_information *infor
     logging_trace("TCP connection established with %s:%hu\n", get_address(connection), get_port(connection));
   } else {
     assert(information->type == TLS_SOCKET);
-    tls_initialize_underlying(connection);
+    tls_initialize_underlying(connection, information);
     logging_trace("TLS connection initialized with %s:%hu\n", get_address(connection), get_port(connection));
   }
 
@@ -140,6 +202,7 @@ void initialize_connection_information(struct file_descriptor_information *infor
 }
 void destroy_connection_information(struct connection_information *information) {
   free(information->buffer.buffer);
+  free(information->timing.url);
   http_request_destroy(information->request);
   http_response_destroy(information->response);
   free(information->request);
@@ -148,6 +211,20 @@ void destroy_connection_information(struct connection_information *information)
   information->destroy_underlying(information);
 }
 
+// connections being shut down, ordered by deadline, along with a timer expiring at the earliest deadline
+struct closing_list {
+  struct file_descriptor_information *head;
+  struct file_descriptor_information **tail;
+  int timer;
+};
+static struct closing_list *get_closing_list(void) {
+  static struct closing_list list = {NULL, &list.head, -1};
+  return &list;
+}
+static int *get_epoll_file_descriptor(void) {
+  static int epoll_file_descriptor = -1;
+  return &epoll_file_descriptor;
+}
 struct file_descriptor_information **get_file_descriptor_list(void) {
   static struct file_descriptor_information *head = NULL;
   return &head;
@@ -155,30 +232,141 @@ struct file_descriptor_information **get_file_descriptor_list(void) {
 struct file_descriptor_information *
 register_file_descriptor(int file_descriptor, enum file_descriptor_type type) {
   size_t allocate_size = sizeof(struct file_descriptor_information);
-  if (type != LISTEN_SOCKET) {
+  if (type == TCP_SOCKET || type == TLS_SOCKET) {
     allocate_size += sizeof(struct connection_information);
   }
   struct file_descriptor_information *information = malloc(allocate_size);
   information->file_descriptor = file_descriptor;
   information->type = type;
-  if (type != LISTEN_SOCKET) {
+  if (type == TCP_SOCKET || type == TLS_SOCKET) {
     initialize_connection_information(information);
   }
   struct file_descriptor_information **head = get_file_descriptor_list();
   information->next = *head;
   information->prev = head;
+  if (*head != NULL) {
+    (*head)->prev = &information->next;
+  }
   *head = information;
   return information;
 }
 void destroy_file_information(struct file_descriptor_information *information) {
-  close(information->file_descriptor);
+  // the owner of an event source closes it, as does the underlying of a connection taking over its socket
+  bool owned = information->type != EVENT_SOURCE;
   *information->prev = information->next;
-  if (information->type != LISTEN_SOCKET) {
+  if (information->next != NULL) {
+    information->next->prev = information->prev;
+  }
+  if (information->type == TCP_SOCKET || information->type == TLS_SOCKET) {
+    PROBE1(connection__close, information->connection->id);
+    if (information->connection->stream != NULL) {
+      compression_cancel_wait(information->connection->stream, information);
+      compression_release(information->connection->stream);
+    }
+    if (information->connection->listing != NULL) {
+      autoindex_cancel_wait(information->connection->listing, information);
+      autoindex_release(information->connection->listing);
+    }
+    if (information->connection->state == ConnectionStatusWaitingContent) {
+      prefetch_cancel_wait(information);
+    }
+    if (information->connection->state == ConnectionStatusClosing) {
+      *information->closing_prev = information->closing_next;
+      if (information->closing_next != NULL) {
+        information->closing_next->closing_prev = information->closing_prev;
+      } else {
+        get_closing_list()->tail = information->closing_prev;
+      }
+    }
     destroy_connection_information(information->connection);
+    if (information->connection->file_descriptor == -1) {
+      // events of the socket shall no longer reach this structure, which is freed
+      epoll_ctl(*get_epoll_file_descriptor(), EPOLL_CTL_DEL, information->file_descriptor, NULL);
+      owned = false;
+    }
     free(information->connection);
   }
+  if (owned) {
+    close(information->file_descriptor);
+  }
   free(information);
 }
+// get milliseconds of the monotonic clock
+static uint64_t get_monotonic_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+// arm the timer of closing connections for the earliest deadline, or disarm it if there is none
+static void arm_closing_timer(void) {
+  struct closing_list *list = get_closing_list();
+  struct itimerspec expiration = {{0, 0}, {0, 0}};
+  if (list->head != NULL) {
+    uint64_t deadline = list->head->closing_deadline;
+    expiration.it_value.tv_sec = deadline / 1000;
+    expiration.it_value.tv_nsec = deadline % 1000 * 1000000;
+  }
+  timerfd_settime(list->timer, TFD_TIMER_ABSTIME, &expiration, NULL);
+}
+// shut the connection down gracefully, which is freed once done, or when ClosingTimeout passes if the peer
+//  does not answer, while it stays registered meanwhile
+//  this shall be called again on events of the connection until it is freed
+void close_connection(struct file_descriptor_information *information) {
+  struct connection_information *connection = information->connection;
+  struct closing_list *list = get_closing_list();
+  if (connection->state != ConnectionStatusClosing) {
+    if (connection->shutdown == NULL || list->timer == -1) {
+      destroy_file_information(information);
+      return;
+    }
+    // nothing else resumes the connection from now on
+    if (connection->stream != NULL) {
+      compression_cancel_wait(connection->stream, information);
+      compression_release(connection->stream);
+      connection->stream = NULL;
+    }
+    if (connection->listing != NULL) {
+      autoindex_cancel_wait(connection->listing, information);
+      autoindex_release(connection->listing);
+      connection->listing = NULL;
+    }
+    if (connection->state == ConnectionStatusWaitingContent) {
+      prefetch_cancel_wait(information);
+    }
+    connection->state = ConnectionStatusClosing;
+    // the timeout is the same for all, therefore appending keeps the list ordered
+    information->closing_deadline = get_monotonic_time() + ClosingTimeout;
+    information->closing_next = NULL;
+    information->closing_prev = list->tail;
+    *list->tail = information;
+    list->tail = &information->closing_next;
+    if (list->head == information) {
+      arm_closing_timer();
+    }
+  }
+  if (connection->shutdown(connection) == 0 || errno != EAGAIN) {
+    destroy_file_information(information);
+  }
+}
+// free connections whose deadlines of shutdown passed, context is unused so this can be registered as an
+//  event handler
+void expire_closing_connections(void *context) {
+  (void)context;
+  struct closing_list *list = get_closing_list();
+  uint64_t expirations;
+  if (read(list->timer, &expirations, sizeof(expirations)) == -1) {
+    return;
+  }
+  uint64_t now = get_monotonic_time();
+  while (list->head != NULL && list->head->closing_deadline <= now) {
+    logging_debug(
+        "%s:%hu did not answer shutdown in time\n", get_address(list->head->connection),
+        get_port(list->head->connection)
+    );
+    destroy_file_information(list->head);
+  }
+  arm_closing_timer();
+}
 void close_all_file_descriptors(void) {
   while (true) {
     struct file_descriptor_information **head = get_file_descriptor_list();
@@ -189,6 +377,32 @@ void close_all_file_descriptors(void) {
   }
 }
 
+// watch a file descriptor owned by another module, handler(context) is called when it becomes readable
+void register_event_source(
+    int epoll_file_descriptor, int file_descriptor, void (*handler)(void *context), void *context
+) {
+  struct file_descriptor_information *information = register_file_descriptor(file_descriptor, EVENT_SOURCE);
+  information->event_source.handler = handler;
+  information->event_source.context = context;
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = information};
+  epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, file_descriptor, &event);
+}
+
+// event handler of a worker pool, which calls completion of finished jobs
+void dispatch_worker_pool(void *pool) { worker_pool_dispatch(pool); }
+
+// stop the event loop on a termination signal received from the signal file descriptor, which is the
+//  context, therefore main tears down connections and joins worker pools before returning, after which
+//  records and messages still buffered are written by handlers of atexit(3)
+void handle_termination(void *context) {
+  struct signalfd_siginfo information;
+  if (read((int)(intptr_t)context, &information, sizeof(information)) != sizeof(information)) {
+    return;
+  }
+  logging_information("terminating on signal %u\n", information.ssi_signo);
+  *get_running() = false;
+}
+
 void listen_address(int epoll_file_descriptor, const struct addrinfo *address) {
   // get description of the address we are trying to listed to
   char address_buffer[INET6_ADDRSTRLEN];
@@ -226,10 +440,17 @@ void listen_address(int epoll_file_descriptor, const struct addrinfo *address) {
   epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, socket_file_descriptor, &event);
 }
 void accept_connection(int epoll_file_descriptor, int listen_file_descriptor) {
-  int connection_socket = accept(listen_file_descriptor, NULL, NULL);
+  struct sockaddr_storage peer;
+  socklen_t peer_length = sizeof(peer);
+  int connection_socket = accept(listen_file_descriptor, (struct sockaddr *)&peer, &peer_length);
   if (connection_socket == -1) {
     return;
   }
+  metrics_add(METRICS_COUNTER_ACCEPTED_CONNECTIONS, 1);
+  if (penalty_is_penalized(&peer)) {
+    close(connection_socket);
+    return;
+  }
   // set the socket as non-blocking
   int flags = fcntl(connection_socket, F_GETFL);
   flags |= O_NONBLOCK;
@@ -253,6 +474,7 @@ void accept_connection(int epoll_file_descriptor, int listen_file_descriptor) {
   }
   enum file_descriptor_type type = port == HTTPPort ? TCP_SOCKET : TLS_SOCKET;
   struct file_descriptor_information *information = register_file_descriptor(connection_socket, type);
+  PROBE3(connection__accept, information->connection->id, connection_socket, type == TLS_SOCKET);
   struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = information};
   epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, connection_socket, &event);
 }
@@ -271,17 +493,383 @@ void generate_forbidden(struct connection_information *information) {
 }
 void generate_not_found(struct connection_information *information) {
   http_response_set_code(information->response, HTTP_RESPONSE_CODE_NOT_FOUND, NULL);
+  penalty_record_miss(&information->address);
+}
+// respond a 404(Not Found) whose head is rendered once, for paths rejected by the path filter in bulk
+void set_rejected(struct connection_information *information) {
+  static char *head = NULL;
+  static size_t head_length = 0;
+  if (head == NULL) {
+    struct http_response *response = malloc(http_response_size);
+    http_response_initialize(response);
+    http_response_set_code(response, HTTP_RESPONSE_CODE_NOT_FOUND, NULL);
+    http_response_set_header(response, "Server", SERVER_NAME);
+    http_response_render_head(response, NULL, &head_length);
+    head = malloc(head_length);
+    http_response_render_head(response, head, &head_length);
+    http_response_destroy(response);
+    free(response);
+  }
+  http_response_set_code(information->response, HTTP_RESPONSE_CODE_NOT_FOUND, NULL);
+  http_response_set_head_prerendered(information->response);
+  http_response_append_body_reference(information->response, head, head_length);
+  penalty_record_miss(&information->address);
+}
+// evaluate If-None-Match and If-Modified-Since against validators of the selected representation
+//  return true if the request shall be responded with a 304(Not Modified)
+bool is_not_modified(struct http_request *request, const char *entity_tag, time_t last_modified) {
+  // If-Modified-Since is ignored if If-None-Match presents
+  char *value = get_request_header(request, "If-None-Match");
+  if (value != NULL) {
+    bool result = match_entity_tag(value, entity_tag, true);
+    free(value);
+    return result;
+  }
+  value = get_request_header(request, "If-Modified-Since");
+  if (value != NULL) {
+    time_t since;
+    bool result = parse_http_date(value, &since) && last_modified <= since;
+    free(value);
+    return result;
+  }
+  return false;
+}
+// evaluate If-Range against validators of the selected representation
+//  return true if the Range header shall be honoured, which is also the case when If-Range is absent
+bool is_range_applicable(struct http_request *request, const char *entity_tag, time_t last_modified) {
+  char *value = get_request_header(request, "If-Range");
+  if (value == NULL) {
+    return true;
+  }
+  bool result = false;
+  time_t date;
+  if (*value == '"' || strncmp(value, "W/", 2) == 0) {
+    result = match_entity_tag(value, entity_tag, false);
+  } else if (parse_http_date(value, &date)) {
+    result = date == last_modified;
+  }
+  free(value);
+  return result;
+}
+// check if the request carries a header, regardless of its value
+bool has_request_header(struct http_request *request, const char *name) {
+  size_t length;
+  return http_request_get_header(request, name, NULL, &length) == HTTP_ERROR_CODE_SUCCEED;
+}
+// check if the request is made with HTTP/1.1, the only version supporting chunked transfer coding here
+bool is_http_1_1(struct http_request *request) {
+  char version[16];
+  size_t length = sizeof(version);
+  return http_request_get_version(request, version, &length) == HTTP_ERROR_CODE_SUCCEED &&
+         strcmp(version, "HTTP/1.1") == 0;
+}
+// fill body of response with ranges of content as multipart/byteranges, or of the attached file if content is
+//  NULL
+void set_multipart_body(
+    struct http_response *response, const char *content, const struct range_set *ranges, size_t size,
+    const char *content_type
+) {
+  const char *boundary = get_multipart_boundary();
+  char buffer[strlen(boundary) + strlen(content_type) + 128];
+  for (size_t i = 0; i < ranges->count; i++) {
+    const struct range *range = &ranges->ranges[i];
+    int length = sprintf(
+        buffer, "%s--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+        i == 0 ? "" : "\r\n", boundary, content_type, range->start, range->end - 1, size
+    );
+    http_response_append_body(response, buffer, length);
+    if (content != NULL) {
+      http_response_append_body_reference(response, content + range->start, range->end - range->start);
+    } else {
+      http_response_append_body_file(response, range->start, range->end - range->start);
+    }
+  }
+  int length = sprintf(buffer, "\r\n--%s--\r\n", boundary);
+  http_response_append_body(response, buffer, length);
+  sprintf(buffer, "multipart/byteranges; boundary=%s", boundary);
+  http_response_set_header(response, "Content-Type", buffer);
+}
+// record the range of the file with status requested on connection, ranges is NULL for the full content
+//  a client requesting a single range which starts where its last range of the same file ended is considered
+//   to be streaming the file, for which content is read ahead while the response is sent
+void track_access(
+    struct connection_information *connection, const struct stat *status, const struct range_set *ranges
+) {
+  struct access_pattern *pattern = &connection->pattern;
+  if (pattern->device != status->st_dev || pattern->inode != status->st_ino ||
+      pattern->size != status->st_size) {
+    pattern->device = status->st_dev;
+    pattern->inode = status->st_ino;
+    pattern->size = status->st_size;
+    pattern->next = -1;
+    pattern->advised = 0;
+    pattern->dropped = 0;
+  }
+  if (ranges == NULL || ranges->count != 1) {
+    pattern->next = -1;
+    return;
+  }
+  off_t start = ranges->ranges[0].start;
+  pattern->sequential = start == pattern->next;
+  if (!pattern->sequential || pattern->advised < start) {
+    pattern->advised = start;
+  }
+  if (!pattern->sequential) {
+    pattern->dropped = start;
+  }
+  pattern->next = ranges->ranges[0].end;
+}
+// replace the response with the cached head and body, which are referenced until the response is destroyed
+void set_cached_content(struct http_response *response, struct content_cache_entry *content) {
+  const void *head;
+  const void *body;
+  size_t head_length;
+  size_t body_length;
+  content_cache_get_head(content, &head, &head_length);
+  content_cache_get_body(content, &body, &body_length);
+  http_response_destroy(response);
+  http_response_set_code(response, HTTP_RESPONSE_CODE_OK, NULL);
+  http_response_set_head_prerendered(response);
+  http_response_append_body_reference(response, head, head_length);
+  http_response_append_body_reference(response, body, body_length);
+  http_response_add_release_hook(response, content_cache_release, content);
+}
+// get the path of the index file of the directory at path, NULL if directories have no index file
+//  the returned string shall be freed
+char *get_index_path(const char *path) {
+  const char *index_file = get_configuration()->index_file;
+  if (index_file == NULL) {
+    return NULL;
+  }
+  if (strcmp(path, ".") == 0) {
+    return strdup(index_file);
+  }
+  char *index_path = malloc(strlen(path) + strlen(index_file) + 1);
+  sprintf(index_path, "%s%s", path, index_file);
+  return index_path;
+}
+// respond with the listing, whose reference is taken over by the response
+void set_listing(struct connection_information *connection, struct autoindex_entry *listing) {
+  if (autoindex_get_state(listing) == AUTOINDEX_STATE_FAILED) {
+    autoindex_release(listing);
+    generate_not_found(connection);
+    return;
+  }
+  http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+  http_response_set_header(connection->response, "Content-Type", "text/html; charset=utf-8");
+  // blocks are sent in place one after another, which are kept until the response is destroyed
+  for (size_t i = 0; i < autoindex_get_block_count(listing); i++) {
+    const void *content;
+    size_t length;
+    autoindex_get_block(listing, i, &content, &length);
+    http_response_append_body_reference(connection->response, content, length);
+  }
+  http_response_add_release_hook(connection->response, autoindex_release, listing);
+}
+void resume_listing(void *context);
+// respond with the listing of the directory at path, whose url ends with '/'
+//  a listing being rendered off the event loop is waited for, and the response is generated once it is done
+void serve_listing(struct file_descriptor_information *information, const char *path, const char *url) {
+  struct connection_information *connection = information->connection;
+  struct autoindex_entry *listing = autoindex_acquire(path, url);
+  if (listing == NULL && errno == EAGAIN) {
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_SERVICE_UNAVAILABLE, NULL);
+    http_response_set_header(connection->response, "Retry-After", "1");
+    return;
+  }
+  if (listing == NULL) {
+    generate_not_found(connection);
+    return;
+  }
+  if (autoindex_get_state(listing) == AUTOINDEX_STATE_RUNNING) {
+    connection->listing = listing;
+    connection->timing.waited = metrics_get_time();
+    autoindex_wait(listing, resume_listing, information);
+    connection->state = ConnectionStatusWaitingContent;
+    return;
+  }
+  set_listing(connection, listing);
+}
+// respond with the file at path in archive, whose reference is taken over by the response
+//  an archive holds no directory, a path ending with '/' is served by the index file under it
+void serve_archive(struct connection_information *connection, struct archive *archive, const char *path) {
+  char *index_path = NULL;
+  if (strcmp(path, ".") == 0 || path[strlen(path) - 1] == '/') {
+    index_path = get_index_path(path);
+  }
+  const struct archive_file *file = archive_lookup(archive, index_path != NULL ? index_path : path);
+  free(index_path);
+  if (file == NULL) {
+    archive_release(archive);
+    generate_not_found(connection);
+    return;
+  }
+  // select a precompressed variant acceptable by the client, the same as for the document root
+  unsigned variants = archive_get_variants(file);
+  int coding = -1;
+  if (variants != 0) {
+    http_response_set_header(connection->response, "Vary", "Accept-Encoding");
+    char *accept_encoding = get_request_header(connection->request, "Accept-Encoding");
+    coding = select_content_coding(accept_encoding, variants);
+    free(accept_encoding);
+  }
+  struct archive_representation representation;
+  archive_get_representation(archive, file, coding, &representation);
+  time_t modification = archive_get_modification(file);
+  if (coding != -1) {
+    http_response_set_header(connection->response, "Content-Encoding", content_coding_name(coding));
+  }
+  http_response_set_header(connection->response, "ETag", representation.entity_tag);
+  http_response_set_header(connection->response, "Last-Modified", archive_get_last_modified(archive, file));
+  if (is_not_modified(connection->request, representation.entity_tag, modification)) {
+    archive_release(archive);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_NOT_MODIFIED, NULL);
+    return;
+  }
+
+  char *range_value = NULL;
+  if (is_range_applicable(connection->request, representation.entity_tag, modification)) {
+    range_value = get_request_header(connection->request, "Range");
+  }
+  struct range_set ranges;
+  enum range_result range_result = parse_range(range_value, representation.body_length, &ranges);
+  free(range_value);
+  // the content is referred to in place, and the archive is kept mapped until the response is destroyed
+  http_response_add_release_hook(connection->response, archive_release, archive);
+  const char *content_type = archive_get_content_type(archive, file);
+  const char *body = representation.body;
+  char buffer[100];
+  if (range_result == RANGE_RESULT_UNSATISFIABLE) {
+    sprintf(buffer, "bytes */%zu", representation.body_length);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE, NULL);
+    http_response_set_header(connection->response, "Content-Range", buffer);
+  } else if (range_result == RANGE_RESULT_FULL) {
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+    http_response_set_head_prerendered(connection->response);
+    http_response_append_body_reference(
+        connection->response, representation.head, representation.head_length
+    );
+    http_response_append_body_reference(connection->response, body, representation.body_length);
+  } else if (ranges.count == 1) {
+    struct range *range = &ranges.ranges[0];
+    sprintf(buffer, "bytes %zu-%zu/%zu", range->start, range->end - 1, representation.body_length);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_PARTIAL_CONTENT, NULL);
+    http_response_set_header(connection->response, "Content-Range", buffer);
+    http_response_set_header(connection->response, "Content-Type", content_type);
+    http_response_append_body_reference(connection->response, body + range->start, range->end - range->start);
+  } else {
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_PARTIAL_CONTENT, NULL);
+    set_multipart_body(connection->response, body, &ranges, representation.body_length, content_type);
+  }
+}
+// write metrics in the text format of Prometheus to output, along with gauges and statistics kept by modules
+void render_metrics(FILE *output) {
+  metrics_render(output);
+  // connections are counted by walking them, which costs nothing until metrics are collected
+  static const char *states[] = {"waiting-request", "writing-response", "waiting-content", "closing"};
+  size_t connections[sizeof(states) / sizeof(states[0])] = {0};
+  for (struct file_descriptor_information *target = *get_file_descriptor_list(); target != NULL;
+       target = target->next) {
+    if (target->type == TCP_SOCKET || target->type == TLS_SOCKET) {
+      connections[target->connection->state]++;
+    }
+  }
+  fprintf(output, "# HELP connections Connections open by state.\n# TYPE connections gauge\n");
+  for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+    fprintf(output, "connections{state=\"%s\"} %zu\n", states[i], connections[i]);
+  }
+  struct tls_statistics tls;
+  tls_get_statistics(&tls);
+  fprintf(
+      output,
+      "# HELP tls_handshakes_total TLS handshakes completed by type.\n# TYPE tls_handshakes_total counter\n"
+      "tls_handshakes_total{type=\"full\"} %zu\ntls_handshakes_total{type=\"resumed\"} %zu\n"
+      "# HELP tls_early_data_total Resumed handshakes whose early data is accepted.\n"
+      "# TYPE tls_early_data_total counter\ntls_early_data_total %zu\n"
+      "# HELP tls_replays_total Early data rejected as a replay.\n"
+      "# TYPE tls_replays_total counter\ntls_replays_total %zu\n"
+      "# HELP tls_queued_handshakes Steps of TLS handshakes queued or running on the pool.\n"
+      "# TYPE tls_queued_handshakes gauge\ntls_queued_handshakes %zu\n",
+      tls.handshakes - tls.resumptions, tls.resumptions, tls.early_data, tls.replays, tls.queued_handshakes
+  );
+  struct content_cache_statistics cache;
+  content_cache_get_statistics(&cache);
+  fprintf(
+      output,
+      "# HELP content_cache_lookups_total Lookups of the content cache by result.\n"
+      "# TYPE content_cache_lookups_total counter\n"
+      "content_cache_lookups_total{result=\"hit\"} %zu\ncontent_cache_lookups_total{result=\"miss\"} %zu\n"
+      "# HELP content_cache_bytes Size of entries in the content cache.\n"
+      "# TYPE content_cache_bytes gauge\ncontent_cache_bytes %zu\n",
+      cache.hits, cache.misses, cache.bytes
+  );
+}
+// write every connection open with its state, timing, traffic and memory held, followed by totals over them,
+//  which tells whether memory goes to a few large responses or many idle buffers
+//  memory counts what the server allocates for a connection, but not what the kernel or GnuTLS holds for it
+void render_connections(FILE *output) {
+  static const char *states[] = {"waiting-request", "writing-response", "waiting-content", "closing"};
+  size_t connections[sizeof(states) / sizeof(states[0])] = {0};
+  size_t total_buffer = 0, total_response = 0, total_pool = 0, total_memory = 0;
+  uint64_t now = metrics_get_time();
+  for (struct file_descriptor_information *target = *get_file_descriptor_list(); target != NULL;
+       target = target->next) {
+    if (target->type != TCP_SOCKET && target->type != TLS_SOCKET) {
+      continue;
+    }
+    struct connection_information *connection = target->connection;
+    struct http_response_memory response;
+    http_response_get_memory(connection->response, &response);
+    size_t memory = sizeof(struct connection_information) + http_request_size + http_response_size +
+                    connection->buffer.capability + response.pool_capacity + response.overhead;
+    fprintf(
+        output, "connection %lu peer %s:%hu state %s age-ms %.3f idle-ms %.3f received %zu sent %zu ",
+        connection->id, get_address(connection), get_port(connection), states[connection->state],
+        (now - connection->established) / 1e6, (now - connection->active) / 1e6, connection->received_bytes,
+        connection->sent_bytes
+    );
+    if (target->type == TLS_SOCKET) {
+      struct tls_connection_status tls;
+      tls_get_connection_status(connection, &tls);
+      memory += tls.structure;
+      fprintf(output, "tls %s corked %zu ", tls.state, tls.corked);
+    }
+    fprintf(
+        output, "buffer %zu pending %zu response %zu pool %zu/%zu overhead %zu memory %zu\n",
+        connection->buffer.capability, connection->buffer.end - connection->buffer.start,
+        response.body_length, response.pool_length, response.pool_capacity, response.overhead, memory
+    );
+    connections[connection->state]++;
+    total_buffer += connection->buffer.capability;
+    total_response += response.body_length;
+    total_pool += response.pool_capacity;
+    total_memory += memory;
+  }
+  size_t count = 0;
+  fprintf(output, "total");
+  for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+    fprintf(output, " %s %zu", states[i], connections[i]);
+    count += connections[i];
+  }
+  fprintf(
+      output, " connections %zu buffer %zu response %zu pool %zu memory %zu\n", count, total_buffer,
+      total_response, total_pool, total_memory
+  );
 }
 // the request is now ready and accessible from the supplied structure, generate response accordingly
 void handle_http_transaction(struct file_descriptor_information *information) {
   struct connection_information *connection = information->connection;
-  char *canonicalized_url = NULL;
   char *range_value = NULL;
+  char *accept_encoding = NULL;
+  char *index_path = NULL;
   size_t url_length;
+  // only responses with a range of a file continue streaming
+  connection->pattern.sequential = false;
   // get the url of request
   http_request_get_url(connection->request, NULL, &url_length);
   char *url = malloc(url_length);
   http_request_get_url(connection->request, url, &url_length);
+  PROBE2(request__parsed, connection->id, url);
 
   // we do not check if the file exist if we are on TCP session: redirect directly to TLS address
   if (information->type == TCP_SOCKET) {
@@ -306,6 +894,11 @@ void handle_http_transaction(struct file_descriptor_information *information) {
 
   // handle magic calls
   if (strncmp(url, "/magic-call/", 12) == 0) {
+    // magic calls have effects, which shall not be repeated by replaying early data
+    if (connection->early_data) {
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_TOO_EARLY, NULL);
+      goto cleanup;
+    }
     char *code = get_request_header(connection->request, "Authorization");
     bool forbidden = false;
     if (code == NULL) {
@@ -323,6 +916,60 @@ void handle_http_transaction(struct file_descriptor_information *information) {
     if (strcmp(url + 12, "shutdown") == 0) {
       *get_running() = false;
       http_response_set_code(connection->response, HTTP_RESPONSE_CODE_NO_CONTENT, NULL);
+    } else if (strcmp(url + 12, "content-cache") == 0) {
+      struct content_cache_statistics statistics;
+      content_cache_get_statistics(&statistics);
+      char buffer[512];
+      sprintf(
+          buffer,
+          "hits %zu\nmisses %zu\ninsertions %zu\nevictions %zu\ninvalidations %zu\nentries %zu\nbytes %zu\n",
+          statistics.hits, statistics.misses, statistics.insertions, statistics.evictions,
+          statistics.invalidations, statistics.entries, statistics.bytes
+      );
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+      http_response_set_header(connection->response, "Content-Type", "text/plain");
+      http_response_set_body(connection->response, buffer, NULL);
+    } else if (strcmp(url + 12, "tls-sessions") == 0) {
+      struct tls_statistics statistics;
+      tls_get_statistics(&statistics);
+      char buffer[256];
+      sprintf(
+          buffer,
+          "handshakes %zu\nresumptions %zu\nearly-data %zu\nreplays %zu\ninline-handshakes %zu\n"
+          "queued-handshakes %zu\n",
+          statistics.handshakes, statistics.resumptions, statistics.early_data, statistics.replays,
+          statistics.inline_handshakes, statistics.queued_handshakes
+      );
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+      http_response_set_header(connection->response, "Content-Type", "text/plain");
+      http_response_set_body(connection->response, buffer, NULL);
+    } else if (strcmp(url + 12, "stats") == 0) {
+      char *buffer = NULL;
+      size_t length = 0;
+      FILE *output = open_memstream(&buffer, &length);
+      render_metrics(output);
+      fclose(output);
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+      http_response_set_header(connection->response, "Content-Type", "text/plain; version=0.0.4");
+      http_response_set_body(connection->response, buffer, &length);
+      free(buffer);
+    } else if (strcmp(url + 12, "connections") == 0) {
+      char *buffer = NULL;
+      size_t length = 0;
+      FILE *output = open_memstream(&buffer, &length);
+      render_connections(output);
+      fclose(output);
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+      http_response_set_header(connection->response, "Content-Type", "text/plain");
+      http_response_set_body(connection->response, buffer, &length);
+      free(buffer);
+    } else if (strcmp(url + 12, "reload-archive") == 0) {
+      // the archive is replaced as a whole, responses being sent keep the previous one until they finish
+      bool loaded = get_configuration()->archive != NULL && archive_load(get_configuration()->archive);
+      http_response_set_code(
+          connection->response,
+          loaded ? HTTP_RESPONSE_CODE_NO_CONTENT : HTTP_RESPONSE_CODE_INTERNAL_SERVER_ERROR, NULL
+      );
     } else if (strncmp(url + 12, "set-log-level?level=", 20) == 0) {
       logging_set_level(strtol(url + 32, NULL, 10));
       http_response_set_code(connection->response, HTTP_RESPONSE_CODE_NO_CONTENT, NULL);
@@ -333,59 +980,580 @@ void handle_http_transaction(struct file_descriptor_information *information) {
   }
 
   // handle common requests
-  // make sure that the url never goes beyond current root
-  assert(*url == '/');
-  canonicalized_url = realpath(url + 1, NULL);
-  if (canonicalized_url == NULL) {
-    generate_not_found(connection);
+  // resolve the url lexically into a path relative to the document root
+  if (!normalize_path(url)) {
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_BAD_REQUEST, NULL);
     goto cleanup;
   }
-  const char *cwd = current_working_directory();
-  if (memcmp(cwd + 4, canonicalized_url, *(uint32_t *)cwd) != 0) {
-    generate_not_found(connection);
+  const char *path = url[1] == '\0' ? "." : url + 1;
+
+  // the archive, if loaded, is served in place of the document root with a single lookup
+  struct archive *archive = archive_acquire();
+  if (archive != NULL) {
+    serve_archive(connection, archive, path);
+    goto cleanup;
+  }
+  // most requests of vulnerability scanners are for paths which never exist
+  if (!path_filter_may_contain(path)) {
+    set_rejected(connection);
     goto cleanup;
   }
 
-  // try to open the file
-  int file = open(canonicalized_url, O_RDONLY);
-  if (file == -1) {
+  // try to open the file, the kernel makes sure that the resolution never goes beyond the document root
+  //  the file is opened once and kept open in the file cache, along with its status and derived headers
+  bool directory = false;
+  struct file_cache_entry *entry = file_cache_acquire(path, &directory);
+  if (entry == NULL && directory) {
+    // relative references in the index of a directory resolve under it only if its url ends with '/'
+    //  the location is the normalized path encoded again, as it is decoded by now, with the query kept
+    if (url[strlen(url) - 1] != '/') {
+      size_t target_length = url_length + 1;
+      char target[target_length];
+      http_request_get_url(connection->request, target, &target_length);
+      const char *query = target + strcspn(target, "?#");
+      size_t query_length = *query == '?' ? strcspn(query, "#") : 0;
+      char location[3 * strlen(url) + 1 + query_length + 1];
+      size_t length = encode_path(url, location);
+      location[length++] = '/';
+      memcpy(location + length, query, query_length);
+      location[length + query_length] = '\0';
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_MOVE_MOVED_PERMANENTLY, NULL);
+      http_response_set_header(connection->response, "Location", location);
+      goto cleanup;
+    }
+    // serve the index file of the directory as if it is requested, otherwise a listing if enabled
+    index_path = get_index_path(path);
+    entry = index_path == NULL ? NULL : file_cache_acquire(index_path, NULL);
+    if (entry != NULL) {
+      path = index_path;
+    } else if (get_configuration()->autoindex) {
+      serve_listing(information, path, url);
+      goto cleanup;
+    }
+  }
+  if (entry == NULL) {
     generate_not_found(connection);
     goto cleanup;
   }
+  int file = file_cache_get_descriptor(entry);
+  struct stat status = *file_cache_get_status(entry);
+  PROBE3(file__resolved, connection->id, path, status.st_size);
 
-  // get length of the file
-  struct stat status;
-  fstat(file, &status);
+  // select a precompressed variant acceptable by the client, whose content is served as is
+  //  otherwise compress the content on the fly if it is worth doing so
+  const char *content_type = file_cache_get_content_type(entry);
+  unsigned variants = precompressed_get_variants(path, &status);
+  bool compressible = compression_applicable(content_type, status.st_size);
+  struct compression_entry *stream = NULL;
+  bool encoded = false;
+  bool vary = variants != 0 || compressible;
+  if (vary) {
+    // the response depends on Accept-Encoding as long as there is a variant, even if it is not selected
+    http_response_set_header(connection->response, "Vary", "Accept-Encoding");
+    accept_encoding = get_request_header(connection->request, "Accept-Encoding");
+  }
+  if (variants != 0) {
+    int coding = select_content_coding(accept_encoding, variants);
+    struct file_cache_entry *variant = coding == -1 ? NULL : precompressed_acquire(path, coding);
+    if (variant != NULL) {
+      // validators and ranges now apply to the encoded content, which is cached as a file of its own
+      file_cache_release(entry);
+      entry = variant;
+      file = file_cache_get_descriptor(entry);
+      status = *file_cache_get_status(entry);
+      encoded = true;
+      http_response_set_header(connection->response, "Content-Encoding", content_coding_name(coding));
+      compressible = false;
+    }
+  }
+  // content compressed on the fly is served as a whole, a range request is better served with the identity
+  //  one which needs no compression at all; the unknown length needs chunked coding of HTTP/1.1
+  bool gzip = compressible && !has_request_header(connection->request, "Range") &&
+              is_http_1_1(connection->request) &&
+              select_content_coding(accept_encoding, 1u << CONTENT_CODING_GZIP) == CONTENT_CODING_GZIP;
+
+  // generate validators and evaluate conditional requests with them, before any compression is started so
+  //  that a request ending in 304 never compresses anything
+  char entity_tag[ENTITY_TAG_LENGTH + 5];
+  char last_modified[HTTP_DATE_LENGTH];
+  strcpy(entity_tag, file_cache_get_entity_tag(entry));
+  strcpy(last_modified, file_cache_get_last_modified(entry));
+  size_t identity_length = strlen(entity_tag);
+  if (gzip) {
+    // the compressed representation differs from the identity one, so shall its strong validator
+    strcpy(entity_tag + identity_length - 1, "-gzip\"");
+  }
+  bool not_modified = is_not_modified(connection->request, entity_tag, status.st_mtim.tv_sec);
+  if (gzip && !not_modified && (stream = compression_acquire(file, &status, CONTENT_CODING_GZIP)) == NULL) {
+    // compression cannot be started now, so the identity representation is served, whose validator applies
+    strcpy(entity_tag + identity_length - 1, "\"");
+    not_modified = is_not_modified(connection->request, entity_tag, status.st_mtim.tv_sec);
+  }
+  http_response_set_header(connection->response, "ETag", entity_tag);
+  http_response_set_header(connection->response, "Last-Modified", last_modified);
+  if (not_modified) {
+    file_cache_release(entry);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_NOT_MODIFIED, NULL);
+    goto cleanup;
+  }
+
+  if (stream != NULL) {
+    // the content is read from the compressed entry from now on
+    file_cache_release(entry);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+    http_response_set_header(connection->response, "Content-Type", content_type);
+    http_response_set_header(
+        connection->response, "Content-Encoding", content_coding_name(CONTENT_CODING_GZIP)
+    );
+    if (compression_get_state(stream) == COMPRESSION_STATE_COMPLETE) {
+      // serve blocks in place, which are kept by the reference held until the response is destroyed
+      const void *content;
+      size_t length;
+      for (size_t i = 0; compression_get_block(stream, i, &content, &length); i++) {
+        http_response_append_body_reference(connection->response, content, length);
+      }
+      http_response_add_release_hook(connection->response, compression_release, stream);
+    } else {
+      // blocks are sent as chunks following the head as they are compressed
+      http_response_set_header(connection->response, "Transfer-Encoding", "chunked");
+      connection->stream = stream;
+      connection->stream_block = 0;
+    }
+    goto cleanup;
+  }
 
   // calculate Range information
-  range_value = get_request_header(connection->request, "Range");
-  struct range range = parse_range(range_value, status.st_size);
-  // the only case that range.start == range.end is that both of which is 0, which indicates a full range
-  size_t real_length = range.start == range.end ? status.st_size : range.end - range.start;
-
-  // map the file
-  //  since offset must be a page-aligned value, we cannot map only the range requested but the full file
-  void *content = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
-  close(file);
-  http_response_set_body(connection->response, content + range.start, &real_length);
-  munmap(content, status.st_size);
-  if (range.start != range.end) {
-    char buffer[100];
-    sprintf(buffer, "bytes %lu-%lu/%lu", range.start, range.end - 1, status.st_size);
+  if (is_range_applicable(connection->request, entity_tag, status.st_mtim.tv_sec)) {
+    range_value = get_request_header(connection->request, "Range");
+  }
+  struct range_set ranges;
+  enum range_result range_result = parse_range(range_value, status.st_size, &ranges);
+
+  // serve small files as a whole from the content cache, whose head is rendered only once
+  if (range_result != RANGE_RESULT_UNSATISFIABLE) {
+    track_access(connection, &status, range_result == RANGE_RESULT_PARTIAL ? &ranges : NULL);
+  }
+  if (range_result == RANGE_RESULT_FULL && !encoded && content_cache_applicable(status.st_size)) {
+    struct content_cache_entry *content = content_cache_acquire(path, &status, vary);
+    if (content != NULL) {
+      PROBE2(cache__hit, connection->id, path);
+    } else {
+      PROBE2(cache__miss, connection->id, path);
+      // the cached head is the same as that of the ordinary response below
+      http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+      http_response_set_header(connection->response, "Accept-Ranges", "bytes");
+      http_response_set_header(connection->response, "Content-Type", content_type);
+      http_response_set_header(connection->response, "Server", SERVER_NAME);
+      content = content_cache_insert(path, &status, vary, file, connection->response);
+    }
+    if (content != NULL) {
+      file_cache_release(entry);
+      set_cached_content(connection->response, content);
+      goto cleanup;
+    }
+  }
+
+  // the content is streamed from the file when sending, which is kept open by the reference to the entry
+  //  until the response is destroyed
+  http_response_set_body_file_reference(connection->response, file);
+  http_response_add_release_hook(connection->response, file_cache_release, entry);
+  char buffer[100];
+  if (range_result == RANGE_RESULT_UNSATISFIABLE) {
+    sprintf(buffer, "bytes */%lu", status.st_size);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE, NULL);
+    http_response_set_header(connection->response, "Content-Range", buffer);
+  } else if (range_result == RANGE_RESULT_FULL) {
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+    http_response_set_header(connection->response, "Accept-Ranges", "bytes");
+    http_response_set_header(connection->response, "Content-Type", content_type);
+    http_response_append_body_file(connection->response, 0, status.st_size);
+  } else if (ranges.count == 1) {
+    struct range *range = &ranges.ranges[0];
+    sprintf(buffer, "bytes %zu-%zu/%lu", range->start, range->end - 1, status.st_size);
     http_response_set_code(connection->response, HTTP_RESPONSE_CODE_PARTIAL_CONTENT, NULL);
     http_response_set_header(connection->response, "Content-Range", buffer);
+    http_response_set_header(connection->response, "Content-Type", content_type);
+    http_response_append_body_file(connection->response, range->start, range->end - range->start);
   } else {
-    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_OK, NULL);
+    http_response_set_code(connection->response, HTTP_RESPONSE_CODE_PARTIAL_CONTENT, NULL);
+    set_multipart_body(connection->response, NULL, &ranges, status.st_size, content_type);
   }
 
 cleanup:
   // free all
   free(url);
-  free(canonicalized_url);
   free(range_value);
+  free(accept_encoding);
+  free(index_path);
+}
+
+// account a call sending to connection which returns size
+void account_send(struct connection_information *connection, ssize_t size) {
+  connection->timing.calls++;
+  if (size > 0) {
+    connection->timing.sent_bytes += size;
+    connection->sent_bytes += size;
+    connection->active = metrics_get_time();
+    metrics_add(METRICS_COUNTER_SENT_BYTES, size);
+  }
+}
+// send bytes held back by the connection to build larger records
+//  return 1 if everything is sent, 0 if the rest is sent along with the next send or flush, or -1 if the
+//   connection is broken and destroyed
+int flush_connection(struct file_descriptor_information *information) {
+  struct connection_information *connection = information->connection;
+  if (connection->flush == NULL) {
+    return 1;
+  }
+  connection->timing.calls++;
+  if (connection->flush(connection) == 0) {
+    return 1;
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    destroy_file_information(information);
+    return -1;
+  }
+  return 0;
+}
+
+// send 103(Early Hints) announcing sub-resources of the requested page, before the page itself is looked up
+//  what cannot be sent at once is left at the beginning of buffer and sent ahead of the final response
+//  return the number of bytes left in buffer, or -1 if the connection is broken and destroyed
+ssize_t send_early_hints(struct file_descriptor_information *information) {
+  struct connection_information *connection = information->connection;
+  // interim responses are not defined before HTTP/1.1, and requests on plain TCP are only redirected
+  if (information->type != TLS_SOCKET || get_configuration()->early_hints_manifest == NULL ||
+      !is_http_1_1(connection->request)) {
+    return 0;
+  }
+  size_t url_length;
+  http_request_get_url(connection->request, NULL, &url_length);
+  char url[url_length];
+  http_request_get_url(connection->request, url, &url_length);
+  if (!normalize_path(url)) {
+    return 0;
+  }
+  const char *links = early_hints_lookup(url);
+  if (links == NULL) {
+    return 0;
+  }
+  http_response_set_interim_code(connection->response, HTTP_RESPONSE_CODE_EARLY_HINTS);
+  http_response_set_interim_header(connection->response, "Link", links);
+  size_t size = connection->buffer.capability;
+  if (http_response_render_interim(connection->response, connection->buffer.buffer, &size) ==
+      HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE) {
+    free(connection->buffer.buffer);
+    connection->buffer.buffer = malloc(size);
+    connection->buffer.capability = size;
+    http_response_render_interim(connection->response, connection->buffer.buffer, &size);
+  }
+  size_t start = 0;
+  while (start != size) {
+    ssize_t sent = connection->send(connection, connection->buffer.buffer + start, size - start);
+    account_send(connection, sent);
+    if (sent == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        destroy_file_information(information);
+        return -1;
+      }
+      break;
+    }
+    start += sent;
+  }
+  // hints are of no use held back until the final response
+  if (start == size && flush_connection(information) == -1) {
+    return -1;
+  }
+  memmove(connection->buffer.buffer, connection->buffer.buffer + start, size - start);
+  return size - start;
+}
+
+// copy leading parts of body in memory after the head in buffer, therefore small responses are sent at once
+void coalesce_body(struct connection_information *connection) {
+  struct http_body_part part;
+  while (http_response_get_body_part(connection->response, connection->body_part, &part) ==
+             HTTP_ERROR_CODE_SUCCEED &&
+         part.content != NULL && connection->buffer.end + part.length <= CoalesceLimit) {
+    if (connection->buffer.end + part.length > connection->buffer.capability) {
+      connection->buffer.capability = connection->buffer.end + part.length;
+      connection->buffer.buffer = realloc(connection->buffer.buffer, connection->buffer.capability);
+    }
+    memcpy(connection->buffer.buffer + connection->buffer.end, part.content, part.length);
+    connection->buffer.end += part.length;
+    connection->body_part++;
+  }
+}
+// send consecutive parts of body in memory from the current one with a single vector send, then advance the
+//  progress by the size sent, which is returned with the same semantic as writev(2)
+ssize_t send_memory_parts(struct connection_information *connection) {
+  struct iovec vector[SendVectorLimit];
+  int count = 0;
+  struct http_body_part part;
+  size_t offset = connection->body_offset;
+  for (size_t i = connection->body_part;
+       count < SendVectorLimit &&
+       http_response_get_body_part(connection->response, i, &part) == HTTP_ERROR_CODE_SUCCEED &&
+       part.content != NULL;
+       i++) {
+    vector[count].iov_base = (void *)part.content + offset;
+    vector[count].iov_len = part.length - offset;
+    count++;
+    offset = 0;
+  }
+  ssize_t size = connection->send_vector(connection, vector, count);
+  for (size_t left = size > 0 ? size : 0; left != 0;) {
+    http_response_get_body_part(connection->response, connection->body_part, &part);
+    size_t remaining = part.length - connection->body_offset;
+    if (left < remaining) {
+      connection->body_offset += left;
+      break;
+    }
+    left -= remaining;
+    connection->body_part++;
+    connection->body_offset = 0;
+  }
+  return size;
+}
+void resume_connection(void *context);
+// read the next chunk of a body part in file into buffer, which is then sent as other content in buffer
+//  return the size read, with the same semantic as pread(2)
+//  if the chunk is not in the page cache, the connection waits for it and -1 is returned with errno EAGAIN
+ssize_t read_file_chunk(struct file_descriptor_information *information, const struct http_body_part *part) {
+  struct connection_information *connection = information->connection;
+  if (connection->buffer.capability < FileChunkSize) {
+    free(connection->buffer.buffer);
+    connection->buffer.buffer = malloc(FileChunkSize);
+    connection->buffer.capability = FileChunkSize;
+  }
+  size_t remaining = part->length - connection->body_offset;
+  uint64_t start = metrics_get_time();
+  ssize_t size = prefetch_read(
+      part->file_descriptor, connection->buffer.buffer,
+      remaining < connection->buffer.capability ? remaining : connection->buffer.capability,
+      part->offset + connection->body_offset, resume_connection, information
+  );
+  connection->timing.waited = metrics_get_time();
+  connection->timing.reading += connection->timing.waited - start;
+  connection->timing.calls++;
+  if (size == -1 && errno == EAGAIN) {
+    connection->state = ConnectionStatusWaitingContent;
+  }
+  if (size > 0) {
+    connection->buffer.start = 0;
+    connection->buffer.end = size;
+  }
+  return size;
+}
+
+void handle_connection(uint32_t event, struct file_descriptor_information *information);
+// continue sending a response which was waiting for content, called once more content is available
+void resume_connection(void *context) {
+  struct file_descriptor_information *information = context;
+  information->connection->timing.waiting += metrics_get_time() - information->connection->timing.waited;
+  information->connection->state = ConnectionStatusWritingResponse;
+  handle_connection(EPOLLOUT, information);
+}
+// go on with a connection whose step of TLS handshake returns on the pool
+void resume_handshake(void *context) { handle_connection(EPOLLIN | EPOLLOUT, context); }
+// advise the kernel on content around the part being sent to a client streaming a file by ranges
+void advise_access(struct connection_information *connection, const struct http_body_part *part) {
+  struct access_pattern *pattern = &connection->pattern;
+  off_t position = part->offset + connection->body_offset;
+  // advise the next window once half of the last one is consumed, so the disk stays ahead of the client
+  //  the window extends past the range requested, which is where the next range is expected to start
+  if (pattern->advised < pattern->size && position + ReadaheadWindow / 2 >= pattern->advised) {
+    off_t start = pattern->advised > position ? pattern->advised : position;
+    off_t end = position + ReadaheadWindow < pattern->size ? position + ReadaheadWindow : pattern->size;
+    prefetch_advise(part->file_descriptor, start, end - start);
+    pattern->advised = end;
+  }
+  if (pattern->size >= DropBehindSize && position - pattern->dropped >= ReadaheadWindow) {
+    posix_fadvise(part->file_descriptor, pattern->dropped, position - pattern->dropped, POSIX_FADV_DONTNEED);
+    pattern->dropped = position;
+  }
+}
+
+// frame the next block of content compressed on the fly as a chunk into buffer
+//  return 1 if a chunk is loaded, 0 if the connection shall wait for the next block, or -1 if compression
+//   failed, in which case the response cannot be completed
+int load_stream_chunk(struct file_descriptor_information *information) {
+  struct connection_information *connection = information->connection;
+  const void *content;
+  size_t length;
+  if (!compression_get_block(connection->stream, connection->stream_block, &content, &length)) {
+    switch (compression_get_state(connection->stream)) {
+    case COMPRESSION_STATE_RUNNING:
+      connection->timing.waited = metrics_get_time();
+      compression_wait(connection->stream, resume_connection, information);
+      connection->state = ConnectionStatusWaitingContent;
+      return 0;
+    case COMPRESSION_STATE_FAILED:
+      return -1;
+    case COMPRESSION_STATE_COMPLETE:
+      break;
+    }
+    // the last chunk
+    compression_release(connection->stream);
+    connection->stream = NULL;
+    content = NULL;
+    length = 0;
+  } else {
+    connection->stream_block++;
+  }
+  // chunk size in hexadecimal, CRLF, data, CRLF; the last chunk has no data, which ends the body as well
+  size_t total = 16 + 2 + length + 2;
+  if (connection->buffer.capability < total) {
+    free(connection->buffer.buffer);
+    connection->buffer.buffer = malloc(total);
+    connection->buffer.capability = total;
+  }
+  int head = sprintf(connection->buffer.buffer, "%zx\r\n", length);
+  if (length != 0) {
+    memcpy(connection->buffer.buffer + head, content, length);
+  }
+  memcpy(connection->buffer.buffer + head + length, "\r\n", 2);
+  connection->buffer.start = 0;
+  connection->buffer.end = head + length + 2;
+  return 1;
+}
+
+// append a record of the request to the access log
+static void log_access(
+    struct file_descriptor_information *information, enum http_response_code code, uint64_t finished
+) {
+  struct connection_information *connection = information->connection;
+  const struct request_timing *timing = &connection->timing;
+  struct access_log_record record = {
+      .time = timing->started + access_log_get_clock_offset(),
+      .sent_bytes = timing->sent_bytes,
+      .received_bytes = timing->received_bytes,
+      .port = get_port(connection),
+      .status = strtol(http_response_code_get_digits(code), NULL, 10),
+      .method = timing->method < 0 ? ACCESS_LOG_METHOD_INVALID : timing->method,
+      .flags = (information->type == TLS_SOCKET ? ACCESS_LOG_FLAG_TLS : 0) |
+               (connection->resumed ? ACCESS_LOG_FLAG_RESUMED : 0),
+  };
+  if (timing->url != NULL) {
+    // hash the path only, as a query makes every url unique
+    char *query = strchr(timing->url, '?');
+    if (query != NULL) {
+      *query = '\0';
+    }
+    record.path_hash = hash_string(timing->url);
+  }
+  if (connection->address.ss_family == AF_INET) {
+    const struct sockaddr_in *address = (const struct sockaddr_in *)&connection->address;
+    record.address[10] = record.address[11] = 0xff;
+    memcpy(record.address + 12, &address->sin_addr, 4);
+  } else {
+    memcpy(record.address, &((const struct sockaddr_in6 *)&connection->address)->sin6_addr, 16);
+  }
+  const uint64_t stages[ACCESS_LOG_STAGE_MAX] = {
+      [ACCESS_LOG_STAGE_RECEIVE] = timing->received - timing->started,
+      [ACCESS_LOG_STAGE_PARSE] = timing->parsed - timing->received,
+      [ACCESS_LOG_STAGE_RESOLVE] = timing->resolved - timing->parsed,
+      [ACCESS_LOG_STAGE_RENDER] = timing->rendered - timing->resolved,
+      [ACCESS_LOG_STAGE_SEND] = finished - timing->rendered,
+      [ACCESS_LOG_STAGE_READ] = timing->reading,
+      [ACCESS_LOG_STAGE_WAIT] = timing->waiting,
+  };
+  for (size_t i = 0; i < ACCESS_LOG_STAGE_MAX; i++) {
+    record.latencies[i] = stages[i] / 1000 > UINT32_MAX ? UINT32_MAX : stages[i] / 1000;
+  }
+  access_log_append(&record);
+}
+// account the request whose response is sent as a whole, logging it if it is slow
+void finish_request(struct file_descriptor_information *information) {
+  struct connection_information *connection = information->connection;
+  struct request_timing *timing = &connection->timing;
+  uint64_t finished = metrics_get_time();
+  enum http_response_code code = http_response_get_code(connection->response);
+  metrics_count_response(code);
+  PROBE3(send__complete, connection->id, http_response_code_get_digits(code), timing->sent_bytes);
+  metrics_observe(METRICS_HISTOGRAM_REQUEST_DURATION, (finished - timing->received) / 1000);
+  size_t threshold = get_configuration()->slow_request_threshold;
+  if (threshold != 0 && finished - timing->started >= threshold * 1000000) {
+    // stages follow one another, except that reading and waiting for content happen while sending
+    logging_warning(
+        "slow request from %s:%hu for %s with %s: %.3f ms in total, receive %.3f ms, parse %.3f ms, "
+        "resolve %.3f ms, render %.3f ms, send %.3f ms including read %.3f ms and wait %.3f ms, %zu calls, "
+        "%zu bytes received, %zu bytes sent\n",
+        get_address(connection), get_port(connection), timing->url != NULL ? timing->url : "(invalid)",
+        http_response_code_get_digits(code), (finished - timing->started) / 1e6,
+        (timing->received - timing->started) / 1e6, (timing->parsed - timing->received) / 1e6,
+        (timing->resolved - timing->parsed) / 1e6, (timing->rendered - timing->resolved) / 1e6,
+        (finished - timing->rendered) / 1e6, timing->reading / 1e6, timing->waiting / 1e6, timing->calls,
+        timing->received_bytes, timing->sent_bytes
+    );
+  }
+  if (get_configuration()->access_log != NULL) {
+    log_access(information, code, finished);
+  }
+  free(timing->url);
+  memset(timing, 0, sizeof(*timing));
+}
+
+// render the head of the response generated for the request after pending bytes of interim responses in
+//  buffer, and get the connection ready for sending it
+void prepare_response(struct file_descriptor_information *information, ssize_t pending) {
+  struct request_timing *timing = &information->connection->timing;
+  timing->resolved = metrics_get_time();
+  // free request since no which is no longer used
+  http_request_destroy(information->connection->request);
+  // the rest of the buffer is dropped, therefore the next request never arrives as early data
+  information->connection->early_data = false;
+  // set common headers
+  http_response_set_header(information->connection->response, "Server", SERVER_NAME);
+  // render the head of response for sending after pending interim responses, the body follows part by part
+  size_t size = information->connection->buffer.capability - pending;
+  if (http_response_render_head(
+          information->connection->response, information->connection->buffer.buffer + pending, &size
+      ) == HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE) {
+    if (pending == 0) {
+      // avoid copying unused data
+      free(information->connection->buffer.buffer);
+      information->connection->buffer.buffer = malloc(size);
+    } else {
+      information->connection->buffer.buffer =
+          realloc(information->connection->buffer.buffer, pending + size);
+    }
+    information->connection->buffer.capability = pending + size;
+    http_response_render_head(
+        information->connection->response, information->connection->buffer.buffer + pending, &size
+    );
+  }
+  information->connection->buffer.start = 0;
+  information->connection->buffer.end = pending + size;
+  information->connection->body_part = 0;
+  information->connection->body_offset = 0;
+  // a single vector send makes copying unnecessary
+  if (information->connection->send_vector == NULL) {
+    coalesce_body(information->connection);
+  }
+  timing->rendered = metrics_get_time();
+  // mark for sending
+  information->connection->state = ConnectionStatusWritingResponse;
+}
+// generate the response from the listing the request waits for, once it is rendered, and send it
+void resume_listing(void *context) {
+  struct file_descriptor_information *information = context;
+  struct connection_information *connection = information->connection;
+  connection->timing.waiting += metrics_get_time() - connection->timing.waited;
+  struct autoindex_entry *listing = connection->listing;
+  connection->listing = NULL;
+  set_listing(connection, listing);
+  prepare_response(information, connection->buffer.end);
+  handle_connection(EPOLLOUT, information);
 }
 
 void handle_connection(uint32_t event, struct file_descriptor_information *information) {
+  if (information->connection->state == ConnectionStatusWaitingContent) {
+    return;
+  }
+  if (information->connection->state == ConnectionStatusClosing) {
+    close_connection(information);
+    return;
+  }
   if ((event & EPOLLIN) == 0 && information->connection->state == ConnectionStatusWaitingRequest) {
     return;
   }
@@ -403,6 +1571,7 @@ void handle_connection(uint32_t event, struct file_descriptor_information *infor
       ssize_t size = information->connection->recv(
           information->connection, buffer_list[buffer_page] + offset, buffer_page_size - offset
       );
+      information->connection->timing.calls++;
       if (size == -1) {
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
           int error = errno;
@@ -421,7 +1590,7 @@ void handle_connection(uint32_t event, struct file_descriptor_information *infor
         // this identifies EOF from peer, a (half-)closed TCP connection
         //  if no data received in this round, we shall close the connection
         if (total_size == 0) {
-          destroy_file_information(information);
+          close_connection(information);
           information = NULL;
           break;
         }
@@ -436,6 +1605,14 @@ void handle_connection(uint32_t event, struct file_descriptor_information *infor
       }
     }
     if (information != NULL && total_size != 0) {
+      metrics_add(METRICS_COUNTER_RECEIVED_BYTES, total_size);
+      struct request_timing *timing = &information->connection->timing;
+      timing->received_bytes += total_size;
+      information->connection->received_bytes += total_size;
+      information->connection->active = metrics_get_time();
+      if (timing->started == 0) {
+        timing->started = information->connection->active;
+      }
       // shift effective part to beginning
       if (information->connection->buffer.start != 0) {
         memmove(
@@ -487,6 +1664,10 @@ void handle_connection(uint32_t event, struct file_descriptor_information *infor
     }
     // try to parse it
     int return_value;
+    // bytes of interim responses in buffer yet to be sent ahead of the final response
+    ssize_t pending = 0;
+    struct request_timing *timing = &information->connection->timing;
+    timing->received = metrics_get_time();
     return_value = http_request_from_buffer(
         information->connection->request,
         information->connection->buffer.buffer + information->connection->buffer.start,
@@ -495,50 +1676,126 @@ void handle_connection(uint32_t event, struct file_descriptor_information *infor
     if (return_value == HTTP_ERROR_CODE_INCOMPLETE_REQUEST) {
       // we shall wait for further data
       return;
-    } else if (return_value != HTTP_ERROR_CODE_SUCCEED) {
+    }
+    timing->parsed = metrics_get_time();
+    if (return_value != HTTP_ERROR_CODE_SUCCEED) {
       // we shall return a BAD REQUEST for this
       http_response_set_code(information->connection->response, HTTP_RESPONSE_CODE_BAD_REQUEST, NULL);
+      timing->method = -1;
     } else {
+      timing->method = http_request_get_method(information->connection->request);
+      if (get_configuration()->slow_request_threshold != 0 || get_configuration()->access_log != NULL) {
+        size_t url_length;
+        http_request_get_url(information->connection->request, NULL, &url_length);
+        timing->url = malloc(url_length);
+        http_request_get_url(information->connection->request, timing->url, &url_length);
+      }
+      pending = send_early_hints(information);
+      if (pending == -1) {
+        return;
+      }
       handle_http_transaction(information);
+      if (information->connection->state == ConnectionStatusWaitingContent) {
+        // interim responses are kept in the buffer until the response is generated
+        information->connection->buffer.start = 0;
+        information->connection->buffer.end = pending;
+        return;
+      }
     }
-    // free request since no which is no longer used
-    http_request_destroy(information->connection->request);
-    // set common headers
-    http_response_set_header(information->connection->response, "Server", "hSS/0.0.1-alpha");
-    // render the response for sending
-    size_t size = information->connection->buffer.capability;
-    if (http_response_render(
-            information->connection->response, information->connection->buffer.buffer, &size
-        ) == HTTP_ERROR_CODE_INSUFFICIENT_BUFFER_SIZE) {
-      // avoid copying unused data
-      free(information->connection->buffer.buffer);
-      information->connection->buffer.buffer = malloc(size);
-      information->connection->buffer.capability = size;
-      http_response_render(information->connection->response, information->connection->buffer.buffer, &size);
-    }
-    information->connection->buffer.start = 0;
-    information->connection->buffer.end = size;
-    // mark for sending
-    information->connection->state = ConnectionStatusWritingResponse;
+    prepare_response(information, pending);
   }
   if (information->connection->state == ConnectionStatusWritingResponse) {
+    struct connection_information *connection = information->connection;
     while (true) {
-      size_t to_be_write = information->connection->buffer.end - information->connection->buffer.start;
-      ssize_t size = information->connection->send(
-          information->connection,
-          information->connection->buffer.buffer + information->connection->buffer.start, to_be_write
-      );
-      if (size == -1) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-          destroy_file_information(information);
+      ssize_t size;
+      size_t to_be_write = connection->buffer.end - connection->buffer.start;
+      if (to_be_write != 0) {
+        size = connection->send(
+            connection, connection->buffer.buffer + connection->buffer.start, to_be_write
+        );
+        account_send(connection, size);
+        if (size > 0) {
+          connection->buffer.start += size;
+        }
+      } else {
+        struct http_body_part part;
+        if (http_response_get_body_part(connection->response, connection->body_part, &part) !=
+            HTTP_ERROR_CODE_SUCCEED) {
+          if (connection->stream != NULL) {
+            // the body continues with content compressed on the fly
+            int result = load_stream_chunk(information);
+            if (result == -1) {
+              logging_warning(
+                  "compression failed while sending to %s:%hu\n", get_address(connection),
+                  get_port(connection)
+              );
+              close_connection(information);
+            }
+            // what is sent so far shall not wait for compression
+            if (result == 0) {
+              flush_connection(information);
+            }
+            if (result != 1) {
+              return;
+            }
+            continue;
+          }
+          // the whole response is sent, once nothing is held back
+          if (flush_connection(information) != 1) {
+            return;
+          }
+          finish_request(information);
+          http_response_destroy(connection->response);
+          connection->state = ConnectionStatusWaitingRequest;
           return;
+        }
+        if (connection->body_offset == part.length) {
+          connection->body_part++;
+          connection->body_offset = 0;
+          continue;
+        }
+        size_t remaining = part.length - connection->body_offset;
+        if (part.content != NULL && connection->send_vector != NULL) {
+          size = send_memory_parts(connection);
+          account_send(connection, size);
+          if (size > 0) {
+            continue;
+          }
+        } else if (part.content != NULL) {
+          size = connection->send(connection, part.content + connection->body_offset, remaining);
+          account_send(connection, size);
+        } else if (connection->send_file != NULL) {
+          if (connection->pattern.sequential) {
+            advise_access(connection, &part);
+          }
+          off_t offset = part.offset + connection->body_offset;
+          size = connection->send_file(connection, part.file_descriptor, &offset, remaining);
+          account_send(connection, size);
         } else {
+          if (connection->pattern.sequential) {
+            advise_access(connection, &part);
+          }
+          size = read_file_chunk(information, &part);
+        }
+        if (size == 0) {
+          // the file is truncated after the response was generated, which cannot be recovered
+          logging_warning(
+              "file shrank while sending to %s:%hu\n", get_address(connection), get_port(connection)
+          );
+          close_connection(information);
           return;
         }
+        if (size > 0) {
+          connection->body_offset += size;
+        }
       }
-      information->connection->buffer.start += size;
-      if ((size_t)size == to_be_write) {
-        information->connection->state = ConnectionStatusWaitingRequest;
+      if (size == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          destroy_file_information(information);
+        } else if (connection->state == ConnectionStatusWaitingContent) {
+          // what is sent so far shall not wait for the disk
+          flush_connection(information);
+        }
         return;
       }
     }
@@ -563,24 +1820,146 @@ void listen_addresses(int epoll_file_descriptor, int port) {
   }
   freeaddrinfo(result);
 }
-int main() {
+int main(int argc, char *argv[]) {
+  // termination signals are taken from the event loop, which shall be blocked before any thread is created so
+  //  every thread inherits the mask
+  sigset_t termination;
+  sigemptyset(&termination);
+  sigaddset(&termination, SIGINT);
+  sigaddset(&termination, SIGTERM);
+  sigprocmask(SIG_BLOCK, &termination, NULL);
+  configuration_parse(argc, argv);
+  // requested paths are resolved against the working directory at startup
+  get_document_root();
+  if (get_configuration()->early_hints_manifest != NULL &&
+      !early_hints_load(get_configuration()->early_hints_manifest)) {
+    exit(EXIT_FAILURE);
+  }
+  if (get_configuration()->archive != NULL && !archive_load(get_configuration()->archive)) {
+    exit(EXIT_FAILURE);
+  }
+  // sendfile(2) may raise SIGPIPE on a connection closed by peer, which shall not terminate the server
+  signal(SIGPIPE, SIG_IGN);
   // generate and print authorization code
   get_authorization_code();
   // create epoll handle
   int epoll_file_descriptor = epoll_create1(EPOLL_CLOEXEC);
+  *get_epoll_file_descriptor() = epoll_file_descriptor;
   // listen HTTP port
   listen_addresses(epoll_file_descriptor, HTTPPort);
   // listen HTTPS port
   listen_addresses(epoll_file_descriptor, HTTPSPort);
+  content_cache_initialize(get_configuration()->content_cache_size);
+  // reject paths missing from the document root, and refuse clients which keep missing
+  if (get_configuration()->path_filter && path_filter_initialize()) {
+    register_event_source(
+        epoll_file_descriptor, path_filter_get_notification_descriptor(), path_filter_handle_notification,
+        NULL
+    );
+  }
+  penalty_initialize(get_configuration()->scanner_penalty);
+  // free connections whose peers do not answer shutdown in time
+  get_closing_list()->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (get_closing_list()->timer == -1) {
+    logging_error("cannot create timer, connections are closed without shutdown\n");
+  } else {
+    register_event_source(epoll_file_descriptor, get_closing_list()->timer, expire_closing_connections, NULL);
+  }
+  // load certificates before any connection, since the server is of no use without them
+  tls_load_credential(
+      get_configuration()->tls_certificates, get_configuration()->tls_keys,
+      get_configuration()->n_tls_key_pairs
+  );
+  if (get_configuration()->access_log != NULL && !access_log_open(get_configuration()->access_log)) {
+    exit(EXIT_FAILURE);
+  }
+  int signal_descriptor = signalfd(-1, &termination, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_descriptor == -1) {
+    logging_error("cannot create signal file descriptor: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  register_event_source(
+      epoll_file_descriptor, signal_descriptor, handle_termination, (void *)(intptr_t)signal_descriptor
+  );
+  // resume TLS sessions from tickets, whose key is replaced on a schedule
+  if (tls_initialize(get_configuration()->tls_early_data) && tls_get_rotation_descriptor() != -1) {
+    register_event_source(epoll_file_descriptor, tls_get_rotation_descriptor(), tls_handle_rotation, NULL);
+  }
+  // cache listings of directories until they change
+  if (get_configuration()->autoindex && autoindex_initialize(AutoindexCapacity) &&
+      autoindex_get_notification_descriptor() != -1) {
+    register_event_source(
+        epoll_file_descriptor, autoindex_get_notification_descriptor(), autoindex_handle_notification, NULL
+    );
+  }
+  // watch the document root for changes to files kept open
+  if (file_cache_initialize(get_configuration()->file_cache_size) &&
+      file_cache_get_notification_descriptor() != -1) {
+    register_event_source(
+        epoll_file_descriptor, file_cache_get_notification_descriptor(), file_cache_handle_notification, NULL
+    );
+  }
+  // start compression on the fly if enabled
+  struct worker_pool *compression_pool = NULL;
+  if (get_configuration()->compression_cache_size != 0) {
+    compression_pool = worker_pool_create(CompressionThreads, 0);
+    if (compression_pool == NULL) {
+      logging_error("cannot create worker pool, compression on the fly is disabled\n");
+    } else {
+      compression_initialize(get_configuration()->compression_cache_size, compression_pool);
+      register_event_source(
+          epoll_file_descriptor, worker_pool_get_file_descriptor(compression_pool),
+          dispatch_worker_pool, compression_pool
+      );
+    }
+  }
+
+  // run TLS handshakes off the event loop, therefore established connections do not wait for a burst of them
+  struct worker_pool *handshake_pool = worker_pool_create(HandshakeThreads, HandshakeCapacity);
+  if (handshake_pool == NULL) {
+    logging_error("cannot create worker pool, handshakes run on the event loop\n");
+  } else {
+    tls_offload_handshakes(handshake_pool, resume_handshake);
+    register_event_source(
+        epoll_file_descriptor, worker_pool_get_file_descriptor(handshake_pool), dispatch_worker_pool,
+        handshake_pool
+    );
+  }
+  // read files not in the page cache, and directories to be listed, off the event loop
+  struct worker_pool *read_pool = worker_pool_create(ReadThreads, ReadCapacity);
+  if (read_pool == NULL) {
+    logging_error("cannot create worker pool, files are read on the event loop\n");
+  } else {
+    prefetch_initialize(read_pool);
+    autoindex_offload_rendering(read_pool);
+    register_event_source(
+        epoll_file_descriptor, worker_pool_get_file_descriptor(read_pool), dispatch_worker_pool, read_pool
+    );
+  }
 
   while (*get_running()) {
     struct epoll_event events[128];
     int event_count = epoll_wait(epoll_file_descriptor, events, 128, -1);
+    uint64_t iteration_start = metrics_get_time();
+    metrics_observe(METRICS_HISTOGRAM_EPOLL_BATCH, event_count > 0 ? event_count : 0);
+    // event sources are handled after other events of this round, since handlers may destroy connections
+    //  whose events are still pending in the array
+    struct file_descriptor_information *event_sources[128];
+    int event_source_count = 0;
     for (int i = 0; i < event_count; i++) {
       struct file_descriptor_information *information = events[i].data.ptr;
+      if (information->type == EVENT_SOURCE) {
+        event_sources[event_source_count++] = information;
+        continue;
+      }
       if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
-        // error occurred or the connection is closed, free this connection
-        destroy_file_information(information);
+        // error occurred or the connection is closed, free this connection, after telling the peer which is
+        //  still able to read
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          destroy_file_information(information);
+        } else {
+          close_connection(information);
+        }
         if (*get_file_descriptor_list() == NULL) {
           // all connections are gone, exit
           *get_running() = false;
@@ -595,8 +1974,24 @@ int main() {
         handle_connection(events[i].events, information);
       }
     }
+    for (int i = 0; i < event_source_count; i++) {
+      event_sources[i]->event_source.handler(event_sources[i]->event_source.context);
+    }
+    metrics_observe(METRICS_HISTOGRAM_LOOP_ITERATION, metrics_get_time() - iteration_start);
   }
   close_all_file_descriptors();
+  if (compression_pool != NULL) {
+    worker_pool_destroy(compression_pool);
+  }
+  if (read_pool != NULL) {
+    worker_pool_destroy(read_pool);
+  }
+  if (handshake_pool != NULL) {
+    worker_pool_destroy(handshake_pool);
+  }
+  if (get_closing_list()->timer != -1) {
+    close(get_closing_list()->timer);
+  }
   close(epoll_file_descriptor);
   return 0;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <tcp_connection.h>
 // these are just simple wrapper over recv and send
@@ -9,6 +10,16 @@ static ssize_t tcp_send(struct connection_information *connection, const void *b
   //  just too lazy to set up a handler lol
   return send(connection->file_descriptor, buf, n, MSG_NOSIGNAL);
 }
+static ssize_t
+tcp_send_file(struct connection_information *connection, int file_descriptor, off_t *offset, size_t n) {
+  // sendfile has no flag like MSG_NOSIGNAL, SIGPIPE is ignored by the process instead
+  return sendfile(connection->file_descriptor, file_descriptor, offset, n);
+}
+static ssize_t
+tcp_send_vector(struct connection_information *connection, const struct iovec *vector, int count) {
+  struct msghdr message = {.msg_iov = (struct iovec *)vector, .msg_iovlen = count};
+  return sendmsg(connection->file_descriptor, &message, MSG_NOSIGNAL);
+}
 static void tcp_destroy_underlying(struct connection_information *connection) {
   logging_trace("closing TCP session with %s:%hu\n", get_address(connection), get_port(connection));
 }
@@ -16,5 +27,9 @@ void tcp_initialize_underlying(struct connection_information *connection) {
   // there is no need for extra, hidden states
   connection->recv = tcp_recv;
   connection->send = tcp_send;
+  connection->send_file = tcp_send_file;
+  connection->send_vector = tcp_send_vector;
+  connection->flush = NULL;
+  connection->shutdown = NULL;
   connection->destroy_underlying = tcp_destroy_underlying;
 }
\ No newline at end of file
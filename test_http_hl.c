@@ -0,0 +1,230 @@
+// tests of normalization and range parsing in http_hl.c, which guard paths, headers and bodies built from
+//  requests
+//  run by make test, a failed check is printed and makes the test exit with failure
+#include <http_hl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define check(condition)                                                                                    \
+  do {                                                                                                       \
+    if (!(condition)) {                                                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                         \
+      failures++;                                                                                            \
+    }                                                                                                        \
+  } while (0)
+
+// normalize target, return whether it succeeds and compare the result with expected if so
+static bool normalizes_to(const char *target, const char *expected) {
+  char buffer[strlen(target) + 2];
+  strcpy(buffer, target);
+  if (!normalize_path(buffer)) {
+    return false;
+  }
+  if (strcmp(buffer, expected) != 0) {
+    fprintf(stderr, "%s normalized to %s, expected %s\n", target, buffer, expected);
+    return false;
+  }
+  return true;
+}
+static bool rejected(const char *target) {
+  char buffer[strlen(target) + 1];
+  strcpy(buffer, target);
+  return !normalize_path(buffer);
+}
+
+static void test_normalize_path(void) {
+  // NUL and invalid percent-encodings
+  check(rejected("/a%00b"));
+  check(rejected("/%00"));
+  check(rejected("/a%"));
+  check(rejected("/a%2"));
+  check(rejected("/a%g0"));
+  check(rejected("/a%0g"));
+  check(rejected("/%%41"));
+  // not an absolute path
+  check(rejected(""));
+  check(rejected("a/b"));
+  check(rejected("../etc/passwd"));
+  check(rejected("*"));
+  // dot segments never go above the root, encoded or not
+  check(normalizes_to("/..", "/"));
+  check(normalizes_to("/../etc/passwd", "/etc/passwd"));
+  check(normalizes_to("/../../a/../../b", "/b"));
+  check(normalizes_to("/%2e%2e/etc/passwd", "/etc/passwd"));
+  check(normalizes_to("/%2E%2E%2f%2E%2E%2fetc", "/etc"));
+  check(normalizes_to("/a/%2e%2e/%2e%2e/%2e%2e/b", "/b"));
+  check(normalizes_to("/a/..%2fb", "/b"));
+  // a segment which only starts with dots is an ordinary one
+  check(normalizes_to("/...", "/..."));
+  check(normalizes_to("/..a/.b", "/..a/.b"));
+  // repeated slashes
+  check(normalizes_to("//", "/"));
+  check(normalizes_to("//a///b//", "/a/b/"));
+  check(normalizes_to("/a%2f%2fb", "/a/b"));
+  // a trailing dot segment names a directory
+  check(normalizes_to("/a/b/.", "/a/b/"));
+  check(normalizes_to("/a/b/..", "/a/"));
+  check(normalizes_to("/a/.", "/a/"));
+  check(normalizes_to("/.", "/"));
+  check(normalizes_to("/a", "/a"));
+  // query and fragment are dropped before decoding, so encoded ones are kept in the path
+  check(normalizes_to("/a?b=../c#d", "/a"));
+  check(normalizes_to("/a#b", "/a"));
+  check(normalizes_to("/a%3Fb%23c", "/a?b#c"));
+  check(normalizes_to("/a%20b", "/a b"));
+}
+
+// check that encoding the normalized target emits nothing which ends a path or a header, and that it
+//  normalizes back to the same path
+static void check_encoded(const char *target) {
+  char normalized[strlen(target) + 2];
+  strcpy(normalized, target);
+  if (!normalize_path(normalized)) {
+    return;
+  }
+  char encoded[3 * strlen(normalized) + 1];
+  size_t length = encode_path(normalized, encoded);
+  check(length == strlen(encoded));
+  check(strpbrk(encoded, "?# \r\n\t\"<>\\") == NULL);
+  for (const char *c = encoded; *c != '\0'; c++) {
+    check(*c > 0x20 && *c < 0x7f);
+  }
+  char again[length + 2];
+  strcpy(again, encoded);
+  check(normalize_path(again) && strcmp(again, normalized) == 0);
+}
+static void test_encode_path(void) {
+  char encoded[64];
+  check(encode_path("/", encoded) == 1 && strcmp(encoded, "/") == 0);
+  check(encode_path("/a-b_c.d~e/", encoded) == 11 && strcmp(encoded, "/a-b_c.d~e/") == 0);
+  check(encode_path("/a b?c#d", encoded) == 14 && strcmp(encoded, "/a%20b%3Fc%23d") == 0);
+  check(encode_path("/\r\n", encoded) == 7 && strcmp(encoded, "/%0D%0A") == 0);
+  check(encode_path("/\xff", encoded) == 4 && strcmp(encoded, "/%FF") == 0);
+  check_encoded("/a%3Fb%23c%20d%0D%0AX-Injected:%201");
+  check_encoded("/%2e%2e/a%25b");
+  // every octet but NUL, either encoded or not
+  for (int octet = 1; octet < 256; octet++) {
+    char target[16];
+    sprintf(target, "/x%%%02Xy/", octet);
+    check_encoded(target);
+    if (octet != '?' && octet != '#' && octet != '%') {
+      sprintf(target, "/x%cy", octet);
+      check_encoded(target);
+    }
+  }
+}
+
+// parse a Range header of a representation with size bytes, and compare the set with expected ranges, given
+//  as pairs of start and exclusive end
+static bool parses_to(const char *header, size_t size, enum range_result result, size_t count, ...) {
+  struct range_set set;
+  if (parse_range(header, size, &set) != result || set.count != count) {
+    fprintf(stderr, "%s of %zu bytes parsed to %zu ranges\n", header, size, set.count);
+    return false;
+  }
+  va_list ranges;
+  va_start(ranges, count);
+  bool matched = true;
+  for (size_t i = 0; i < count; i++) {
+    size_t start = va_arg(ranges, size_t);
+    size_t end = va_arg(ranges, size_t);
+    if (set.ranges[i].start != start || set.ranges[i].end != end) {
+      fprintf(
+          stderr, "%s of %zu bytes: range %zu is [%zu, %zu)\n", header, size, i, set.ranges[i].start,
+          set.ranges[i].end
+      );
+      matched = false;
+    }
+  }
+  va_end(ranges);
+  return matched;
+}
+
+static void test_parse_range(void) {
+  check(parses_to(NULL, 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("items=0-1", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=0-9", 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)10));
+  check(parses_to("bytes=90-", 100, RANGE_RESULT_PARTIAL, 1, (size_t)90, (size_t)100));
+  check(parses_to("bytes=90-1000", 100, RANGE_RESULT_PARTIAL, 1, (size_t)90, (size_t)100));
+  // suffix ranges
+  check(parses_to("bytes=-10", 100, RANGE_RESULT_PARTIAL, 1, (size_t)90, (size_t)100));
+  check(parses_to("bytes=-100", 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)100));
+  check(parses_to("bytes=-1000", 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)100));
+  check(parses_to("bytes=-0", 100, RANGE_RESULT_UNSATISFIABLE, 0));
+  check(parses_to("bytes=-0,0-0", 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)1));
+  check(parses_to("bytes=-1", 0, RANGE_RESULT_UNSATISFIABLE, 0));
+  // first > last is invalid syntax, which makes the whole header ignored
+  check(parses_to("bytes=10-9", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=0-1,10-9", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=5-5", 100, RANGE_RESULT_PARTIAL, 1, (size_t)5, (size_t)6));
+  // positions up to SIZE_MAX are accepted, while one that overflows is invalid syntax
+  char header[128];
+  sprintf(header, "bytes=0-%zu", (size_t)SIZE_MAX);
+  check(parses_to(header, 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)100));
+  sprintf(header, "bytes=%zu-", (size_t)SIZE_MAX);
+  check(parses_to(header, 100, RANGE_RESULT_UNSATISFIABLE, 0));
+  check(parses_to("bytes=0-18446744073709551616", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=0-99999999999999999999999999", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=-99999999999999999999999999", 100, RANGE_RESULT_FULL, 0));
+  // other invalid syntax
+  check(parses_to("bytes=", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=-", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=a-b", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=0-1;2-3", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=+1-2", 100, RANGE_RESULT_FULL, 0));
+  // empty list elements are allowed
+  check(parses_to("bytes=,", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=, ,", 100, RANGE_RESULT_FULL, 0));
+  check(parses_to("bytes=,0-1", 100, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)2));
+  check(
+      parses_to("bytes=0-1,, ,200-300,", 1000, RANGE_RESULT_PARTIAL, 2, (size_t)0, (size_t)2, (size_t)200,
+                (size_t)301)
+  );
+  // at most RANGE_SET_CAPACITY specifiers, empty elements not counted
+  char many[1024] = "bytes=";
+  for (size_t i = 0; i < RANGE_SET_CAPACITY; i++) {
+    sprintf(many + strlen(many), "%s%zu-%zu,,", i == 0 ? "" : ",", i * 1000, i * 1000);
+  }
+  struct range_set set;
+  check(parse_range(many, RANGE_SET_CAPACITY * 1000, &set) == RANGE_RESULT_PARTIAL);
+  check(set.count == RANGE_SET_CAPACITY);
+  strcat(many, "99999-99999");
+  check(parse_range(many, RANGE_SET_CAPACITY * 1000 + 100000, &set) == RANGE_RESULT_FULL);
+  check(set.count == 0);
+  // unsatisfiable specifiers are dropped, a set of only those is unsatisfiable
+  check(parses_to("bytes=100-200", 100, RANGE_RESULT_UNSATISFIABLE, 0));
+  check(parses_to("bytes=100-200, 300-, -0", 100, RANGE_RESULT_UNSATISFIABLE, 0));
+  check(parses_to("bytes=0-", 0, RANGE_RESULT_UNSATISFIABLE, 0));
+  check(parses_to("bytes=100-200,50-59", 100, RANGE_RESULT_PARTIAL, 1, (size_t)50, (size_t)60));
+  // sorted, then coalesced when overlapping or no more than RANGE_COALESCE_GAP bytes apart
+  check(
+      parses_to("bytes=500-599,0-9", 1000, RANGE_RESULT_PARTIAL, 2, (size_t)0, (size_t)10, (size_t)500,
+                (size_t)600)
+  );
+  check(parses_to("bytes=0-9,5-19", 1000, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)20));
+  check(parses_to("bytes=0-9,10-19", 1000, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)20));
+  sprintf(header, "bytes=0-9,%d-%d", 10 + RANGE_COALESCE_GAP, 10 + RANGE_COALESCE_GAP + 9);
+  check(parses_to(header, 1000, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)(10 + RANGE_COALESCE_GAP + 10)));
+  sprintf(header, "bytes=0-9,%d-%d", 10 + RANGE_COALESCE_GAP + 1, 10 + RANGE_COALESCE_GAP + 10);
+  check(
+      parses_to(header, 1000, RANGE_RESULT_PARTIAL, 2, (size_t)0, (size_t)10,
+                (size_t)(10 + RANGE_COALESCE_GAP + 1), (size_t)(10 + RANGE_COALESCE_GAP + 11))
+  );
+  check(parses_to("bytes=0-9,0-999,5-5", 1000, RANGE_RESULT_PARTIAL, 1, (size_t)0, (size_t)1000));
+}
+
+int main(void) {
+  test_normalize_path();
+  test_encode_path();
+  test_parse_range();
+  if (failures != 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -1,13 +1,42 @@
+#define _GNU_SOURCE
 #include <common.h>
 #include <errno.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/x509-ext.h>
 #include <gnutls/x509.h>
+#include <probes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <tls_connection.h>
+#include <unistd.h>
+#include <worker_pool.h>
+
+enum {
+  // payload of a record fitting in a single TCP segment on a path with 1500 bytes MTU: less IPv6 and TCP
+  //  headers with timestamps, and TLS 1.3 framing of header, content type and tag
+  SmallRecordSize = 1500 - 40 - 20 - 12 - 5 - 1 - 16,
+  // records sent small at the start of a response, or after the connection is idle for IdleTimeout
+  //  milliseconds, while the congestion window is small, so the client can process each record as soon as
+  //   its segment arrives, after which records are as large as possible to save cost per record
+  SmallRecords = 32,
+  IdleTimeout = 1000,
+  // the ticket key is replaced this often, while keys encrypting tickets are derived from it and rotate with
+  //  the lifetime of tickets, which is 6 hours by default
+  TicketKeyLifetime = 24 * 60 * 60,
+  // bytes of early data accepted, which is plenty for a request
+  EarlyDataSize = 16 * 1024,
+  // ClientHellos with early data are remembered within this window, in milliseconds, to reject replays, while
+  //  older ones are rejected by their ticket age
+  AntiReplayWindow = 10 * 1000,
+  // ClientHellos remembered at most, beyond which early data is rejected until older ones expire
+  AntiReplaySlots = 16384,
+  AntiReplayProbes = 16,
+};
 
 struct connection_underlying {
   // state of the TLS connection
@@ -16,10 +45,63 @@ struct connection_underlying {
     TLS_STATE_Handshaking, // handshaking in progress
     TLS_STATE_Established, // TLS connection established and fully functional
     TLS_STATE_Failed,      // the connection has failed
+    TLS_STATE_Closed,      // close_notify has been sent, either answered or not
   } state;
   // session used for this connection
   gnutls_session_t session;
+  // early data is accepted, which is received before anything else
+  bool early_data;
+  // bytes sent since the response started or the connection went idle, and when anything is sent last in
+  //  milliseconds of the monotonic clock, which determine the size of records
+  size_t ramp;
+  uint64_t last_send;
+  // bytes held back for the record being built, and whether sending it has been interrupted
+  size_t corked;
+  bool flushing;
+  // length of a record sent directly whose sending has been interrupted, which is sent again as it is
+  size_t interrupted;
+  // progress of the handshake step on the pool, which owns the session until the step returns
+  //  this is modified atomically, since a connection torn down meanwhile abandons the job
+  enum handshake_job {
+    HandshakeJobIdle,      // the handshake is not on the pool
+    HandshakeJobQueued,    // the step is submitted but not yet started
+    HandshakeJobRunning,   // the step is running on a worker
+    HandshakeJobDone,      // the step has returned, waiting for completion on the event loop
+    HandshakeJobAbandoned, // the connection is gone, the session is freed and the socket closed on completion
+  } job;
+  int job_result;
+  // the connection has events while the step is on the pool, which may be what the step waits for
+  bool job_events;
+  struct connection_information *connection;
+  void *context; // passed to the wake function of handshakes
+};
+
+// a ClientHello with early data seen recently, identified by a hash of it
+struct client_hello {
+  uint64_t hash;
+  time_t expiration; // 0 if the slot is empty
 };
+// state of session resumption shared by all sessions
+struct resumption {
+  gnutls_datum_t ticket_key; // NULL data if tickets are not issued
+  int timer;
+  bool early_data;
+  gnutls_anti_replay_t anti_replay;
+  // ClientHellos are remembered by handshakes running on workers, guarded by lock along with statistics
+  pthread_mutex_t lock;
+  struct client_hello *client_hellos;
+  struct tls_statistics statistics;
+  // pool on which handshakes run, NULL if they run on the event loop
+  struct worker_pool *pool;
+  void (*wake)(void *context);
+};
+
+static struct resumption *get_resumption(void) {
+  static struct resumption resumption = {
+      .ticket_key = {NULL, 0}, .timer = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .pool = NULL
+  };
+  return &resumption;
+}
 
 // make a GNUTLS call as specified in call with the following argument list
 //  if such call succeed, no further cation is taken
@@ -28,64 +110,127 @@ struct connection_underlying {
   do {                                                                                                       \
     int rtv = call(__VA_ARGS__);                                                                             \
     if (rtv != 0) {                                                                                          \
-      fprintf(                                                                                               \
-          stderr, "GNUTLS call " #call " failed" __VA_OPT__(" with arguments ") #__VA_ARGS__ ": %s\n",       \
+      logging_error(                                                                                         \
+          "GNUTLS call " #call " failed" __VA_OPT__(" with arguments ") #__VA_ARGS__ ": %s\n",               \
           gnutls_strerror(rtv)                                                                               \
       );                                                                                                     \
       failed_call;                                                                                           \
     }                                                                                                        \
   } while (false)
-// this is an internal helper, do not call directly
-static void destroy_credential(void);
-// this function shall ALWAYS be called with argument set to false
-// get credential used for all sessions, which is exactly the certificate and key of the server
-//  this function calls exit(3) in case a failure occurs since absent of credential shall prevent the server
-//   from being functional ultimately
-static gnutls_certificate_credentials_t get_credential(bool destroy) {
-  static gnutls_certificate_credentials_t credential;
-  static bool initialize = true;
-  if (destroy) {
-    if (initialize) {
-      return NULL;
-    }
-    gnutls_certificate_free_credentials(credential);
-  }
-  if (initialize) {
-    // allocate the structure for a certificate
-    GNUTLS_HELPER(exit(EXIT_FAILURE), gnutls_certificate_allocate_credentials, &credential);
-    // load certificate from file
-    GNUTLS_HELPER(
-        exit(EXIT_FAILURE), gnutls_certificate_set_x509_key_file2, credential, "keys/cnlab.cert",
-        "keys/cnlab.prikey", GNUTLS_X509_FMT_PEM, NULL, GNUTLS_PKCS_PLAIN
-    );
-    // register automatic destroy of credential
-    atexit(destroy_credential);
-    initialize = true;
-  }
-  return credential;
+// credential and priority used for all sessions, which are set up once by tls_load_credential
+struct credential {
+  // certificate and key pairs of the server, among which gnutls picks one the client supports per handshake
+  gnutls_certificate_credentials_t certificates;
+  // parsed priority string, which sessions refer to instead of parsing it again
+  gnutls_priority_t priority;
+};
+
+static struct credential *get_credential(void) {
+  static struct credential credential = {NULL, NULL};
+  return &credential;
 }
-void destroy_credential(void) {
-  // free credential
-  get_credential(true);
+static void destroy_credential(void) {
+  struct credential *credential = get_credential();
+  gnutls_priority_deinit(credential->priority);
+  gnutls_certificate_free_credentials(credential->certificates);
 }
 
-static int do_handshake(struct connection_information *connection) {
+// update the state of the session after a step of handshake returns result, on the event loop thread
+static void finish_handshake(struct connection_information *connection, int result) {
   struct connection_underlying *underlying = connection->underlying;
-  logging_trace("handshaking with %s:%hu\n", get_address(connection), get_port(connection));
-  int result = gnutls_handshake(underlying->session);
+  if (result == 0 || gnutls_error_is_fatal(result)) {
+    PROBE3(
+        handshake__end, connection->id, result, result == 0 && gnutls_session_is_resumed(underlying->session)
+    );
+  }
   if (result == 0) {
     logging_trace("handshake done with %s:%hu\n", get_address(connection), get_port(connection));
     underlying->state = TLS_STATE_Established;
+    struct resumption *resumption = get_resumption();
+    pthread_mutex_lock(&resumption->lock);
+    resumption->statistics.handshakes++;
+    if (gnutls_session_is_resumed(underlying->session)) {
+      resumption->statistics.resumptions++;
+      connection->resumed = true;
+    }
+    if (gnutls_session_get_flags(underlying->session) & GNUTLS_SFLAGS_EARLY_DATA) {
+      resumption->statistics.early_data++;
+      underlying->early_data = true;
+    }
+    pthread_mutex_unlock(&resumption->lock);
   } else if (result == GNUTLS_E_FATAL_ALERT_RECEIVED || result == GNUTLS_E_WARNING_ALERT_RECEIVED) {
-    void (*logging)(const char *, ...) =
-        result == GNUTLS_E_FATAL_ALERT_RECEIVED ? logging_error : logging_warning;
+    enum logging_log_level level =
+        result == GNUTLS_E_FATAL_ALERT_RECEIVED ? LOGGING_LOG_LEVEL_ERROR : LOGGING_LOG_LEVEL_WARNING;
     gnutls_alert_description_t alert = gnutls_alert_get(underlying->session);
-    logging("received alert: %s\n", gnutls_alert_get_name(alert));
+    logging_log(level, "received alert: %s\n", gnutls_alert_get_name(alert));
     if (result == GNUTLS_E_FATAL_ALERT_RECEIVED) {
       // fatal alert shall terminate the session
       underlying->state = TLS_STATE_Failed;
     }
   }
+}
+// run a step of handshake on a worker, which is skipped if the connection is gone before it starts
+static void run_handshake(void *context) {
+  struct connection_underlying *underlying = context;
+  enum handshake_job expected = HandshakeJobQueued;
+  if (!__atomic_compare_exchange_n(
+          &underlying->job, &expected, HandshakeJobRunning, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE
+      )) {
+    return;
+  }
+  underlying->job_result = gnutls_handshake(underlying->session);
+  // the connection may be gone meanwhile, in which case the job is left abandoned
+  expected = HandshakeJobRunning;
+  __atomic_compare_exchange_n(
+      &underlying->job, &expected, HandshakeJobDone, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED
+  );
+}
+// hand the session back to the event loop once a step of handshake returns
+static void complete_handshake(void *context) {
+  struct connection_underlying *underlying = context;
+  if (__atomic_load_n(&underlying->job, __ATOMIC_ACQUIRE) == HandshakeJobAbandoned) {
+    // the socket is taken over from the connection gone, since the step may have used it until now
+    close(gnutls_transport_get_int(underlying->session));
+    gnutls_deinit(underlying->session);
+    free(underlying);
+    return;
+  }
+  __atomic_store_n(&underlying->job, HandshakeJobIdle, __ATOMIC_RELAXED);
+  finish_handshake(underlying->connection, underlying->job_result);
+  // waiting for the peer, unless it has sent or received something since the step read or wrote last
+  if (underlying->job_result == GNUTLS_E_AGAIN && !underlying->job_events) {
+    return;
+  }
+  get_resumption()->wake(underlying->context);
+}
+// make progress on the handshake, which runs on the pool if there is room
+//  return the result of gnutls_handshake, where GNUTLS_E_AGAIN is returned as well while the step is on the
+//   pool, and the connection is woken up once it returns
+static int do_handshake(struct connection_information *connection) {
+  struct connection_underlying *underlying = connection->underlying;
+  struct resumption *resumption = get_resumption();
+  if (__atomic_load_n(&underlying->job, __ATOMIC_ACQUIRE) != HandshakeJobIdle) {
+    underlying->job_events = true;
+    return GNUTLS_E_AGAIN;
+  }
+  logging_trace("handshaking with %s:%hu\n", get_address(connection), get_port(connection));
+  if (underlying->state == TLS_STATE_Initialized) {
+    underlying->state = TLS_STATE_Handshaking;
+    PROBE1(handshake__start, connection->id);
+  }
+  if (resumption->pool != NULL) {
+    underlying->job = HandshakeJobQueued;
+    underlying->job_events = false;
+    if (worker_pool_submit(resumption->pool, run_handshake, complete_handshake, underlying)) {
+      return GNUTLS_E_AGAIN;
+    }
+    underlying->job = HandshakeJobIdle;
+    pthread_mutex_lock(&resumption->lock);
+    resumption->statistics.inline_handshakes++;
+    pthread_mutex_unlock(&resumption->lock);
+  }
+  int result = gnutls_handshake(underlying->session);
+  finish_handshake(connection, result);
   return result;
 }
 // set corresponding errno from gnutls error code
@@ -106,7 +251,7 @@ static void set_errno(long gnutls_error_code) {
     break;
   }
   logging_trace(
-      "set errno to %d(%s) by gnutls error code %d(%s)\n", errno, strerror(errno), gnutls_error_code,
+      "set errno to %d(%s) by gnutls error code %ld(%s)\n", errno, strerror(errno), gnutls_error_code,
       gnutls_strerror((int)gnutls_error_code)
   );
 }
@@ -140,45 +285,343 @@ tls_recv_send(struct connection_information *connection, operation_t operation,
     return -1;
   }
 }
+// receive early data, which is buffered by gnutls separately as the handshake proceeds
+//  return -1 if there is none now
+static ssize_t recv_early_data(struct connection_information *connection, void *buf, size_t nbytes) {
+  struct connection_underlying *underlying = connection->underlying;
+  if (!underlying->early_data) {
+    return -1;
+  }
+  ssize_t size = gnutls_record_recv_early_data(underlying->session, buf, nbytes);
+  if (size <= 0) {
+    return -1;
+  }
+  connection->early_data = true;
+  return size;
+}
 static ssize_t tls_recv(struct connection_information *connection, void *buf, size_t nbytes) {
-  ssize_t result = tls_recv_send(connection, gnutls_record_recv, buf, nbytes);
+  ssize_t result = recv_early_data(connection, buf, nbytes);
+  if (result == -1) {
+    result = tls_recv_send(connection, gnutls_record_recv, buf, nbytes);
+    if (result == -1 && errno == EAGAIN) {
+      // early data may arrive while the client is yet to finish the handshake
+      result = recv_early_data(connection, buf, nbytes);
+      errno = EAGAIN;
+    }
+  }
   // save errno
   int error = errno;
+  // a request starts a response, which starts with small records again
+  if (result > 0) {
+    ((struct connection_underlying *)connection->underlying)->ramp = 0;
+  }
   logging_trace("%ld bytes received from %s:%hu\n", result, get_address(connection), get_port(connection));
   errno = error;
   return result;
 }
+// get milliseconds of the monotonic clock
+static uint64_t get_monotonic_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+// get the size of the next record, which is never smaller than the record being built
+static size_t get_record_size(struct connection_underlying *underlying) {
+  if (get_monotonic_time() - underlying->last_send >= IdleTimeout) {
+    underlying->ramp = 0;
+  }
+  size_t size = underlying->ramp < SmallRecords * SmallRecordSize
+                    ? SmallRecordSize
+                    : gnutls_record_get_max_size(underlying->session);
+  return size < underlying->corked ? underlying->corked : size;
+}
+// send the record being built, return 0 or an error code of gnutls
+static int flush_record(struct connection_underlying *underlying) {
+  // an interrupted uncork holds the record back again, which is resumed by another call
+  ssize_t result = gnutls_record_uncork(underlying->session, 0);
+  underlying->flushing = result == GNUTLS_E_AGAIN || result == GNUTLS_E_INTERRUPTED;
+  if (result < 0) {
+    return result;
+  }
+  underlying->ramp += underlying->corked;
+  underlying->last_send = get_monotonic_time();
+  underlying->corked = 0;
+  return 0;
+}
+// send n bytes in records sized dynamically: a write smaller than a record is held back, and grouped with
+//  following ones into a single record, which is sent once it is filled or flushed
+static ssize_t send_records(struct connection_information *connection, const void *buf, size_t n) {
+  struct connection_underlying *underlying = connection->underlying;
+  // nothing goes ahead of a record whose sending has been interrupted
+  int result = underlying->flushing ? flush_record(underlying) : 0;
+  if (result < 0) {
+    set_errno(result);
+    return -1;
+  }
+  size_t record_size = underlying->interrupted != 0 ? underlying->interrupted : get_record_size(underlying);
+  size_t length = n < record_size - underlying->corked ? n : record_size - underlying->corked;
+  if (underlying->corked == 0 && length == record_size) {
+    ssize_t size = gnutls_record_send(underlying->session, buf, length);
+    if (size < 0) {
+      underlying->interrupted = size == GNUTLS_E_AGAIN || size == GNUTLS_E_INTERRUPTED ? length : 0;
+      set_errno(size);
+      return -1;
+    }
+    underlying->interrupted = 0;
+    underlying->ramp += size;
+    underlying->last_send = get_monotonic_time();
+    return size;
+  }
+  // bytes written while corked are only buffered, which never fails for the socket
+  gnutls_record_cork(underlying->session);
+  ssize_t size = gnutls_record_send(underlying->session, buf, length);
+  if (size < 0) {
+    set_errno(size);
+    return -1;
+  }
+  underlying->corked += size;
+  // bytes held back are sent sooner or later even if the record is interrupted, and are reported as sent
+  if (underlying->corked == record_size && (result = flush_record(underlying)) < 0 && !underlying->flushing) {
+    set_errno(result);
+    return -1;
+  }
+  return size;
+}
 static ssize_t tls_send(struct connection_information *connection, const void *buf, size_t n) {
-  ssize_t result = tls_recv_send(connection, (operation_t)gnutls_record_send, (void *)buf, n);
+  struct connection_underlying *underlying = connection->underlying;
+  ssize_t result = underlying->state == TLS_STATE_Established
+                       ? send_records(connection, buf, n)
+                       : tls_recv_send(connection, (operation_t)gnutls_record_send, (void *)buf, n);
   int error = errno;
   logging_trace("%ld bytes sent to %s:%hu\n", result, get_address(connection), get_port(connection));
   errno = error;
   return result;
 }
 
-static void tls_destroy_underlying(struct connection_information *connection) {
+static int tls_flush(struct connection_information *connection) {
   struct connection_underlying *underlying = connection->underlying;
-  // use blocking terminate here
-  int result;
+  if (underlying->state != TLS_STATE_Established || (underlying->corked == 0 && !underlying->flushing)) {
+    return 0;
+  }
+  int result = flush_record(underlying);
+  if (result < 0) {
+    set_errno(result);
+    return -1;
+  }
+  return 0;
+}
+static int tls_shutdown(struct connection_information *connection) {
+  struct connection_underlying *underlying = connection->underlying;
+  // there is nothing to close for a session never established
+  if (underlying->state != TLS_STATE_Established) {
+    return 0;
+  }
+  // close_notify follows the response, which may be partly held back
+  if (tls_flush(connection) == -1) {
+    return errno == EAGAIN ? -1 : 0;
+  }
   logging_trace("tearing down TLS session with %s:%hu\n", get_address(connection), get_port(connection));
-  do {
-    result = gnutls_bye(underlying->session, GNUTLS_SHUT_RDWR);
-  } while (result == GNUTLS_E_AGAIN);
+  // send close_notify and wait for that of the peer, which resumes where it stopped when called again
+  int result = gnutls_bye(underlying->session, GNUTLS_SHUT_RDWR);
+  if (result == GNUTLS_E_AGAIN || result == GNUTLS_E_INTERRUPTED) {
+    errno = EAGAIN;
+    return -1;
+  }
   if (result == 0) {
     logging_trace("TLS session closed gracefully\n");
   } else {
     logging_debug("unclear close of TLS session: %s\n", gnutls_strerror(result));
   }
+  underlying->state = TLS_STATE_Closed;
+  return 0;
+}
+static void tls_destroy_underlying(struct connection_information *connection) {
+  struct connection_underlying *underlying = connection->underlying;
+  if (__atomic_load_n(&underlying->job, __ATOMIC_ACQUIRE) != HandshakeJobIdle) {
+    // a step on the pool may be using the socket, therefore the job is abandoned without waiting for it, and
+    //  the session is freed and the socket is closed on completion
+    __atomic_store_n(&underlying->job, HandshakeJobAbandoned, __ATOMIC_RELEASE);
+    connection->file_descriptor = -1;
+    connection->underlying = NULL;
+    return;
+  }
+  // a session torn down without shutdown gets close_notify at best, which is never waited for
+  if (underlying->state == TLS_STATE_Established) {
+    gnutls_bye(underlying->session, GNUTLS_SHUT_WR);
+  }
   gnutls_deinit(underlying->session);
   free(connection->underlying);
   connection->underlying = NULL;
 }
 
-void tls_initialize_underlying(struct connection_information *connection) {
+// remember a ClientHello with early data, called by gnutls for anti-replay on the thread of the handshake
+//  return GNUTLS_E_DB_ENTRY_EXISTS if it is seen before, or it cannot be remembered, which rejects early data
+static int remember_client_hello(
+    void *context, time_t expiration, const gnutls_datum_t *key, const gnutls_datum_t *data
+) {
+  (void)data;
+  struct resumption *resumption = context;
+  // 64-bit FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < key->size; i++) {
+    hash = (hash ^ key->data[i]) * 0x100000001b3ull;
+  }
+  time_t now = time(NULL);
+  int result = 0;
+  pthread_mutex_lock(&resumption->lock);
+  struct client_hello *free_slot = NULL;
+  for (size_t i = 0; i < AntiReplayProbes && result == 0; i++) {
+    struct client_hello *slot = &resumption->client_hellos[(hash + i) & (AntiReplaySlots - 1)];
+    if (slot->expiration <= now) {
+      free_slot = free_slot == NULL ? slot : free_slot;
+    } else if (slot->hash == hash) {
+      resumption->statistics.replays++;
+      logging_warning("early data rejected as a replay\n");
+      result = GNUTLS_E_DB_ENTRY_EXISTS;
+    }
+  }
+  if (result == 0 && free_slot == NULL) {
+    logging_debug("early data rejected since too many ClientHellos are remembered\n");
+    result = GNUTLS_E_DB_ENTRY_EXISTS;
+  } else if (result == 0) {
+    free_slot->hash = hash;
+    free_slot->expiration = expiration;
+  }
+  pthread_mutex_unlock(&resumption->lock);
+  return result;
+}
+// check if the key in file is an elliptic curve one, whose signature is much cheaper than that of RSA
+static bool is_elliptic_curve_key(const char *path) {
+  gnutls_datum_t data;
+  if (gnutls_load_file(path, &data) != 0) {
+    return false;
+  }
+  gnutls_x509_privkey_t key;
+  int algorithm = GNUTLS_PK_UNKNOWN;
+  if (gnutls_x509_privkey_init(&key) == 0) {
+    if (gnutls_x509_privkey_import2(key, &data, GNUTLS_X509_FMT_PEM, NULL, GNUTLS_PKCS_PLAIN) == 0) {
+      algorithm = gnutls_x509_privkey_get_pk_algorithm(key);
+    }
+    gnutls_x509_privkey_deinit(key);
+  }
+  gnutls_memset(data.data, 0, data.size);
+  gnutls_free(data.data);
+  return algorithm == GNUTLS_PK_ECDSA || algorithm == GNUTLS_PK_EDDSA_ED25519 ||
+         algorithm == GNUTLS_PK_EDDSA_ED448;
+}
+void tls_load_credential(const char *const *certificates, const char *const *keys, size_t count) {
+  struct credential *credential = get_credential();
+  // allocate the structure for certificates
+  GNUTLS_HELPER(exit(EXIT_FAILURE), gnutls_certificate_allocate_credentials, &credential->certificates);
+  // load certificates from files, each of which is appended along with its key
+  //  gnutls takes the first pair the client supports, therefore elliptic curve keys go ahead of the others
+  for (int elliptic_curve = 1; elliptic_curve >= 0; elliptic_curve--) {
+    for (size_t i = 0; i < count; i++) {
+      if (is_elliptic_curve_key(keys[i]) != elliptic_curve) {
+        continue;
+      }
+      GNUTLS_HELPER(
+          exit(EXIT_FAILURE), gnutls_certificate_set_x509_key_file2, credential->certificates,
+          certificates[i], keys[i], GNUTLS_X509_FMT_PEM, NULL, GNUTLS_PKCS_PLAIN
+      );
+      logging_information("loaded certificate %s with key %s\n", certificates[i], keys[i]);
+    }
+  }
+  // simply use the default settings, which are parsed here once
+  GNUTLS_HELPER(exit(EXIT_FAILURE), gnutls_priority_init2, &credential->priority, NULL, NULL, 0);
+  // register automatic destroy of credential
+  atexit(destroy_credential);
+}
+
+bool tls_initialize(bool early_data) {
+  struct resumption *resumption = get_resumption();
+  if (gnutls_session_ticket_key_generate(&resumption->ticket_key) != 0) {
+    logging_error("cannot generate ticket key, sessions are not resumed\n");
+    resumption->ticket_key.data = NULL;
+    return false;
+  }
+  resumption->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  struct itimerspec interval = {{TicketKeyLifetime, 0}, {TicketKeyLifetime, 0}};
+  if (resumption->timer == -1 || timerfd_settime(resumption->timer, 0, &interval, NULL) == -1) {
+    logging_warning("cannot set up timer, the ticket key is never replaced\n");
+  }
+  if (early_data) {
+    resumption->client_hellos = calloc(AntiReplaySlots, sizeof(struct client_hello));
+    if (gnutls_anti_replay_init(&resumption->anti_replay) != 0) {
+      logging_error("cannot set up anti-replay, early data is disabled\n");
+      free(resumption->client_hellos);
+      return true;
+    }
+    gnutls_anti_replay_set_window(resumption->anti_replay, AntiReplayWindow);
+    gnutls_anti_replay_set_add_function(resumption->anti_replay, remember_client_hello);
+    gnutls_anti_replay_set_ptr(resumption->anti_replay, resumption);
+    resumption->early_data = true;
+  }
+  return true;
+}
+
+int tls_get_rotation_descriptor(void) { return get_resumption()->timer; }
+
+void tls_handle_rotation(void *context) {
+  (void)context;
+  struct resumption *resumption = get_resumption();
+  uint64_t expirations;
+  if (read(resumption->timer, &expirations, sizeof(expirations)) == -1) {
+    return;
+  }
+  // sessions have their own copies of the key, therefore the previous one is freed at once
+  gnutls_datum_t key;
+  if (gnutls_session_ticket_key_generate(&key) != 0) {
+    logging_error("cannot generate ticket key, the previous one is kept\n");
+    return;
+  }
+  gnutls_memset(resumption->ticket_key.data, 0, resumption->ticket_key.size);
+  gnutls_free(resumption->ticket_key.data);
+  resumption->ticket_key = key;
+  logging_information("ticket key is replaced\n");
+}
+
+void tls_offload_handshakes(struct worker_pool *pool, void (*wake)(void *context)) {
+  get_resumption()->pool = pool;
+  get_resumption()->wake = wake;
+}
+
+void tls_get_statistics(struct tls_statistics *statistics) {
+  struct resumption *resumption = get_resumption();
+  pthread_mutex_lock(&resumption->lock);
+  *statistics = resumption->statistics;
+  pthread_mutex_unlock(&resumption->lock);
+  statistics->queued_handshakes = resumption->pool == NULL ? 0 : worker_pool_get_pending(resumption->pool);
+}
+
+void tls_get_connection_status(
+    struct connection_information *connection, struct tls_connection_status *status
+) {
+  static const char *states[] = {"initialized", "handshaking", "established", "failed", "closed"};
+  _Static_assert(sizeof(states) / sizeof(states[0]) == TLS_STATE_Closed + 1, "unnamed state");
+  struct connection_underlying *underlying = connection->underlying;
+  status->state = states[underlying->state];
+  status->structure = sizeof(struct connection_underlying);
+  status->corked = underlying->corked;
+}
+
+void tls_initialize_underlying(struct connection_information *connection, void *context) {
+  struct resumption *resumption = get_resumption();
   // we do need extra state here
   connection->underlying = malloc(sizeof(struct connection_underlying));
   struct connection_underlying *underlying = connection->underlying;
   underlying->state = TLS_STATE_Failed;
+  underlying->early_data = false;
+  underlying->ramp = 0;
+  underlying->last_send = 0;
+  underlying->corked = 0;
+  underlying->flushing = false;
+  underlying->interrupted = 0;
+  underlying->job = HandshakeJobIdle;
+  underlying->connection = connection;
+  underlying->context = context;
+  // accept early data if enabled, and respond to it before the client finishes the handshake
+  unsigned early_data = resumption->early_data ? GNUTLS_ENABLE_EARLY_DATA | GNUTLS_ENABLE_EARLY_START : 0;
   // setup session
   GNUTLS_HELPER(return, gnutls_init, &underlying->session,
                       GNUTLS_SERVER          // this is a session for server side
@@ -186,18 +629,32 @@ void tls_initialize_underlying(struct connection_information *connection) {
                           | GNUTLS_NO_SIGNAL // do not generate SIGPIPE
                           | GNUTLS_POST_HANDSHAKE_AUTH // enable for auto re-auth
                           | GNUTLS_AUTO_REAUTH         // let GNUTLS handle re-handshake automatically
+                          | early_data
   );
-  // simply use the default settings
-  GNUTLS_HELPER(return, gnutls_set_default_priority, underlying->session);
-  // set the certificate/key pair
+  // share the priority parsed at startup
+  GNUTLS_HELPER(return, gnutls_priority_set, underlying->session, get_credential()->priority);
+  // set the certificate/key pairs
   GNUTLS_HELPER(return, gnutls_credentials_set, underlying->session, GNUTLS_CRD_CERTIFICATE,
-                      get_credential(false));
+                      get_credential()->certificates);
+  // issue tickets to resume the session with
+  if (resumption->ticket_key.data != NULL) {
+    GNUTLS_HELPER(return, gnutls_session_ticket_enable_server, underlying->session, &resumption->ticket_key);
+  }
+  if (resumption->early_data) {
+    gnutls_record_set_max_early_data_size(underlying->session, EarlyDataSize);
+    gnutls_anti_replay_enable(underlying->session, resumption->anti_replay);
+  }
   // setup socket file descriptor for communication
   gnutls_transport_set_int(underlying->session, connection->file_descriptor);
   // setup wrapper for recv/send
   connection->recv = tls_recv;
   connection->send = tls_send;
+  connection->flush = tls_flush;
+  // records must be encrypted in memory, so file content is always read into buffer before sending
+  connection->send_file = NULL;
+  connection->send_vector = NULL;
   // setup destructor
+  connection->shutdown = tls_shutdown;
   connection->destroy_underlying = tls_destroy_underlying;
   // update state
   underlying->state = TLS_STATE_Initialized;
@@ -1,8 +1,66 @@
 #ifndef TLS_H_
 #define TLS_H_
 #include <common.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
-void tls_initialize_underlying(struct connection_information *connection);
+#include <worker_pool.h>
+// statistics of session resumption since startup
+struct tls_statistics {
+  size_t handshakes;  // handshakes completed, including resumed ones
+  size_t resumptions; // handshakes resuming a session from a ticket, which skip the certificate entirely
+  size_t early_data;  // resumed handshakes whose early data (0-RTT) is accepted
+  size_t replays;     // early data rejected as a replay of a ClientHello seen before
+  // handshakes run on the event loop since the pool was at its capacity
+  size_t inline_handshakes;
+  // steps of handshake queued or running on the pool now
+  size_t queued_handshakes;
+};
+
+// load certificate and key pairs from PEM files, where certificates[i] goes with keys[i], and parse the
+//  priority, both of which are shared by all sessions
+//  pairs of different key types, e.g. ECDSA and RSA, are all offered, among which gnutls picks one supported
+//   by the client per handshake, preferring elliptic curve keys whatever the order, therefore clients
+//   supporting ECDSA get the much cheaper signature
+//  this calls exit(3) if any pair cannot be loaded, since the server is of no use without its certificate
+void tls_load_credential(const char *const *certificates, const char *const *keys, size_t count);
+
+// set up resumption shared by all sessions: TLS 1.3 session tickets encrypted with keys held in memory only,
+//  which are replaced on a schedule, and early data (0-RTT) with replay protection if early_data
+//  requests received as early data may be replayed by an attacker, which is marked on the connection
+//  return false if tickets cannot be issued, in which case every handshake is a full one
+bool tls_initialize(bool early_data);
+
+// get the file descriptor which becomes readable when the ticket key is due for replacement, -1 if there is
+//  no ticket key
+int tls_get_rotation_descriptor(void);
+
+// replace the ticket key, this shall be called when the descriptor above becomes readable, context is unused
+//  so this can be registered as an event handler
+//  tickets issued with the previous key are no longer accepted, whose clients fall back to a full handshake
+void tls_handle_rotation(void *context);
+
+// run handshakes on pool, which include the asymmetric cryptography of a full handshake, instead of the event
+//  loop, where wake(context) is called on the event loop thread once a step of the handshake of a connection
+//  returns, upon which the connection shall be handled as if it has events
+//  a handshake runs on the event loop if the pool is at its capacity
+void tls_offload_handshakes(struct worker_pool *pool, void (*wake)(void *context));
+
+// get statistics of session resumption and handshakes
+void tls_get_statistics(struct tls_statistics *statistics);
+
+// state of the TLS session of a connection, which is reported for diagnostics
+struct tls_connection_status {
+  const char *state;  // e.g. "established"
+  size_t structure;   // bytes of the structure kept along with the session, not including GnuTLS itself
+  size_t corked;      // bytes held back for the record being built
+};
+// get the state of the TLS session on connection
+void tls_get_connection_status(
+    struct connection_information *connection, struct tls_connection_status *status
+);
+
+// set up TLS on connection, context is passed to the wake function of handshakes for this connection
+void tls_initialize_underlying(struct connection_information *connection, void *context);
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+// convert an access log written by the server with --access-log into JSON lines, one object per request
+//  usage: access_log_decoder [access log]
+//  the log is read from standard input if no path is given, and shall come from a host of the same byte
+//   order
+//  paths are hashed with hash_string in the log, therefore they are printed as hashes in hexadecimal
+#define _GNU_SOURCE
+#include <access_log.h>
+#include <arpa/inet.h>
+#include <http.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *stages[] = {"receive", "parse", "resolve", "render", "send", "read", "wait"};
+_Static_assert(sizeof(stages) / sizeof(stages[0]) == ACCESS_LOG_STAGE_MAX, "unnamed stage");
+
+static void print_record(const struct access_log_record *record) {
+  // time in RFC 3339 with nanoseconds
+  char time[32];
+  time_t seconds = record->time / 1000000000;
+  struct tm calendar;
+  strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", gmtime_r(&seconds, &calendar));
+  // print IPv4 addresses mapped into IPv6 as they are
+  static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  char address[INET6_ADDRSTRLEN];
+  if (memcmp(record->address, mapped, sizeof(mapped)) == 0) {
+    inet_ntop(AF_INET, record->address + 12, address, sizeof(address));
+  } else {
+    inet_ntop(AF_INET6, record->address, address, sizeof(address));
+  }
+  printf(
+      "{\"time\":\"%s.%09" PRIu64 "Z\",\"address\":\"%s\",\"port\":%" PRIu16 ",", time,
+      record->time % 1000000000, address, record->port
+  );
+  if (record->method == HTTP_REQUEST_METHOD_GET) {
+    printf("\"method\":\"GET\",\"path_hash\":\"%016" PRIx64 "\",", record->path_hash);
+  } else {
+    printf("\"method\":null,\"path_hash\":null,");
+  }
+  printf(
+      "\"status\":%" PRIu16 ",\"received_bytes\":%" PRIu32 ",\"sent_bytes\":%" PRIu64
+      ",\"tls\":%s,\"resumed\":%s,\"latencies_us\":{",
+      record->status, record->received_bytes, record->sent_bytes,
+      record->flags & ACCESS_LOG_FLAG_TLS ? "true" : "false",
+      record->flags & ACCESS_LOG_FLAG_RESUMED ? "true" : "false"
+  );
+  for (size_t i = 0; i < ACCESS_LOG_STAGE_MAX; i++) {
+    printf("%s\"%s\":%" PRIu32, i == 0 ? "" : ",", stages[i], record->latencies[i]);
+  }
+  printf("}}\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [access log]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  FILE *input = stdin;
+  if (argc == 2 && (input = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  struct access_log_header header;
+  if (fread(&header, sizeof(header), 1, input) != 1 ||
+      memcmp(header.magic, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_LENGTH) != 0 ||
+      header.record_size != sizeof(struct access_log_record)) {
+    fprintf(stderr, "not an access log of this version or byte order\n");
+    return EXIT_FAILURE;
+  }
+  // read records in batches, the same as they are written
+  static struct access_log_record records[4096];
+  size_t count;
+  while ((count = fread(records, sizeof(records[0]), sizeof(records) / sizeof(records[0]), input)) != 0) {
+    for (size_t i = 0; i < count; i++) {
+      print_record(&records[i]);
+    }
+  }
+  if (ferror(input)) {
+    perror("cannot read the access log");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,300 @@
+// pack a document root into an archive served by the server with --archive
+//  usage: archive_builder <document root> <archive>
+//  every regular file under the document root is packed along with its precompressed variants, which are
+//   siblings named after it as the server looks for them, and a gzip variant is generated for a file without
+//   one if it is worth doing so
+//  the archive is written next to the destination and renamed over it, therefore a running server never sees
+//   a partially written archive, and keeps the one it has mapped until it is told to load the new one
+//  files are resolved beneath the document root as the server does, so a symbolic link leading out of it is
+//   skipped rather than packed
+#define _GNU_SOURCE
+#include <archive.h>
+#include <common.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <http.h>
+#include <linux/openat2.h>
+#include <mime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// files smaller than this are not worth compressing, the same as compression on the fly
+enum { MinimumCompressedSize = 256 };
+
+struct content {
+  void *data;
+  size_t length;
+};
+struct file {
+  char *path; // relative to the document root
+  uint64_t offset;
+};
+
+static const char *root;
+static int root_descriptor;
+static struct file *files = NULL;
+static size_t n_files = 0;
+static FILE *output;
+static uint64_t output_offset = 0;
+
+static void fail(const char *message, const char *path) {
+  fprintf(stderr, "%s %s: %s\n", message, path, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+// open path relative to the document root, never going out of it, the same as open_beneath in the server
+static int open_beneath_root(const char *path, int flags) {
+  struct open_how how = {
+      .flags = flags,
+      .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+  };
+  return syscall(SYS_openat2, root_descriptor, *path == '\0' ? "." : path, &how, sizeof(how));
+}
+
+static void collect(const char *directory) {
+  int descriptor = open_beneath_root(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR *handle = descriptor == -1 ? NULL : fdopendir(descriptor);
+  if (handle == NULL) {
+    fail("cannot open directory", *directory == '\0' ? root : directory);
+  }
+  struct dirent *entry;
+  while ((entry = readdir(handle)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    char *path;
+    if (*directory == '\0') {
+      path = strdup(entry->d_name);
+    } else if (asprintf(&path, "%s/%s", directory, entry->d_name) == -1) {
+      fail("cannot allocate path for", entry->d_name);
+    }
+    struct stat status;
+    // symbolic links to directories are not followed, which may form a loop
+    if (fstatat(dirfd(handle), entry->d_name, &status, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(status.st_mode)) {
+      collect(path);
+      free(path);
+      continue;
+    }
+    int file = open_beneath_root(path, O_RDONLY | O_CLOEXEC);
+    if (file == -1 && errno == EXDEV) {
+      fprintf(stderr, "skipping %s, which leads out of the document root\n", path);
+    }
+    if (file != -1 && fstat(file, &status) == 0 && S_ISREG(status.st_mode)) {
+      files = realloc(files, sizeof(struct file) * (n_files + 1));
+      files[n_files].path = path;
+      files[n_files].offset = 0;
+      n_files++;
+    } else {
+      free(path);
+    }
+    if (file != -1) {
+      close(file);
+    }
+  }
+  closedir(handle);
+}
+
+static bool read_file(const char *path, struct content *content, struct stat *status) {
+  int descriptor = open_beneath_root(path, O_RDONLY | O_CLOEXEC);
+  FILE *file = descriptor == -1 ? NULL : fdopen(descriptor, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  fstat(fileno(file), status);
+  content->length = status->st_size;
+  content->data = malloc(content->length == 0 ? 1 : content->length);
+  if (fread(content->data, 1, content->length, file) != content->length) {
+    fail("cannot read", path);
+  }
+  fclose(file);
+  return true;
+}
+// compress content with gzip, return false if the result is not small enough to be worth serving
+static bool compress_gzip(const struct content *content, struct content *compressed) {
+  if (content->length < MinimumCompressedSize) {
+    return false;
+  }
+  z_stream stream = {0};
+  deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+  compressed->data = malloc(deflateBound(&stream, content->length));
+  stream.next_in = content->data;
+  stream.avail_in = content->length;
+  stream.next_out = compressed->data;
+  stream.avail_out = deflateBound(&stream, content->length);
+  deflate(&stream, Z_FINISH);
+  compressed->length = stream.total_out;
+  deflateEnd(&stream);
+  // a gain below one eighth does not pay for decoding
+  if (compressed->length > content->length - content->length / 8) {
+    free(compressed->data);
+    return false;
+  }
+  return true;
+}
+
+static void write_bytes(const void *data, size_t length) {
+  if (length != 0 && fwrite(data, 1, length, output) != length) {
+    fail("cannot write", "archive");
+  }
+  output_offset += length;
+}
+static void align(size_t alignment) {
+  static const char zeros[ARCHIVE_ALIGNMENT] = {0};
+  write_bytes(zeros, (alignment - output_offset % alignment) % alignment);
+}
+static struct archive_range write_string(const char *string) {
+  struct archive_range range = {.offset = output_offset, .length = strlen(string)};
+  write_bytes(string, range.length + 1);
+  return range;
+}
+// write body of a representation along with its head and validator
+static struct archive_variant write_variant(
+    const char *path, const struct content *body, int coding, unsigned variants, const char *content_type,
+    const char *last_modified
+) {
+  struct archive_variant variant;
+  char entity_tag[ENTITY_TAG_LENGTH];
+  format_content_entity_tag(entity_tag, body->data, body->length);
+  // the same headers as the server sets for the whole content from the document root
+  struct http_response *response = malloc(http_response_size);
+  http_response_initialize(response);
+  http_response_set_code(response, HTTP_RESPONSE_CODE_OK, NULL);
+  if (variants != 0) {
+    http_response_set_header(response, "Vary", "Accept-Encoding");
+  }
+  if (coding != -1) {
+    http_response_set_header(response, "Content-Encoding", content_coding_name(coding));
+  }
+  http_response_set_header(response, "ETag", entity_tag);
+  http_response_set_header(response, "Last-Modified", last_modified);
+  http_response_set_header(response, "Accept-Ranges", "bytes");
+  http_response_set_header(response, "Content-Type", content_type);
+  http_response_set_header(response, "Server", SERVER_NAME);
+  http_response_append_body_reference(response, body->data, body->length);
+  size_t head_length = 0;
+  http_response_render_head(response, NULL, &head_length);
+  char *head = malloc(head_length);
+  if (http_response_render_head(response, head, &head_length) != HTTP_ERROR_CODE_SUCCEED) {
+    fprintf(stderr, "cannot render head of %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  http_response_destroy(response);
+  free(response);
+
+  variant.entity_tag = write_string(entity_tag);
+  variant.head.offset = output_offset;
+  variant.head.length = head_length;
+  write_bytes(head, head_length);
+  free(head);
+  align(ARCHIVE_ALIGNMENT);
+  variant.body.offset = output_offset;
+  variant.body.length = body->length;
+  write_bytes(body->data, body->length);
+  return variant;
+}
+static void pack(struct file *file) {
+  struct content identity;
+  struct stat status;
+  if (!read_file(file->path, &identity, &status)) {
+    fail("cannot open", file->path);
+  }
+  // fresh precompressed siblings are used as they are
+  static const char *extensions[] = {".br", ".zst", ".gz"};
+  _Static_assert(sizeof(extensions) / sizeof(extensions[0]) == CONTENT_CODING_MAX, "unmapped content coding");
+  struct content encoded[CONTENT_CODING_MAX];
+  unsigned variants = 0;
+  for (size_t coding = 0; coding < CONTENT_CODING_MAX; coding++) {
+    char sibling[strlen(file->path) + 8];
+    sprintf(sibling, "%s%s", file->path, extensions[coding]);
+    struct stat sibling_status;
+    if (read_file(sibling, &encoded[coding], &sibling_status)) {
+      if (sibling_status.st_mtim.tv_sec >= status.st_mtim.tv_sec) {
+        variants |= 1u << coding;
+      } else {
+        free(encoded[coding].data);
+      }
+    }
+  }
+  if ((variants & (1u << CONTENT_CODING_GZIP)) == 0 &&
+      compress_gzip(&identity, &encoded[CONTENT_CODING_GZIP])) {
+    variants |= 1u << CONTENT_CODING_GZIP;
+  }
+
+  struct archive_file record = {0};
+  char last_modified[HTTP_DATE_LENGTH];
+  format_http_date(status.st_mtim.tv_sec, last_modified);
+  const char *content_type = mime_type_lookup(file->path);
+  record.path = write_string(file->path);
+  record.content_type = write_string(content_type);
+  record.last_modified = write_string(last_modified);
+  record.modification = status.st_mtim.tv_sec;
+  record.variants = variants;
+  record.identity = write_variant(file->path, &identity, -1, variants, content_type, last_modified);
+  free(identity.data);
+  for (size_t coding = 0; coding < CONTENT_CODING_MAX; coding++) {
+    if ((variants & (1u << coding)) != 0) {
+      record.encoded[coding] =
+          write_variant(file->path, &encoded[coding], coding, variants, content_type, last_modified);
+      free(encoded[coding].data);
+    }
+  }
+  align(_Alignof(struct archive_file));
+  file->offset = output_offset;
+  write_bytes(&record, sizeof(record));
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <document root> <archive>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  root = argv[1];
+  root_descriptor = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (root_descriptor == -1) {
+    fail("cannot open document root", root);
+  }
+  collect("");
+
+  // use a load factor no more than 0.5 to keep probing short, which also leaves an empty slot
+  size_t n_slots = 2;
+  while (n_slots < n_files * 2) {
+    n_slots <<= 1;
+  }
+  struct archive_slot *slots = calloc(n_slots, sizeof(struct archive_slot));
+  char temporary[strlen(argv[2]) + 8];
+  sprintf(temporary, "%s.tmp", argv[2]);
+  output = fopen(temporary, "wb");
+  if (output == NULL) {
+    fail("cannot create", temporary);
+  }
+  // the header and the index are written once all files are placed
+  struct archive_header header = {.byte_order = ARCHIVE_BYTE_ORDER, .n_slots = n_slots, .n_files = n_files};
+  memcpy(header.magic, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LENGTH);
+  write_bytes(&header, sizeof(header));
+  write_bytes(slots, sizeof(struct archive_slot) * n_slots);
+  for (size_t i = 0; i < n_files; i++) {
+    pack(&files[i]);
+    uint64_t hash = hash_string(files[i].path);
+    size_t slot = hash & (n_slots - 1);
+    while (slots[slot].file != 0) {
+      slot = (slot + 1) & (n_slots - 1);
+    }
+    slots[slot].hash = hash;
+    slots[slot].file = files[i].offset;
+  }
+  if (fseek(output, sizeof(header), SEEK_SET) != 0) {
+    fail("cannot seek", temporary);
+  }
+  write_bytes(slots, sizeof(struct archive_slot) * n_slots);
+  if (fclose(output) != 0 || rename(temporary, argv[2]) != 0) {
+    fail("cannot write", argv[2]);
+  }
+  fprintf(stderr, "%zu files packed into %s\n", n_files, argv[2]);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
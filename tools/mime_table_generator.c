@@ -0,0 +1,184 @@
+// generate the perfect hash table used by mime.c from a file in the format of mime.types
+//  usage: mime_table_generator <mime.types> > mime_table.h
+//  the table is built with hash-and-displace: keys are first distributed into buckets by mime_hash with seed
+//   0, then buckets are placed from the largest to the smallest, searching for each bucket a displacement
+//   with which mime_hash places all its keys into free slots
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <mime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct entry {
+  struct mime_key key;
+  char extension[MIME_EXTENSION_MAX_LENGTH + 1];
+  size_t type; // index into types
+};
+struct bucket {
+  size_t index;
+  size_t size;
+  size_t *entries;
+};
+
+static char **types = NULL;
+static size_t n_types = 0;
+static struct entry *entries = NULL;
+static size_t n_entries = 0;
+
+static size_t add_type(const char *type) {
+  for (size_t i = 0; i < n_types; i++) {
+    if (strcmp(types[i], type) == 0) {
+      return i;
+    }
+  }
+  types = realloc(types, sizeof(types[0]) * (n_types + 1));
+  types[n_types] = strdup(type);
+  return n_types++;
+}
+static void add_entry(const char *extension, size_t type) {
+  struct mime_key key;
+  if (!mime_pack_key(extension, strlen(extension), &key)) {
+    fprintf(stderr, "extension %s is too long, ignored\n", extension);
+    return;
+  }
+  for (size_t i = 0; i < n_entries; i++) {
+    if (entries[i].key.low == key.low && entries[i].key.high == key.high) {
+      fprintf(stderr, "duplicated extension %s, the first mapping is kept\n", extension);
+      return;
+    }
+  }
+  entries = realloc(entries, sizeof(entries[0]) * (n_entries + 1));
+  entries[n_entries].key = key;
+  strcpy(entries[n_entries].extension, extension);
+  for (char *c = entries[n_entries].extension; *c != '\0'; c++) {
+    *c = tolower(*c);
+  }
+  entries[n_entries].type = type;
+  n_entries++;
+}
+static void parse(FILE *file) {
+  char line[1024];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char *save = NULL;
+    char *type = strtok_r(line, " \t\r\n", &save);
+    if (type == NULL) {
+      continue;
+    }
+    size_t index = add_type(type);
+    for (char *extension = strtok_r(NULL, " \t\r\n", &save); extension != NULL;
+         extension = strtok_r(NULL, " \t\r\n", &save)) {
+      add_entry(extension, index);
+    }
+  }
+}
+static int compare_bucket(const void *lhs_, const void *rhs_) {
+  const struct bucket *lhs = lhs_;
+  const struct bucket *rhs = rhs_;
+  if (lhs->size != rhs->size) {
+    return lhs->size > rhs->size ? -1 : 1;
+  }
+  return lhs->index < rhs->index ? -1 : (lhs->index > rhs->index);
+}
+static size_t round_up_power_of_two(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <mime.types>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  FILE *file = fopen(argv[1], "r");
+  if (file == NULL) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  parse(file);
+  fclose(file);
+  if (n_entries == 0) {
+    fprintf(stderr, "no extension found in %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // use a load factor no more than 0.5 to keep the search for displacements short
+  size_t n_slots = round_up_power_of_two(n_entries * 2);
+  size_t n_buckets = round_up_power_of_two((n_entries + 3) / 4);
+  struct bucket *buckets = calloc(n_buckets, sizeof(struct bucket));
+  for (size_t i = 0; i < n_buckets; i++) {
+    buckets[i].index = i;
+    buckets[i].entries = malloc(sizeof(size_t) * n_entries);
+  }
+  for (size_t i = 0; i < n_entries; i++) {
+    struct bucket *bucket = &buckets[mime_hash(&entries[i].key, 0) & (n_buckets - 1)];
+    bucket->entries[bucket->size++] = i;
+  }
+  qsort(buckets, n_buckets, sizeof(buckets[0]), compare_bucket);
+
+  long *slots = malloc(sizeof(long) * n_slots);
+  for (size_t i = 0; i < n_slots; i++) {
+    slots[i] = -1;
+  }
+  uint32_t *displacements = calloc(n_buckets, sizeof(uint32_t));
+  size_t *placed = malloc(sizeof(size_t) * n_entries);
+  for (size_t i = 0; i < n_buckets && buckets[i].size != 0; i++) {
+    struct bucket *bucket = &buckets[i];
+    uint32_t displacement = 1;
+    while (true) {
+      size_t n_placed = 0;
+      for (; n_placed < bucket->size; n_placed++) {
+        size_t slot = mime_hash(&entries[bucket->entries[n_placed]].key, displacement) & (n_slots - 1);
+        if (slots[slot] != -1) {
+          break;
+        }
+        slots[slot] = bucket->entries[n_placed];
+        placed[n_placed] = slot;
+      }
+      if (n_placed == bucket->size) {
+        break;
+      }
+      // roll back and try the next displacement
+      for (size_t j = 0; j < n_placed; j++) {
+        slots[placed[j]] = -1;
+      }
+      if (++displacement == 0) {
+        fprintf(stderr, "cannot find a perfect hash for the supplied extensions\n");
+        return EXIT_FAILURE;
+      }
+    }
+    displacements[bucket->index] = displacement;
+  }
+
+  printf("// generated by tools/mime_table_generator from %s, do not edit\n", argv[1]);
+  printf("//  %zu extensions of %zu media types in %zu slots with %zu buckets\n", n_entries, n_types, n_slots,
+         n_buckets);
+  printf("#ifndef MIME_TABLE_H_\n#define MIME_TABLE_H_\n");
+  printf("#include <mime.h>\n#include <stdint.h>\n");
+  printf("enum { MIME_TABLE_SLOTS = %zu, MIME_TABLE_BUCKETS = %zu };\n", n_slots, n_buckets);
+  printf("static const uint32_t mime_displacements[MIME_TABLE_BUCKETS] = {\n");
+  for (size_t i = 0; i < n_buckets; i++) {
+    printf("    %u,\n", displacements[i]);
+  }
+  printf("};\n");
+  printf("static const struct mime_slot {\n  struct mime_key key;\n  const char *type;\n} "
+         "mime_slots[MIME_TABLE_SLOTS] = {\n");
+  for (size_t i = 0; i < n_slots; i++) {
+    if (slots[i] == -1) {
+      printf("    {{0, 0}, NULL},\n");
+    } else {
+      const struct entry *entry = &entries[slots[i]];
+      printf("    {{0x%016llxull, 0x%016llxull}, \"%s\"}, // %s\n", (unsigned long long)entry->key.low,
+             (unsigned long long)entry->key.high, types[entry->type], entry->extension);
+    }
+  }
+  printf("};\n#endif\n");
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
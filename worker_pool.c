@@ -0,0 +1,173 @@
+#include <common.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <worker_pool.h>
+
+struct job {
+  void (*work)(void *context);
+  void (*complete)(void *context);
+  void *context;
+  struct job *next;
+};
+// a singly linked FIFO of jobs
+struct job_queue {
+  struct job *head;
+  struct job **tail;
+};
+struct worker_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t available; // signaled when a job is queued or the pool is stopping
+  struct job_queue queued;
+  struct job_queue completed;
+  size_t pending; // jobs queued, running or waiting for completion, modified atomically
+  size_t capacity;
+  bool stopping;
+  int event_file_descriptor;
+  size_t n_threads;
+  pthread_t threads[];
+};
+
+static void job_queue_initialize(struct job_queue *queue) {
+  queue->head = NULL;
+  queue->tail = &queue->head;
+}
+static void job_queue_push(struct job_queue *queue, struct job *job) {
+  job->next = NULL;
+  *queue->tail = job;
+  queue->tail = &job->next;
+}
+static struct job *job_queue_pop(struct job_queue *queue) {
+  struct job *job = queue->head;
+  if (job != NULL) {
+    queue->head = job->next;
+    if (queue->head == NULL) {
+      queue->tail = &queue->head;
+    }
+  }
+  return job;
+}
+
+static void *worker_main(void *argument) {
+  struct worker_pool *pool = argument;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (pool->queued.head == NULL && !pool->stopping) {
+      pthread_cond_wait(&pool->available, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    struct job *job = job_queue_pop(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    job->work(job->context);
+    pthread_mutex_lock(&pool->lock);
+    bool notify = pool->completed.head == NULL;
+    job_queue_push(&pool->completed, job);
+    if (notify) {
+      // the event loop drains all completed jobs at once, so only the first one needs a notification
+      uint64_t one = 1;
+      write(pool->event_file_descriptor, &one, sizeof(one));
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+struct worker_pool *worker_pool_create(size_t n_threads, size_t capacity) {
+  struct worker_pool *pool = malloc(sizeof(struct worker_pool) + sizeof(pthread_t) * n_threads);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->available, NULL);
+  job_queue_initialize(&pool->queued);
+  job_queue_initialize(&pool->completed);
+  pool->pending = 0;
+  pool->capacity = capacity;
+  pool->stopping = false;
+  pool->n_threads = 0;
+  pool->event_file_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pool->event_file_descriptor == -1) {
+    logging_error("cannot create eventfd for worker pool: %s\n", strerror(errno));
+    worker_pool_destroy(pool);
+    return NULL;
+  }
+  for (; pool->n_threads < n_threads; pool->n_threads++) {
+    int result = pthread_create(&pool->threads[pool->n_threads], NULL, worker_main, pool);
+    if (result != 0) {
+      logging_error("cannot create worker thread: %s\n", strerror(result));
+      worker_pool_destroy(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+bool worker_pool_submit(
+    struct worker_pool *pool, void (*work)(void *context), void (*complete)(void *context), void *context
+) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->capacity != 0 && __atomic_load_n(&pool->pending, __ATOMIC_RELAXED) >= pool->capacity) {
+    pthread_mutex_unlock(&pool->lock);
+    return false;
+  }
+  struct job *job = malloc(sizeof(struct job));
+  job->work = work;
+  job->complete = complete;
+  job->context = context;
+  job_queue_push(&pool->queued, job);
+  __atomic_add_fetch(&pool->pending, 1, __ATOMIC_RELAXED);
+  pthread_cond_signal(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+  return true;
+}
+
+int worker_pool_get_file_descriptor(const struct worker_pool *pool) { return pool->event_file_descriptor; }
+
+void worker_pool_dispatch(struct worker_pool *pool) {
+  uint64_t count;
+  if (read(pool->event_file_descriptor, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    logging_error("cannot read eventfd of worker pool: %s\n", strerror(errno));
+  }
+  pthread_mutex_lock(&pool->lock);
+  struct job *job = pool->completed.head;
+  job_queue_initialize(&pool->completed);
+  pthread_mutex_unlock(&pool->lock);
+  while (job != NULL) {
+    struct job *next = job->next;
+    // release the slot of the job before complete runs, so that complete can always submit a follow-up job
+    //  in its place even if the pool is at its capacity, as jobs are only submitted from the event loop
+    __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_RELAXED);
+    job->complete(job->context);
+    free(job);
+    job = next;
+  }
+}
+
+size_t worker_pool_get_pending(const struct worker_pool *pool) {
+  return __atomic_load_n(&pool->pending, __ATOMIC_RELAXED);
+}
+
+void worker_pool_destroy(struct worker_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 0; i < pool->n_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (struct job *job = job_queue_pop(&pool->queued); job != NULL; job = job_queue_pop(&pool->queued)) {
+    free(job);
+  }
+  for (struct job *job = job_queue_pop(&pool->completed); job != NULL;
+       job = job_queue_pop(&pool->completed)) {
+    free(job);
+  }
+  if (pool->event_file_descriptor != -1) {
+    close(pool->event_file_descriptor);
+  }
+  pthread_cond_destroy(&pool->available);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
\ No newline at end of file
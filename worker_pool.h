@@ -0,0 +1,33 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+#include <stdbool.h>
+#include <stddef.h>
+// a pool of threads running jobs off the event loop
+//  a job is a pair of functions called with the same context: work is called on a worker thread, and complete
+//  is called on the event loop thread once work returns, therefore only work needs to be thread-safe
+//  the event loop is notified of completed jobs by the file descriptor of the pool becoming readable, upon
+//  which worker_pool_dispatch shall be called
+struct worker_pool;
+
+// create a pool with n_threads threads, allowing at most capacity jobs queued or running at the same time,
+//  0 for no limit
+//  return NULL on failure
+struct worker_pool *worker_pool_create(size_t n_threads, size_t capacity);
+
+// submit a job to the pool, return false if the pool is at its capacity, in which case nothing is done
+bool worker_pool_submit(
+    struct worker_pool *pool, void (*work)(void *context), void (*complete)(void *context), void *context
+);
+
+// get the file descriptor which becomes readable when there are completed jobs
+int worker_pool_get_file_descriptor(const struct worker_pool *pool);
+
+// call complete of all completed jobs, this shall be called on the event loop thread
+void worker_pool_dispatch(struct worker_pool *pool);
+
+// get number of jobs queued or running
+size_t worker_pool_get_pending(const struct worker_pool *pool);
+
+// stop all threads and free the pool, jobs not yet started are dropped without calling either function
+void worker_pool_destroy(struct worker_pool *pool);
+#endif
\ No newline at end of file